@@ -0,0 +1,306 @@
+#include "Allocator.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+void MemoryAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize preferredBlockSize) {
+	this->logicalDevice = logicalDevice;
+	this->preferredBlockSize = preferredBlockSize;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &this->memoryProperties);
+}
+
+void MemoryAllocator::Destroy() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	for (Block& block : this->blocks) {
+		if (block.memory != VK_NULL_HANDLE) {
+			vkFreeMemory(this->logicalDevice, block.memory, nullptr);
+		}
+	}
+
+	this->blocks.clear();
+	this->emptyBlocks.clear();
+}
+
+VkDeviceSize MemoryAllocator::GetBlockSize(uint32_t memoryType) {
+	VkDeviceSize heapSize = this->memoryProperties.memoryHeaps[this->memoryProperties.memoryTypes[memoryType].heapIndex].size;
+
+	// Small heaps (e.g. the 256 MiB device-local host-visible heap) get proportionally smaller blocks.
+	if (heapSize <= 1024ull * 1024 * 1024) {
+		return std::min(this->preferredBlockSize, heapSize / 8);
+	}
+
+	return this->preferredBlockSize;
+}
+
+void* MemoryAllocator::MapMemory(VkDeviceMemory memory, uint32_t memoryType) {
+	if (!(this->memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+		return nullptr;
+	}
+
+	void* mapped = nullptr;
+
+	if (vkMapMemory(this->logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+		throw std::runtime_error("Could not map device memory block.");
+	}
+
+	return mapped;
+}
+
+uint32_t MemoryAllocator::CreateBlock(uint32_t memoryType, bool linear, VkDeviceSize size) {
+	Block block = {};
+	block.size = size;
+	block.memoryType = memoryType;
+	block.linear = linear;
+
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = memoryType;
+
+	if (vkAllocateMemory(this->logicalDevice, &allocateInfo, nullptr, &block.memory) != VK_SUCCESS) {
+		throw std::runtime_error("Could not allocate device memory block.");
+	}
+
+	block.mapped = MapMemory(block.memory, memoryType);
+	block.freeRanges[0] = size;
+
+	// Reuse the slot of a released block so existing allocations keep their indices.
+	if (!this->emptyBlocks.empty()) {
+		uint32_t index = this->emptyBlocks.back();
+		this->emptyBlocks.pop_back();
+		this->blocks[index] = block;
+		return index;
+	}
+
+	this->blocks.push_back(block);
+	return static_cast<uint32_t>(this->blocks.size() - 1);
+}
+
+bool MemoryAllocator::AllocateFromBlock(uint32_t blockIndex, const VkMemoryRequirements& requirements, Allocation& allocation) {
+	Block& block = this->blocks[blockIndex];
+
+	// Best fit: the free range that leaves the least space behind once aligned.
+	std::map<VkDeviceSize, VkDeviceSize>::iterator best = block.freeRanges.end();
+	VkDeviceSize bestLeftover = UINT64_MAX;
+
+	for (std::map<VkDeviceSize, VkDeviceSize>::iterator it = block.freeRanges.begin(); it != block.freeRanges.end(); it++) {
+		VkDeviceSize alignedOffset = AlignUp(it->first, requirements.alignment);
+		VkDeviceSize rangeEnd = it->first + it->second;
+
+		if (alignedOffset + requirements.size > rangeEnd) {
+			continue;
+		}
+
+		VkDeviceSize leftover = it->second - requirements.size;
+
+		if (leftover < bestLeftover) {
+			best = it;
+			bestLeftover = leftover;
+		}
+	}
+
+	if (best == block.freeRanges.end()) {
+		return false;
+	}
+
+	VkDeviceSize rangeStart = best->first;
+	VkDeviceSize rangeEnd = best->first + best->second;
+	VkDeviceSize alignedOffset = AlignUp(rangeStart, requirements.alignment);
+	VkDeviceSize allocationEnd = alignedOffset + requirements.size;
+
+	block.freeRanges.erase(best);
+
+	VkDeviceSize reservedStart = rangeStart;
+	VkDeviceSize reservedEnd = rangeEnd;
+
+	if (alignedOffset - rangeStart >= this->MIN_FRAGMENT_SIZE) {
+		block.freeRanges[rangeStart] = alignedOffset - rangeStart;
+		reservedStart = alignedOffset;
+	}
+
+	if (rangeEnd - allocationEnd >= this->MIN_FRAGMENT_SIZE) {
+		block.freeRanges[allocationEnd] = rangeEnd - allocationEnd;
+		reservedEnd = allocationEnd;
+	}
+
+	allocation.memory = block.memory;
+	allocation.offset = alignedOffset;
+	allocation.size = requirements.size;
+	allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + alignedOffset : nullptr;
+	allocation.memoryType = block.memoryType;
+	allocation.block = blockIndex;
+	allocation.rangeOffset = reservedStart;
+	allocation.rangeSize = reservedEnd - reservedStart;
+
+	block.allocationCount++;
+	block.bytesUsed += allocation.size;
+	block.bytesWasted += allocation.rangeSize - allocation.size;
+
+	return true;
+}
+
+Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	Allocation allocation = {};
+	VkDeviceSize blockSize = GetBlockSize(memoryType);
+
+	if (requirements.size > blockSize / 2) {
+		VkMemoryAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = requirements.size;
+		allocateInfo.memoryTypeIndex = memoryType;
+
+		if (vkAllocateMemory(this->logicalDevice, &allocateInfo, nullptr, &allocation.memory) != VK_SUCCESS) {
+			throw std::runtime_error("Could not allocate dedicated device memory.");
+		}
+
+		allocation.offset = 0;
+		allocation.size = requirements.size;
+		allocation.mapped = MapMemory(allocation.memory, memoryType);
+		allocation.memoryType = memoryType;
+		allocation.block = UINT32_MAX;
+		allocation.rangeOffset = 0;
+		allocation.rangeSize = requirements.size;
+
+		this->dedicatedCount++;
+		this->dedicatedBytes += requirements.size;
+
+		return allocation;
+	}
+
+	for (uint32_t i = 0; i < this->blocks.size(); i++) {
+		Block& block = this->blocks[i];
+
+		if (block.memory == VK_NULL_HANDLE || block.memoryType != memoryType || block.linear != linear) {
+			continue;
+		}
+
+		if (AllocateFromBlock(i, requirements, allocation)) {
+			return allocation;
+		}
+	}
+
+	uint32_t blockIndex = CreateBlock(memoryType, linear, blockSize);
+
+	if (!AllocateFromBlock(blockIndex, requirements, allocation)) {
+		throw std::runtime_error("Could not sub-allocate from a new device memory block.");
+	}
+
+	return allocation;
+}
+
+void MemoryAllocator::Free(Allocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	if (allocation.block == UINT32_MAX) {
+		vkFreeMemory(this->logicalDevice, allocation.memory, nullptr);
+
+		this->dedicatedCount--;
+		this->dedicatedBytes -= allocation.size;
+
+		allocation = {};
+		return;
+	}
+
+	Block& block = this->blocks[allocation.block];
+
+	VkDeviceSize offset = allocation.rangeOffset;
+	VkDeviceSize size = allocation.rangeSize;
+
+	// Coalesce with the neighbouring free ranges on both sides.
+	std::map<VkDeviceSize, VkDeviceSize>::iterator next = block.freeRanges.lower_bound(offset);
+
+	if (next != block.freeRanges.begin()) {
+		std::map<VkDeviceSize, VkDeviceSize>::iterator prev = std::prev(next);
+
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			block.freeRanges.erase(prev);
+		}
+	}
+
+	if (next != block.freeRanges.end() && offset + size == next->first) {
+		size += next->second;
+		block.freeRanges.erase(next);
+	}
+
+	block.freeRanges[offset] = size;
+
+	block.allocationCount--;
+	block.bytesUsed -= allocation.size;
+	block.bytesWasted -= allocation.rangeSize - allocation.size;
+
+	uint32_t blockIndex = allocation.block;
+	allocation = {};
+
+	if (block.allocationCount > 0) {
+		return;
+	}
+
+	// Keep one empty block per memory type around so load/unload cycles don't thrash vkAllocateMemory.
+	for (uint32_t i = 0; i < this->blocks.size(); i++) {
+		const Block& other = this->blocks[i];
+
+		if (i != blockIndex && other.memory != VK_NULL_HANDLE && other.memoryType == block.memoryType && other.linear == block.linear) {
+			vkFreeMemory(this->logicalDevice, block.memory, nullptr);
+			block = {};
+			this->emptyBlocks.push_back(blockIndex);
+			return;
+		}
+	}
+}
+
+AllocatorStats MemoryAllocator::GetStats() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	AllocatorStats stats = {};
+
+	for (const Block& block : this->blocks) {
+		if (block.memory == VK_NULL_HANDLE) {
+			continue;
+		}
+
+		stats.blockCount++;
+		stats.allocationCount += block.allocationCount;
+		stats.bytesAllocated += block.size;
+		stats.bytesUsed += block.bytesUsed;
+		stats.bytesWasted += block.bytesWasted;
+
+		for (const std::pair<const VkDeviceSize, VkDeviceSize>& range : block.freeRanges) {
+			stats.freeRangeCount++;
+			stats.bytesFree += range.second;
+			stats.largestFreeRange = std::max(stats.largestFreeRange, range.second);
+		}
+	}
+
+	stats.dedicatedCount = this->dedicatedCount;
+	stats.allocationCount += this->dedicatedCount;
+	stats.bytesAllocated += this->dedicatedBytes;
+	stats.bytesUsed += this->dedicatedBytes;
+
+	return stats;
+}
+
+void MemoryAllocator::PrintStats() {
+	AllocatorStats stats = GetStats();
+
+	// 0% means all free space is one contiguous range; close to 100% means it is split into many small ones.
+	double fragmentation = stats.bytesFree > 0 ? 100.0 * (1.0 - (double)stats.largestFreeRange / stats.bytesFree) : 0.0;
+
+	std::cout << "Device memory: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks + " << stats.dedicatedCount << " dedicated, "
+		<< (stats.bytesAllocated / 1024) << " KiB allocated, " << (stats.bytesUsed / 1024) << " KiB used, " << (stats.bytesWasted / 1024) << " KiB wasted, "
+		<< (stats.bytesFree / 1024) << " KiB free in " << stats.freeRangeCount << " ranges (largest " << (stats.largestFreeRange / 1024) << " KiB, " << fragmentation << "% fragmented)" << std::endl;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+#include <mutex>
+
+// A sub-range of a VkDeviceMemory block. mapped is non-null for host-visible memory, which stays mapped for the lifetime of the block.
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;
+
+	uint32_t memoryType = 0;
+	// Index into the allocator's block list, or UINT32_MAX for a dedicated allocation.
+	uint32_t block = UINT32_MAX;
+
+	// The range actually reserved in the block, including alignment padding and absorbed fragments.
+	VkDeviceSize rangeOffset = 0;
+	VkDeviceSize rangeSize = 0;
+};
+
+struct AllocatorStats {
+	uint32_t blockCount = 0;
+	uint32_t dedicatedCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t freeRangeCount = 0;
+	VkDeviceSize bytesAllocated = 0;
+	VkDeviceSize bytesUsed = 0;
+	VkDeviceSize bytesWasted = 0;
+	VkDeviceSize bytesFree = 0;
+	VkDeviceSize largestFreeRange = 0;
+};
+
+// Block-based device memory sub-allocator. Each memory type gets its own list of blocks, with buffers and images
+// kept in separate blocks so bufferImageGranularity never has to be considered. Free space is tracked per block
+// as an offset-ordered free list that is coalesced on free; resources larger than half a block get their own allocation.
+class MemoryAllocator {
+private:
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		uint32_t memoryType = 0;
+		bool linear = true;
+
+		// offset -> size of every free range.
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges = {};
+		uint32_t allocationCount = 0;
+		VkDeviceSize bytesUsed = 0;
+		VkDeviceSize bytesWasted = 0;
+	};
+
+	// Free fragments smaller than this are handed to the allocation next to them instead of being kept.
+	const VkDeviceSize MIN_FRAGMENT_SIZE = 256;
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	VkDeviceSize preferredBlockSize = 0;
+
+	std::vector<Block> blocks = {};
+	std::vector<uint32_t> emptyBlocks = {};
+
+	uint32_t dedicatedCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+
+	std::mutex mutex;
+
+	VkDeviceSize GetBlockSize(uint32_t memoryType);
+	uint32_t CreateBlock(uint32_t memoryType, bool linear, VkDeviceSize size);
+	bool AllocateFromBlock(uint32_t blockIndex, const VkMemoryRequirements& requirements, Allocation& allocation);
+	void* MapMemory(VkDeviceMemory memory, uint32_t memoryType);
+
+public:
+	void Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize preferredBlockSize = 64 * 1024 * 1024);
+	void Destroy();
+
+	Allocation Allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear);
+	void Free(Allocation& allocation);
+
+	AllocatorStats GetStats();
+	void PrintStats();
+};
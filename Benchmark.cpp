@@ -0,0 +1,125 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+static double Percentile(const std::vector<double>& sorted, double percentile) {
+	// Nearest-rank percentile over an already sorted sample set.
+	size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()));
+	return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+BenchmarkStats ComputeBenchmarkStats(std::vector<double> samples) {
+	BenchmarkStats stats = {};
+
+	if (samples.empty()) {
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (double sample : samples) {
+		sum += sample;
+	}
+
+	stats.mean = sum / samples.size();
+	stats.p50 = Percentile(samples, 50.0);
+	stats.p95 = Percentile(samples, 95.0);
+	stats.p99 = Percentile(samples, 99.0);
+	stats.max = samples.back();
+
+	return stats;
+}
+
+static std::vector<double> Column(const std::vector<FrameTiming>& timings, double FrameTiming::* field) {
+	std::vector<double> column(timings.size());
+
+	for (size_t i = 0; i < timings.size(); i++) {
+		column[i] = timings[i].*field;
+	}
+
+	return column;
+}
+
+static const std::vector<std::pair<const char*, double FrameTiming::*>> columns = {
+	{ "cpu", &FrameTiming::cpuMs },
+	{ "fence_wait", &FrameTiming::fenceWaitMs },
+	{ "acquire", &FrameTiming::acquireMs },
+	{ "cull", &FrameTiming::cullMs },
+	{ "record", &FrameTiming::recordMs },
+	{ "present", &FrameTiming::presentMs },
+	{ "latency", &FrameTiming::latencyMs },
+};
+
+void PrintBenchmarkSummary(const std::vector<FrameTiming>& timings, double totalMs, const std::vector<double>& resizeMs) {
+	std::cout << "Benchmark: " << timings.size() << " frames in " << totalMs << " ms (" << (timings.size() * 1000.0 / totalMs) << " fps)" << std::endl;
+	std::cout << std::fixed << std::setprecision(4);
+	std::cout << std::setw(12) << "ms" << std::setw(12) << "mean" << std::setw(12) << "p50" << std::setw(12) << "p95" << std::setw(12) << "p99" << std::setw(12) << "max" << std::endl;
+
+	for (const auto& column : columns) {
+		BenchmarkStats stats = ComputeBenchmarkStats(Column(timings, column.second));
+		std::cout << std::setw(12) << column.first << std::setw(12) << stats.mean << std::setw(12) << stats.p50 << std::setw(12) << stats.p95 << std::setw(12) << stats.p99 << std::setw(12) << stats.max << std::endl;
+	}
+
+	if (!resizeMs.empty()) {
+		BenchmarkStats stats = ComputeBenchmarkStats(resizeMs);
+		std::cout << std::setw(12) << "resize" << std::setw(12) << stats.mean << std::setw(12) << stats.p50 << std::setw(12) << stats.p95 << std::setw(12) << stats.p99 << std::setw(12) << stats.max << "  (" << resizeMs.size() << " swapchain recreations)" << std::endl;
+	}
+
+	std::cout << std::defaultfloat;
+}
+
+void WriteBenchmarkCSV(const std::string& fileName, const std::vector<FrameTiming>& timings) {
+	std::ofstream file(fileName);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("Could not open file " + fileName);
+	}
+
+	file << "frame,cpu_ms,fence_wait_ms,acquire_ms,cull_ms,record_ms,present_ms,latency_ms\n";
+
+	for (size_t i = 0; i < timings.size(); i++) {
+		file << i << "," << timings[i].cpuMs << "," << timings[i].fenceWaitMs << "," << timings[i].acquireMs << "," << timings[i].cullMs << "," << timings[i].recordMs << "," << timings[i].presentMs << "," << timings[i].latencyMs << "\n";
+	}
+}
+
+void WriteBenchmarkJSON(const std::string& fileName, const std::vector<FrameTiming>& timings, double totalMs, const std::vector<double>& resizeMs) {
+	std::ofstream file(fileName);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("Could not open file " + fileName);
+	}
+
+	file << "{\n";
+	file << "  \"frames\": " << timings.size() << ",\n";
+	file << "  \"total_ms\": " << totalMs << ",\n";
+	file << "  \"summary\": {\n";
+
+	for (size_t c = 0; c < columns.size(); c++) {
+		BenchmarkStats stats = ComputeBenchmarkStats(Column(timings, columns[c].second));
+		file << "    \"" << columns[c].first << "\": { \"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << " }";
+		file << (c + 1 < columns.size() ? ",\n" : "\n");
+	}
+
+	file << "  },\n";
+
+	if (!resizeMs.empty()) {
+		BenchmarkStats stats = ComputeBenchmarkStats(resizeMs);
+		file << "  \"resize\": { \"count\": " << resizeMs.size() << ", \"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << " },\n";
+	}
+
+	file << "  \"per_frame\": [\n";
+
+	for (size_t i = 0; i < timings.size(); i++) {
+		file << "    { \"cpu\": " << timings[i].cpuMs << ", \"fence_wait\": " << timings[i].fenceWaitMs << ", \"acquire\": " << timings[i].acquireMs << ", \"cull\": " << timings[i].cullMs << ", \"record\": " << timings[i].recordMs << ", \"present\": " << timings[i].presentMs << ", \"latency\": " << timings[i].latencyMs << " }";
+		file << (i + 1 < timings.size() ? ",\n" : "\n");
+	}
+
+	file << "  ]\n";
+	file << "}\n";
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+// Per-frame timings recorded by the benchmark harness, all in milliseconds.
+struct FrameTiming {
+	double cpuMs = 0.0;
+	double fenceWaitMs = 0.0;
+	double acquireMs = 0.0;
+	// Recording the frame's command buffers, when they are recorded every frame.
+	double recordMs = 0.0;
+	// Frustum culling on the CPU, when it is enabled.
+	double cullMs = 0.0;
+	double presentMs = 0.0;
+	// From polling input to the GPU finishing the frame, to within a frame, for the last frame that finished during
+	// this one. Excludes the compositor and scanout, which Vulkan doesn't report without present timing extensions.
+	double latencyMs = 0.0;
+};
+
+struct BenchmarkStats {
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+BenchmarkStats ComputeBenchmarkStats(std::vector<double> samples);
+
+void PrintBenchmarkSummary(const std::vector<FrameTiming>& timings, double totalMs, const std::vector<double>& resizeMs = {});
+void WriteBenchmarkCSV(const std::string& fileName, const std::vector<FrameTiming>& timings);
+void WriteBenchmarkJSON(const std::string& fileName, const std::vector<FrameTiming>& timings, double totalMs, const std::vector<double>& resizeMs = {});
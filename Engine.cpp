@@ -3,9 +3,6 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include<tiny_obj_loader.h>
-
 
 Engine::Engine() {
 
@@ -23,40 +20,142 @@ void Engine::VKCheck(const char* message, VkResult result) {
 }
 
 void Engine::Load() {
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	this->MAX_CONCURRENT_FRAMES = std::min(std::max(this->MAX_CONCURRENT_FRAMES, 1u), 4u);
+	this->framePacer.SetLimit(this->FPS_LIMIT);
+
+	if (!this->HEADLESS) {
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	}
 
 	CreateInstance();
-	this->window = glfwCreateWindow(static_cast<uint32_t>(this->WIN_W), static_cast<uint32_t>(this->WIN_H), this->TITLE, nullptr, nullptr);
-	CreateWindowSurface();
+
+	if (!this->HEADLESS) {
+		this->window = glfwCreateWindow(static_cast<uint32_t>(this->WIN_W), static_cast<uint32_t>(this->WIN_H), this->TITLE, nullptr, nullptr);
+		CreateWindowSurface();
+	}
+
 	CreatePhysicalDevice();
 	GetQueueFamilies();
 	CreateLogicalDevice();
-	GetSwapchainDetails(this->physicalDevice, this->swapchainDetails);
-	CreateSwapchain(this->swapchain, this->WIN_W, this->WIN_H);
-	GetSwapImages(this->swapchain, this->swapImages);
+	this->allocator.Init(this->physicalDevice, this->logicalDevice);
+	this->deviceLocalHostVisible = HasDeviceLocalHostVisibleMemory();
+	CreateStagingRing();
+
+	if (this->HEADLESS) {
+		CreateOffscreenImages();
+	}
+	else {
+		GetSwapchainDetails(this->physicalDevice, this->swapchainDetails);
+		CreateSwapchain(this->swapchain, this->WIN_W, this->WIN_H);
+		GetSwapImages(this->swapchain, this->swapImages);
+	}
+
 	CreateImageViews();
 	CreateRenderPass();
 	CreateDescriptorSetLayout();
+	CreatePipelineCache();
+	ResolveVertexLayout();
 	CreateGraphicsPipeline();
+	CreateCullingPipeline();
+	ResolveCullMode();
 	CreateCommandPool(this->commandPool, this->queueFamilies.graphicsQF.value());
-	CreateCommandPool(this->copyPool, this->queueFamilies.graphicsQF.value());
+	QueryTimestampSupport();
 	CreateColorResources();
 	CreateDepthResources();
 	CreateFramebuffers();
-	CreateTextureImage(this->TEXTURE_PATH);
-	//CreateTextureImage("textures/pokeball.png");
-	//CreateTextureImage("textures/naruto.jpg");
+
+	CreateScene();
+
+	// Every transition, copy and blit of the initial assets goes into one submission.
+	UploadBatch uploadBatch;
+	BeginUploadBatch(uploadBatch);
+	CreateInstanceBuffer(uploadBatch);
+
+	if (UseAssetStreaming()) {
+		// Drawn until the streamed texture and model become resident, see PollAssetStreaming.
+		CreatePlaceholderAssets(uploadBatch);
+		StreamAsset(StreamedAssetType::Texture, this->TEXTURE_PATH);
+		StreamAsset(StreamedAssetType::Model, this->MODEL_PATH);
+	}
+	else {
+		CreateTextureImage(this->TEXTURE_PATH, uploadBatch);
+		//CreateTextureImage("textures/pokeball.png", uploadBatch);
+		//CreateTextureImage("textures/naruto.jpg", uploadBatch);
+		CreateModel(this->MODEL_PATH);
+		CreateVertexBuffer(uploadBatch);
+		CreateIndicesBuffer(uploadBatch);
+		this->meshCache.Close();
+	}
+
+	BuildDrawList();
+	CreateCullingBuffers(uploadBatch);
+	SubmitUploadBatch(uploadBatch);
+
 	CreateTextureImageViews(this->mipLevels);
 	CreateTextureSampler();
-	CreateModel(this->MODEL_PATH);
-	CreateVertexBuffer();
-	CreateIndicesBuffer();
-	CreateUniformBuffers();
+	CreateUniformBuffer();
 	CreateDescriptorPool();
-	CreateDescriptorSets();
+	CreateDescriptorSet();
+	CreateCullingDescriptorSet();
+
+	// Without a callback nobody reads the pixels, so frames skip the copy altogether.
+	if (this->HEADLESS && this->readbackCallback) {
+		CreateReadbackBuffers();
+	}
+
+	CreateFrameQueryPool();
 	CreateCommandBuffers();
+	CreateFrameCommands();
 	CreateSyncObjects();
+
+	// Waited on last so the uploads overlap with the rest of the setup.
+	FinishUploadBatch(uploadBatch);
+}
+
+static double ElapsedMs(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void OptimizeLoadedMesh(ObjMesh& mesh, const char* name) {
+	std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+	MeshOptimizationStats stats = OptimizeMesh(mesh);
+
+	std::cout << "Optimized model " << name << ": ACMR " << stats.before.acmr << " -> " << stats.after.acmr << ", ATVR " << stats.before.atvr << " -> " << stats.after.atvr
+		<< " in " << ElapsedMs(startTime) << " ms" << std::endl;
+}
+
+static void BuildLoadedMeshLods(ObjMesh& mesh, const char* name, uint32_t levelCount) {
+	std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+	size_t baseIndexCount = mesh.indices.size();
+	BuildLodChain(mesh, levelCount);
+
+	std::cout << "Built " << mesh.lodErrors.size() << " levels of detail for model " << name << " (" << ((mesh.indices.size() - baseIndexCount) / 3) << " extra triangles, coarsest error "
+		<< mesh.lodErrors.back() << ") in " << ElapsedMs(startTime) << " ms" << std::endl;
+}
+
+static const char* GetCullModeName(CullMode mode) {
+	switch (mode) {
+	case CullMode::CPU:
+		return "CPU";
+	case CullMode::GPU:
+		return "GPU";
+	default:
+		return "off";
+	}
+}
+
+static const char* GetPresentModeName(VkPresentModeKHR mode) {
+	switch (mode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "IMMEDIATE";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "MAILBOX";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "FIFO_RELAXED";
+	default:
+		return "FIFO";
+	}
 }
 
 static void ResizeCallback(GLFWwindow* window, int width, int height) {
@@ -91,31 +190,199 @@ static void KeyPressCallback(GLFWwindow* window, int key, int scancode, int acti
 		case GLFW_KEY_E:
 			application->ROTATION_ANGLE -= 1.0f;
 			break;
+		case GLFW_KEY_P:
+			if (action == GLFW_PRESS) {
+				application->CyclePresentMode();
+			}
+			break;
 		}
 	}
 }
 
 void Engine::Start() {
+	// Benchmarks and headless captures start from the real assets so their frames are reproducible.
+	if (this->BENCHMARK || this->HEADLESS) {
+		FinishAssetStreaming();
+	}
+
+	if (this->BENCHMARK) {
+		if (!this->HEADLESS) {
+			// No key callback, so the camera stays fixed for the whole run.
+			glfwSetWindowUserPointer(this->window, this);
+			glfwSetFramebufferSizeCallback(this->window, ResizeCallback);
+		}
+
+		if (!this->BENCHMARK_CULLING) {
+			RunBenchmark();
+			return;
+		}
+
+		std::string output = this->BENCHMARK_OUTPUT;
+
+		for (CullMode mode : { CullMode::Off, CullMode::CPU, CullMode::GPU }) {
+			SetCullMode(mode);
+
+			if (this->cullMode != mode) {
+				continue;
+			}
+
+			std::cout << "Culling " << GetCullModeName(mode) << ":" << std::endl;
+
+			this->BENCHMARK_OUTPUT = output.empty() ? output : output + "_cull_" + GetCullModeName(mode);
+			this->timestampStats.clear();
+			RunBenchmark();
+			PrintTimestampStats();
+		}
+
+		this->BENCHMARK_OUTPUT = output;
+		this->timestampStats.clear();
+		return;
+	}
+
+	if (this->HEADLESS) {
+		std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+
+		for (size_t i = 0; i < this->HEADLESS_FRAMES; i++) {
+			Render();
+		}
+
+		vkDeviceWaitIdle(this->logicalDevice);
+		FlushReadbacks();
+
+		double elapsed = ElapsedMs(startTime);
+		std::cout << "Rendered " << this->HEADLESS_FRAMES << " offscreen frames in " << elapsed << " ms (" << (this->HEADLESS_FRAMES * 1000.0 / elapsed) << " fps)" << std::endl;
+		return;
+	}
 
 	glfwSetWindowUserPointer(this->window, this);
 	glfwSetFramebufferSizeCallback(this->window, ResizeCallback);
 	glfwSetKeyCallback(this->window, KeyPressCallback);
 
+	std::chrono::time_point reportStart = std::chrono::high_resolution_clock::now();
+	size_t reportFrames = 0;
+	double reportLatencyMs = 0.0;
+
 	while (!glfwWindowShouldClose(this->window)) {
+		// Input is polled after the pacing wait, so frames start from the freshest input.
+		this->framePacer.Wait();
 		glfwPollEvents();
 
+		this->frameTiming = {};
+		Render();
+
+		reportFrames++;
+		reportLatencyMs += this->frameTiming.latencyMs;
+
+		double reportMs = ElapsedMs(reportStart);
+
+		if (reportMs >= 1000.0) {
+			char title[256];
+			snprintf(title, sizeof(title), "%s - %.0f fps, %.1f ms latency, %s, %u frames in flight", this->TITLE, reportFrames * 1000.0 / reportMs, reportLatencyMs / reportFrames, GetPresentModeName(this->presentMode), this->MAX_CONCURRENT_FRAMES);
+			glfwSetWindowTitle(this->window, title);
+
+			reportStart = std::chrono::high_resolution_clock::now();
+			reportFrames = 0;
+			reportLatencyMs = 0.0;
+		}
+	}
+
+	vkDeviceWaitIdle(this->logicalDevice);
+}
+
+void Engine::RunBenchmark() {
+	for (size_t i = 0; i < this->BENCHMARK_WARMUP_FRAMES; i++) {
+		this->framePacer.Wait();
+
+		if (!this->HEADLESS) {
+			glfwPollEvents();
+		}
+
+		Render();
+	}
+
+	std::vector<FrameTiming> timings;
+	timings.reserve(this->BENCHMARK_FRAMES);
+
+	this->resizeTimings.clear();
+
+	int windowWidth = 0, windowHeight = 0;
+	size_t resizeInterval = 0;
+
+	if (!this->HEADLESS && this->BENCHMARK_RESIZES > 0) {
+		glfwGetWindowSize(this->window, &windowWidth, &windowHeight);
+		resizeInterval = std::max<size_t>(1, this->BENCHMARK_FRAMES / (this->BENCHMARK_RESIZES + 1));
+	}
+
+	std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	while (true) {
+		if (this->BENCHMARK_SECONDS > 0.0 ? ElapsedMs(startTime) >= this->BENCHMARK_SECONDS * 1000.0 : timings.size() >= this->BENCHMARK_FRAMES) {
+			break;
+		}
+
+		if (!this->HEADLESS) {
+			if (glfwWindowShouldClose(this->window)) {
+				break;
+			}
+
+			// Alternate between the original size and three quarters of it; the resize lands on the next poll.
+			if (resizeInterval > 0 && timings.size() > 0 && timings.size() % resizeInterval == 0) {
+				bool shrink = (timings.size() / resizeInterval) % 2 == 1;
+				glfwSetWindowSize(this->window, shrink ? windowWidth * 3 / 4 : windowWidth, shrink ? windowHeight * 3 / 4 : windowHeight);
+			}
+		}
+
+		this->framePacer.Wait();
+
+		if (!this->HEADLESS) {
+			glfwPollEvents();
+		}
+
+		this->frameTiming = {};
+
+		std::chrono::time_point frameStart = std::chrono::high_resolution_clock::now();
 		Render();
+		this->frameTiming.cpuMs = ElapsedMs(frameStart);
+
+		timings.push_back(this->frameTiming);
 	}
 
 	vkDeviceWaitIdle(this->logicalDevice);
+	FlushReadbacks();
+
+	double totalMs = ElapsedMs(startTime);
+
+	PrintBenchmarkSummary(timings, totalMs, this->resizeTimings);
+
+	if (!this->BENCHMARK_OUTPUT.empty()) {
+		WriteBenchmarkCSV(this->BENCHMARK_OUTPUT + ".csv", timings);
+		WriteBenchmarkJSON(this->BENCHMARK_OUTPUT + ".json", timings, totalMs, this->resizeTimings);
+	}
 }
 
 void Engine::Render() {
+	// Input has just been polled; the frame's latency runs from here.
+	std::chrono::time_point frameStart = std::chrono::high_resolution_clock::now();
+
+	if (!this->streamedAssets.empty()) {
+		PollAssetStreaming(false);
+	}
+
+	if (this->HEADLESS) {
+		RenderOffscreen();
+		return;
+	}
+
+	std::chrono::time_point fenceStart = std::chrono::high_resolution_clock::now();
 	vkWaitForFences(this->logicalDevice, 1, &this->inFlightFences[this->currentFrame], VK_TRUE, UINT64_MAX);
+	this->frameTiming.fenceWaitMs = ElapsedMs(fenceStart);
+	CollectFrameLatencies();
 	
 	uint32_t imageIndex;
 
+	std::chrono::time_point acquireStart = std::chrono::high_resolution_clock::now();
 	VkResult result = vkAcquireNextImageKHR(this->logicalDevice, this->swapchain, UINT64_MAX, this->imagesAvailableSemaphores[this->currentFrame], VK_NULL_HANDLE, &imageIndex);
+	this->frameTiming.acquireMs = ElapsedMs(acquireStart);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		RecreateSwapchain();
@@ -125,14 +392,32 @@ void Engine::Render() {
 		throw std::runtime_error("Could not acquire image.");
 	}
 
-	UpdateUniformBuffers(imageIndex);
-
 	if (this->imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+		fenceStart = std::chrono::high_resolution_clock::now();
 		vkWaitForFences(this->logicalDevice, 1, &this->imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+		this->frameTiming.fenceWaitMs += ElapsedMs(fenceStart);
 	}
 
 	this->imagesInFlight[imageIndex] = this->inFlightFences[this->currentFrame];
 
+	CollectFrameTimestamps(imageIndex);
+
+	// The image's uniforms, like its culling output, may still be read by an older frame until the wait above.
+	UpdateUniformBuffer(imageIndex);
+
+	if (this->cullMode == CullMode::CPU) {
+		std::chrono::time_point cullStart = std::chrono::high_resolution_clock::now();
+		CullOnCPU(imageIndex);
+		this->frameTiming.cullMs = ElapsedMs(cullStart);
+	}
+
+	VkCommandBuffer commandBuffer = this->commandBuffers.empty() ? VK_NULL_HANDLE : this->commandBuffers[imageIndex];
+
+	if (this->RECORD_EVERY_FRAME) {
+		std::chrono::time_point recordStart = std::chrono::high_resolution_clock::now();
+		commandBuffer = RecordFrame(imageIndex);
+		this->frameTiming.recordMs = ElapsedMs(recordStart);
+	}
 
 	VkPipelineStageFlags stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	VkSemaphore waitSemaphores[] = { this->imagesAvailableSemaphores[this->currentFrame] };
@@ -140,7 +425,7 @@ void Engine::Render() {
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pCommandBuffers = &this->commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &commandBuffer;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = stages;
@@ -152,6 +437,8 @@ void Engine::Render() {
 	vkResetFences(this->logicalDevice, 1, &this->inFlightFences[this->currentFrame]);
 
 	VKCheck("Could not submit queue.", vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, this->inFlightFences[this->currentFrame]));
+	this->frameInputTimes[this->currentFrame] = frameStart;
+	this->frameLatencyPending[this->currentFrame] = true;
 
 	std::vector<VkSwapchainKHR> swapchains = { this->swapchain };
 
@@ -163,7 +450,9 @@ void Engine::Render() {
 	presentInfo.pWaitSemaphores = signalSemaphores;
 	presentInfo.pImageIndices = &imageIndex;
 
+	std::chrono::time_point presentStart = std::chrono::high_resolution_clock::now();
 	result = vkQueuePresentKHR(this->presentationQueue, &presentInfo);
+	this->frameTiming.presentMs = ElapsedMs(presentStart);
 
 	if (this->resizeTriggered || result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 		this->resizeTriggered = false;
@@ -176,7 +465,101 @@ void Engine::Render() {
 	this->currentFrame = (this->currentFrame + 1) % this->MAX_CONCURRENT_FRAMES;
 }
 
-void Engine::UpdateUniformBuffers(uint32_t currentImage) {
+void Engine::RenderOffscreen() {
+	std::chrono::time_point fenceStart = std::chrono::high_resolution_clock::now();
+	vkWaitForFences(this->logicalDevice, 1, &this->inFlightFences[this->currentFrame], VK_TRUE, UINT64_MAX);
+	this->frameTiming.fenceWaitMs = ElapsedMs(fenceStart);
+	CollectFrameLatencies();
+
+	// Each in-flight frame owns one offscreen target, so the fence above also guards the image.
+	uint32_t imageIndex = static_cast<uint32_t>(this->currentFrame);
+
+	DeliverReadback(this->currentFrame);
+	CollectFrameTimestamps(imageIndex);
+
+	UpdateUniformBuffer(imageIndex);
+
+	if (this->cullMode == CullMode::CPU) {
+		std::chrono::time_point cullStart = std::chrono::high_resolution_clock::now();
+		CullOnCPU(imageIndex);
+		this->frameTiming.cullMs = ElapsedMs(cullStart);
+	}
+
+	VkCommandBuffer commandBuffer = this->commandBuffers.empty() ? VK_NULL_HANDLE : this->commandBuffers[imageIndex];
+
+	if (this->RECORD_EVERY_FRAME) {
+		std::chrono::time_point recordStart = std::chrono::high_resolution_clock::now();
+		commandBuffer = RecordFrame(imageIndex);
+		this->frameTiming.recordMs = ElapsedMs(recordStart);
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.commandBufferCount = 1;
+
+	vkResetFences(this->logicalDevice, 1, &this->inFlightFences[this->currentFrame]);
+
+	VKCheck("Could not submit queue.", vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, this->inFlightFences[this->currentFrame]));
+	this->frameInputTimes[this->currentFrame] = fenceStart;
+	this->frameLatencyPending[this->currentFrame] = true;
+
+	if (!this->readbackBuffers.empty()) {
+		this->readbackPending[this->currentFrame] = true;
+		this->readbackFrameNumbers[this->currentFrame] = this->frameNumber;
+	}
+
+	this->frameNumber++;
+	this->currentFrame = (this->currentFrame + 1) % this->MAX_CONCURRENT_FRAMES;
+}
+
+void Engine::CollectFrameLatencies() {
+	std::chrono::time_point now = std::chrono::high_resolution_clock::now();
+	std::chrono::high_resolution_clock::time_point newest = {};
+
+	for (size_t i = 0; i < this->frameLatencyPending.size(); i++) {
+		if (!this->frameLatencyPending[i] || vkGetFenceStatus(this->logicalDevice, this->inFlightFences[i]) != VK_SUCCESS) {
+			continue;
+		}
+
+		this->frameLatencyPending[i] = false;
+
+		if (this->frameInputTimes[i] > newest) {
+			newest = this->frameInputTimes[i];
+			this->frameTiming.latencyMs = std::chrono::duration<double, std::chrono::milliseconds::period>(now - newest).count();
+		}
+	}
+}
+
+void Engine::DeliverReadback(size_t frame) {
+	if (this->readbackBuffers.empty() || !this->readbackPending[frame]) {
+		return;
+	}
+
+	this->readbackPending[frame] = false;
+
+	if (!this->readbackCallback) {
+		return;
+	}
+
+	ReadbackFrame readbackFrame = {};
+	readbackFrame.pixels = this->readbackBuffersMemory[frame].mapped;
+	readbackFrame.width = this->swapImageSize.width;
+	readbackFrame.height = this->swapImageSize.height;
+	readbackFrame.format = this->swapImageFormat;
+	readbackFrame.frameNumber = this->readbackFrameNumbers[frame];
+
+	this->readbackCallback(readbackFrame);
+}
+
+void Engine::FlushReadbacks() {
+	// Oldest in-flight frame first, so frames reach the callback in submission order.
+	for (size_t i = 0; i < this->MAX_CONCURRENT_FRAMES; i++) {
+		DeliverReadback((this->currentFrame + i) % this->MAX_CONCURRENT_FRAMES);
+	}
+}
+
+void Engine::UpdateUniformBuffer(uint32_t currentImage) {
 	static std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
 
 	std::chrono::time_point currentTime = std::chrono::high_resolution_clock::now();
@@ -189,11 +572,11 @@ void Engine::UpdateUniformBuffers(uint32_t currentImage) {
 	UBO.view = glm::lookAt(this->CAMERA_POSITION, this->CENTER, this->UP);
 	UBO.projection = glm::perspective(glm::radians(this->FOV), this->swapImageSize.width / (float)this->swapImageSize.height, this->NEAREST, this->FARTHEST);
 	UBO.projection[1][1] *= -1;
+	UBO.quantization = this->vertexQuantization;
+
+	this->frameUBO = UBO;
 
-	void* data;
-	vkMapMemory(this->logicalDevice, this->uniformBuffersMemory[currentImage], 0, sizeof(UBO), 0, &data);
-	memcpy(data, &UBO, sizeof(UBO));
-	vkUnmapMemory(this->logicalDevice, this->uniformBuffersMemory[currentImage]);
+	memcpy(static_cast<uint8_t*>(this->uniformBufferMemory.mapped) + currentImage * this->uniformBufferStride, &UBO, sizeof(UBO));
 }
 
 void Engine::RecreateSwapchain() {
@@ -204,59 +587,110 @@ void Engine::RecreateSwapchain() {
 		glfwWaitEvents();
 	}
 
-	vkDeviceWaitIdle(this->logicalDevice);
-	CloseSwapchain();
+	std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	// Only our own frames and pending presents can still use the old images, so there is no need to idle the whole device.
+	vkWaitForFences(this->logicalDevice, static_cast<uint32_t>(this->inFlightFences.size()), this->inFlightFences.data(), VK_TRUE, UINT64_MAX);
+	vkQueueWaitIdle(this->presentationQueue);
+
+	VkFormat oldFormat = this->swapImageFormat;
+	size_t oldImageCount = this->swapImages.size();
+	VkSwapchainKHR oldSwapchain = this->swapchain;
 
+	DestroySizeDependentResources();
+
+	// The old swapchain is handed to the new one so the driver can reuse its images, and retired afterwards.
 	GetSwapchainDetails(this->physicalDevice, this->swapchainDetails);
 	CreateSwapchain(this->swapchain, this->WIN_W, this->WIN_H);
+	vkDestroySwapchainKHR(this->logicalDevice, oldSwapchain, nullptr);
 	GetSwapImages(this->swapchain, this->swapImages);
 	CreateImageViews();
-	CreateRenderPass();
-	CreateGraphicsPipeline();
+
+	// The render pass and pipeline only depend on the surface format; viewport and scissor are dynamic.
+	if (this->swapImageFormat != oldFormat) {
+		vkDestroyPipeline(this->logicalDevice, this->pipeline, nullptr);
+		vkDestroyPipelineLayout(this->logicalDevice, this->pipelineLayout, nullptr);
+		vkDestroyRenderPass(this->logicalDevice, this->renderPass, nullptr);
+		CreateRenderPass();
+		CreateGraphicsPipeline();
+	}
+
 	CreateColorResources();
 	CreateDepthResources();
 	CreateFramebuffers();
-	//CreateTextureImage(this->TEXTURE_PATH);
-	//CreateTextureImage("textures/pokeball.png");
-	//CreateTextureImage("textures/pokeball.png");
-	//CreateTextureImage("textures/naruto.jpg");
-	//CreateTextureImageViews(this->mipLevels);
-	CreateUniformBuffers();
-	CreateDescriptorPool();
-	CreateDescriptorSets();
+
+	// Uniform buffer slices and timestamp queries are per swap image and only change with the image count.
+	if (this->swapImages.size() != oldImageCount) {
+		DestroyUniformBuffer();
+		vkDestroyQueryPool(this->logicalDevice, this->frameQueryPool, nullptr);
+		this->frameQueryPool = VK_NULL_HANDLE;
+
+		CreateUniformBuffer();
+		CreateDescriptorPool();
+		CreateDescriptorSet();
+		CreateFrameQueryPool();
+		RecreateCullingResources();
+	}
+
+	this->imagesInFlight.assign(this->swapImages.size(), VK_NULL_HANDLE);
+
 	CreateCommandBuffers();
+
+	this->resizeTimings.push_back(ElapsedMs(startTime));
 }
 
-void Engine::CloseSwapchain() {
+void Engine::DestroySizeDependentResources() {
 	vkDestroyImage(this->logicalDevice, this->depthImage, nullptr);
 	vkDestroyImageView(this->logicalDevice, this->depthImageView, nullptr);
-	vkFreeMemory(this->logicalDevice, this->depthImageMemory, nullptr);
+	this->allocator.Free(this->depthImageMemory);
 
 	vkDestroyImage(this->logicalDevice, this->colorImage, nullptr);
 	vkDestroyImageView(this->logicalDevice, this->colorImageView, nullptr);
-	vkFreeMemory(this->logicalDevice, this->colorImageMemory, nullptr);
+	this->allocator.Free(this->colorImageMemory);
 
 	//this->textureImages.clear();
 	//this->textureImageViews.clear();
 	//this->textureImagesMemory.clear();
 
 	DestroyFramebuffers();
-	vkFreeCommandBuffers(this->logicalDevice, this->commandPool, static_cast<uint32_t>(this->commandBuffers.size()), this->commandBuffers.data());
+	DestroyCommandBuffers();
+	DestroySwapImageViews();
+}
+
+void Engine::DestroyUniformBuffer() {
+	vkDestroyBuffer(this->logicalDevice, this->uniformBuffer, nullptr);
+	this->allocator.Free(this->uniformBufferMemory);
+
+	vkDestroyDescriptorPool(this->logicalDevice, this->descriptorPool, nullptr);
+}
+
+void Engine::CloseSwapchain() {
+	DestroySizeDependentResources();
 	vkDestroyPipeline(this->logicalDevice, this->pipeline, nullptr);
 	vkDestroyPipelineLayout(this->logicalDevice, this->pipelineLayout, nullptr);
 	vkDestroyRenderPass(this->logicalDevice, this->renderPass, nullptr);
-	DestroySwapImageViews();
-	vkDestroySwapchainKHR(this->logicalDevice, this->swapchain, nullptr);
 
-	for (int i = 0; i < this->swapImages.size(); i++) {
-		vkDestroyBuffer(this->logicalDevice, this->uniformBuffers[i], nullptr);
-		vkFreeMemory(this->logicalDevice, this->uniformBuffersMemory[i], nullptr);
+	if (this->HEADLESS) {
+		DestroyOffscreenImages();
+	}
+	else {
+		vkDestroySwapchainKHR(this->logicalDevice, this->swapchain, nullptr);
 	}
 
-	vkDestroyDescriptorPool(this->logicalDevice, this->descriptorPool, nullptr);
+	DestroyUniformBuffer();
+	vkDestroyQueryPool(this->logicalDevice, this->frameQueryPool, nullptr);
+	this->frameQueryPool = VK_NULL_HANDLE;
 }
 
 void Engine::Close() {
+	CancelAssetStreaming();
+	PrintTimestampStats();
+	this->allocator.PrintStats();
+
+	if (this->stagingRing.IsEnabled()) {
+		this->stagingRing.PrintStats();
+	}
+
 	CloseSwapchain();
 
 	vkDestroySampler(this->logicalDevice, this->sampler, nullptr);
@@ -264,7 +698,7 @@ void Engine::Close() {
 	for (int i = 0; i < this->textureImages.size(); i++) {
 		vkDestroyImage(this->logicalDevice, this->textureImages[i], nullptr);
 		vkDestroyImageView(this->logicalDevice, this->textureImageViews[i], nullptr);
-		vkFreeMemory(this->logicalDevice, this->textureImagesMemory[i], nullptr);
+		this->allocator.Free(this->textureImagesMemory[i]);
 	}
 
 	this->textureImages.clear();
@@ -272,18 +706,34 @@ void Engine::Close() {
 	this->textureImagesMemory.clear();
 
 	vkDestroyDescriptorSetLayout(this->logicalDevice, this->descriptorSetLayout, nullptr);
+	SavePipelineCache();
+	vkDestroyPipelineCache(this->logicalDevice, this->pipelineCache, nullptr);
+	DestroyReadbackBuffers();
 	DestroySyncObjects();
 	vkDestroyBuffer(this->logicalDevice, this->indicesBuffer, nullptr);
-	vkFreeMemory(this->logicalDevice, this->indicesMemory, nullptr);
+	this->allocator.Free(this->indicesMemory);
 	vkDestroyBuffer(this->logicalDevice, this->vertexBuffer, nullptr);
-	vkFreeMemory(this->logicalDevice, this->vertexMemory, nullptr);
+	this->allocator.Free(this->vertexMemory);
+	vkDestroyBuffer(this->logicalDevice, this->instanceBuffer, nullptr);
+	this->allocator.Free(this->instanceMemory);
+	DestroyCullingResources();
+	DestroyCullingPipeline();
+	DestroyFrameCommands();
 	vkDestroyCommandPool(this->logicalDevice, this->commandPool, nullptr);
-	vkDestroyCommandPool(this->logicalDevice, this->copyPool, nullptr);
+	DestroyStagingRing();
+	this->allocator.Destroy();
 	vkDestroyDevice(this->logicalDevice, nullptr);
-	vkDestroySurfaceKHR(this->instance, this->surface, nullptr);
+
+	if (!this->HEADLESS) {
+		vkDestroySurfaceKHR(this->instance, this->surface, nullptr);
+	}
+
 	vkDestroyInstance(this->instance, nullptr);
-	glfwDestroyWindow(this->window);
-	glfwTerminate();
+
+	if (!this->HEADLESS) {
+		glfwDestroyWindow(this->window);
+		glfwTerminate();
+	}
 }
 
 void Engine::DestroySyncObjects() {
@@ -306,6 +756,28 @@ void Engine::DestroySwapImageViews() {
 	}
 }
 
+void Engine::DestroyReadbackBuffers() {
+	for (size_t i = 0; i < this->readbackBuffers.size(); i++) {
+		vkDestroyBuffer(this->logicalDevice, this->readbackBuffers[i], nullptr);
+		this->allocator.Free(this->readbackBuffersMemory[i]);
+	}
+
+	this->readbackBuffers.clear();
+	this->readbackBuffersMemory.clear();
+	this->readbackPending.clear();
+	this->readbackFrameNumbers.clear();
+}
+
+void Engine::DestroyOffscreenImages() {
+	for (size_t i = 0; i < this->swapImages.size(); i++) {
+		vkDestroyImage(this->logicalDevice, this->swapImages[i], nullptr);
+		this->allocator.Free(this->offscreenImagesMemory[i]);
+	}
+
+	this->swapImages.clear();
+	this->offscreenImagesMemory.clear();
+}
+
 void Engine::DestroyTextureImageViews() {
 	for (VkImageView imageView : this->textureImageViews) {
 		vkDestroyImageView(this->logicalDevice, imageView, nullptr);
@@ -390,7 +862,7 @@ VkSurfaceFormatKHR Engine::GetSurfaceFormat(const std::vector<VkSurfaceFormatKHR
 
 VkPresentModeKHR Engine::GetSurfacePresentMode(const std::vector<VkPresentModeKHR>& presentModes) {
 	for (int i = 0; i < presentModes.size(); i++) {
-		if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+		if (presentModes[i] == this->PRESENT_MODE) {
 			return presentModes[i];
 		}
 	}
@@ -398,6 +870,28 @@ VkPresentModeKHR Engine::GetSurfacePresentMode(const std::vector<VkPresentModeKH
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+void Engine::CyclePresentMode() {
+	const VkPresentModeKHR modes[] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+	const std::vector<VkPresentModeKHR>& supported = this->swapchainDetails.presentModes;
+
+	size_t current = std::find(std::begin(modes), std::end(modes), this->presentMode) - std::begin(modes);
+
+	// The next mode the surface supports; FIFO always is.
+	for (size_t i = 1; i <= std::size(modes); i++) {
+		VkPresentModeKHR mode = modes[(current + i) % std::size(modes)];
+
+		if (std::find(supported.begin(), supported.end(), mode) != supported.end()) {
+			this->PRESENT_MODE = mode;
+			break;
+		}
+	}
+
+	std::cout << "Present mode " << GetPresentModeName(this->PRESENT_MODE) << std::endl;
+
+	// Picked up when the swapchain is recreated after the next present.
+	this->resizeTriggered = true;
+}
+
 VkExtent2D Engine::GetSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, size_t& WIN_W, size_t& WIN_H) {
 
 	if (capabilities.currentExtent.width != UINT32_MAX) {
@@ -406,8 +900,8 @@ VkExtent2D Engine::GetSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, s
 	else {
 		VkExtent2D extent = { static_cast<uint32_t>(WIN_W), static_cast<uint32_t>(WIN_H) };
 
-		extent.width = max(capabilities.minImageExtent.width, min(capabilities.maxImageExtent.width, extent.width));
-		extent.height = max(capabilities.minImageExtent.height, min(capabilities.maxImageExtent.height, extent.height));
+		extent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, extent.width));
+		extent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, extent.height));
 
 		return extent;
 	}
@@ -442,7 +936,7 @@ VkShaderModule Engine::CreateShaderModule(const std::vector<char>& byteCode) {
 	return shaderModule;
 }
 
-VkBuffer Engine::CreateBuffer(VkDeviceMemory& bufferMemory, VkDeviceSize& size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlagBits) {
+VkBuffer Engine::CreateBuffer(Allocation& bufferMemory, VkDeviceSize& size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlagBits, VkMemoryPropertyFlags preferredPropertyFlagBits) {
 	VkBuffer buffer;
 
 	VkBufferCreateInfo bufferInfo = {};
@@ -456,29 +950,73 @@ VkBuffer Engine::CreateBuffer(VkDeviceMemory& bufferMemory, VkDeviceSize& size,
 	VkMemoryRequirements memoryRequirements;
 	vkGetBufferMemoryRequirements(this->logicalDevice, buffer, &memoryRequirements);
 
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memoryRequirements.size;
-	allocateInfo.memoryTypeIndex = GetMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-	VKCheck("Could not allocate buffer memory.", vkAllocateMemory(this->logicalDevice, &allocateInfo, nullptr, &bufferMemory));
+	uint32_t memoryType = GetMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlagBits, preferredPropertyFlagBits);
+	bufferMemory = this->allocator.Allocate(memoryRequirements, memoryType, true);
 
-	vkBindBufferMemory(this->logicalDevice, buffer, bufferMemory, 0);
+	VKCheck("Could not bind buffer memory.", vkBindBufferMemory(this->logicalDevice, buffer, bufferMemory.memory, bufferMemory.offset));
 
 	return buffer;
 }
 
-uint32_t Engine::GetMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+uint32_t Engine::GetMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties) {
 	VkPhysicalDeviceMemoryProperties memoryProperties;
 	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
 
+	// Every candidate must have all the required flags. Among those, prefer the most preferred flags,
+	// then avoid host-visible types nobody asked for so small BAR heaps aren't used up by device-only resources.
+	int bestScore = -1;
+	uint32_t bestType = UINT32_MAX;
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+
+		if (!(typeFilter & (1 << i)) || (flags & properties) != properties) {
+			continue;
+		}
+
+		int score = 0;
+
+		for (VkMemoryPropertyFlags bit = 1; bit <= preferredProperties; bit <<= 1) {
+			if ((preferredProperties & bit) && (flags & bit)) {
+				score += 4;
+			}
+		}
+
+		if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !((properties | preferredProperties) & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+			score -= 1;
+		}
+
+		score += 1;
+
+		if (score > bestScore) {
+			bestScore = score;
+			bestType = i;
+		}
+	}
+
+	if (bestType == UINT32_MAX) {
+		throw std::runtime_error("Could not find an appropriate memory type.");
+	}
+
+	return bestType;
+}
+
+bool Engine::HasDeviceLocalHostVisibleMemory() {
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
 	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
-		if (typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
+		const VkMemoryType& type = memoryProperties.memoryTypes[i];
+
+		// Without resizable BAR the host-visible window into VRAM is only 256 MiB, too small to put geometry in.
+		if ((type.propertyFlags & flags) == flags && memoryProperties.memoryHeaps[type.heapIndex].size > 256ull * 1024 * 1024) {
+			return true;
 		}
 	}
 
-	throw std::runtime_error("Could not find an appropriate memory type.");
+	return false;
 }
 
 VkSampleCountFlagBits Engine::GetMSAASupport() {
@@ -504,30 +1042,64 @@ void Engine::GetQueueFamilies() {
 	std::vector<VkQueueFamilyProperties> qfProperties(qfCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &qfCount, qfProperties.data());
 
-	int idx = 0;
+	std::optional<uint32_t> asyncTransferQF = {};
+
+	for (uint32_t idx = 0; idx < qfCount; idx++) {
+		const VkQueueFamilyProperties& qfProperty = qfProperties[idx];
 
-	for (VkQueueFamilyProperties qfProperty : qfProperties) {
-		if (qfProperty.queueFlags && VK_QUEUE_GRAPHICS_BIT) {
+		if (!this->queueFamilies.graphicsQF.has_value() && (qfProperty.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
 			this->queueFamilies.graphicsQF = idx;
 			this->queueFamilies.count++;
 		}
 
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(this->physicalDevice, idx, this->surface, &presentSupport);
+		if (!this->queueFamilies.presentationQF.has_value()) {
+			VkBool32 presentSupport = false;
+
+			if (this->HEADLESS) {
+				// Nothing is presented; alias the presentation family to the graphics family.
+				presentSupport = this->queueFamilies.graphicsQF.has_value() && this->queueFamilies.graphicsQF.value() == idx;
+			}
+			else {
+				vkGetPhysicalDeviceSurfaceSupportKHR(this->physicalDevice, idx, this->surface, &presentSupport);
+			}
 
-		if (presentSupport) {
-			this->queueFamilies.presentationQF = idx;
+			if (presentSupport) {
+				this->queueFamilies.presentationQF = idx;
 
-			if (idx != this->queueFamilies.graphicsQF.value()) {
-				this->queueFamilies.count++;
+				if (!this->queueFamilies.graphicsQF.has_value() || idx != this->queueFamilies.graphicsQF.value()) {
+					this->queueFamilies.count++;
+				}
 			}
 		}
 
-		if (this->queueFamilies.isComplete()) {
-			break;
-		}
+		// Transfer-only families are backed by copy engines that run next to rendering; async compute families come second.
+		// Mip tails are smaller than a coarse image transfer granularity, so only families that copy single texels qualify.
+		VkExtent3D granularity = qfProperty.minImageTransferGranularity;
+		bool texelCopies = granularity.width == 1 && granularity.height == 1 && granularity.depth == 1;
 
-		idx++;
+		if (texelCopies && (qfProperty.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(qfProperty.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+			if (!this->queueFamilies.transferQF.has_value() && !(qfProperty.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+				this->queueFamilies.transferQF = idx;
+			}
+			else if (!asyncTransferQF.has_value()) {
+				asyncTransferQF = idx;
+			}
+		}
+	}
+
+	if (!this->queueFamilies.transferQF.has_value()) {
+		this->queueFamilies.transferQF = asyncTransferQF;
+	}
+
+	// Presenting does not take the transfer queue mutex, so the two must not end up on the same queue.
+	if (this->queueFamilies.transferQF == this->queueFamilies.presentationQF) {
+		this->queueFamilies.transferQF.reset();
+	}
+
+	// Without a separate family, a second queue of the graphics family still lets uploads run beside rendering.
+	if (!this->queueFamilies.transferQF.has_value() && this->queueFamilies.graphicsQF.has_value() && qfProperties[this->queueFamilies.graphicsQF.value()].queueCount > 1) {
+		this->queueFamilies.transferQF = this->queueFamilies.graphicsQF;
+		this->queueFamilies.transferQueueIndex = 1;
 	}
 }
 
@@ -579,7 +1151,11 @@ void Engine::CreateInstance() {
 	createInfo.pApplicationInfo = &appInfo;
 
 	uint32_t extensionCount = 0;
-	const char** extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+	const char** extensions = nullptr;
+
+	if (!this->HEADLESS) {
+		extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+	}
 
 	createInfo.ppEnabledExtensionNames = extensions;
 	createInfo.enabledExtensionCount = extensionCount;
@@ -596,12 +1172,16 @@ void Engine::CreateInstance() {
 }
 
 void Engine::CreateWindowSurface() {
+#ifdef _WIN32
 	VkWin32SurfaceCreateInfoKHR winCreateSurfaceInfo = {};
 	winCreateSurfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 	winCreateSurfaceInfo.hinstance = GetModuleHandle(0);
 	winCreateSurfaceInfo.hwnd = glfwGetWin32Window(this->window);
 
 	VKCheck("Could not create Win32 surface.", vkCreateWin32SurfaceKHR(this->instance, &winCreateSurfaceInfo, nullptr, &this->surface));
+#else
+	VKCheck("Could not create window surface.", glfwCreateWindowSurface(this->instance, this->window, nullptr, &this->surface));
+#endif
 }
 
 void Engine::CreatePhysicalDevice() {
@@ -615,6 +1195,8 @@ void Engine::CreatePhysicalDevice() {
 	std::vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
 	vkEnumeratePhysicalDevices(this->instance, &physicalDeviceCount, physicalDevices.data());
 
+	const std::vector<const char*>& requiredExtensions = this->HEADLESS ? this->headlessDeviceExtensions : this->deviceExtensions;
+
 	for (VkPhysicalDevice device : physicalDevices) {
 		VkPhysicalDeviceProperties physicalDeviceProperties;
 		VkPhysicalDeviceFeatures physicalDeviceFeatures;
@@ -622,16 +1204,19 @@ void Engine::CreatePhysicalDevice() {
 		vkGetPhysicalDeviceProperties(device, &physicalDeviceProperties);
 		vkGetPhysicalDeviceFeatures(device, &physicalDeviceFeatures);
 
-		if (!ValidateDeviceExtensions(device, this->deviceExtensions)) {
+		if (!ValidateDeviceExtensions(device, requiredExtensions)) {
 			continue;
 		}
 
-		bool supportsSwapchain = false;
-		SwapchainDetails details = {};
-		GetSwapchainDetails(device, details);
+		bool supportsSwapchain = this->HEADLESS;
+
+		if (!this->HEADLESS) {
+			SwapchainDetails details = {};
+			GetSwapchainDetails(device, details);
 
-		if (!details.formats.empty() && !details.presentModes.empty()) {
-			supportsSwapchain = true;
+			if (!details.formats.empty() && !details.presentModes.empty()) {
+				supportsSwapchain = true;
+			}
 		}
 
 		if (supportsSwapchain && physicalDeviceFeatures.samplerAnisotropy && physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
@@ -647,6 +1232,7 @@ void Engine::CreatePhysicalDevice() {
 		vkGetPhysicalDeviceProperties(physicalDevices[0], &physicalDeviceProperties);
 		std::cout << "Using Fallback Device: " << physicalDeviceProperties.deviceName << std::endl;
 		this->physicalDevice = physicalDevices[0];
+		this->msaaSamples = GetMSAASupport();
 		return;
 	}
 	else {
@@ -663,38 +1249,90 @@ void Engine::CreateLogicalDevice() {
 
 	std::set<uint32_t> qfs = { this->queueFamilies.graphicsQF.value(), this->queueFamilies.presentationQF.value() };
 
-	float priority = 1.0f;
+	if (this->queueFamilies.transferQF.has_value()) {
+		qfs.insert(this->queueFamilies.transferQF.value());
+	}
+
+	// Background uploads get the lower priority when they share a family with rendering.
+	float priorities[] = { 1.0f, 0.5f };
 	for (uint32_t qf : qfs) {
 		VkDeviceQueueCreateInfo queueCreateInfo = {};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueCreateInfo.pQueuePriorities = &priority;
-		queueCreateInfo.queueCount = 1;
+		queueCreateInfo.pQueuePriorities = priorities;
+		queueCreateInfo.queueCount = qf == this->queueFamilies.transferQF && this->queueFamilies.transferQueueIndex == 1 ? 2 : 1;
 		queueCreateInfo.queueFamilyIndex = qf;
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(this->physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+	this->textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+	this->multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	this->drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &familyCount, families.data());
+
+	this->graphicsCompute = (families[this->queueFamilies.graphicsQF.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+
+	// Timeline semaphores are core in Vulkan 1.2 but still optional for the device; streaming needs them.
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+	VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+	supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	if (properties.apiVersion >= VK_API_VERSION_1_2) {
+		VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+		supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures2.pNext = &supportedFeatures12;
+
+		vkGetPhysicalDeviceFeatures2(this->physicalDevice, &supportedFeatures2);
+	}
+
+	VkPhysicalDeviceVulkan12Features deviceFeatures12 = {};
+	deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	deviceFeatures12.timelineSemaphore = supportedFeatures12.timelineSemaphore;
+	deviceFeatures12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
+
+	this->timelineSemaphores = supportedFeatures12.timelineSemaphore == VK_TRUE;
+	this->drawIndirectCount = supportedFeatures12.drawIndirectCount == VK_TRUE;
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 
-	deviceCreateInfo.ppEnabledExtensionNames = this->deviceExtensions.data();
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(this->deviceExtensions.size());
+	const std::vector<const char*>& extensions = this->HEADLESS ? this->headlessDeviceExtensions : this->deviceExtensions;
+
+	deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
 
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
+	deviceCreateInfo.pNext = properties.apiVersion >= VK_API_VERSION_1_2 ? &deviceFeatures12 : nullptr;
 
 	VKCheck("Could not create device.", vkCreateDevice(this->physicalDevice, &deviceCreateInfo, nullptr, &this->logicalDevice));
 
 	vkGetDeviceQueue(this->logicalDevice, this->queueFamilies.graphicsQF.value(), 0, &this->graphicsQueue);
 	vkGetDeviceQueue(this->logicalDevice, this->queueFamilies.presentationQF.value(), 0, &this->presentationQueue);
+
+	if (this->queueFamilies.transferQF.has_value()) {
+		vkGetDeviceQueue(this->logicalDevice, this->queueFamilies.transferQF.value(), this->queueFamilies.transferQueueIndex, &this->transferQueue);
+	}
 }
 
 void Engine::CreateSwapchain(VkSwapchainKHR& swapchain, size_t& WIN_W, size_t& WIN_H) {
 	VkSurfaceFormatKHR surfaceFormat = GetSurfaceFormat(this->swapchainDetails.formats);
-	VkPresentModeKHR presentMode = GetSurfacePresentMode(this->swapchainDetails.presentModes);
+	this->presentMode = GetSurfacePresentMode(this->swapchainDetails.presentModes);
 	VkExtent2D swapExtent = GetSwapExtent(this->swapchainDetails.capabilities, WIN_W, WIN_H);
 
 	uint32_t imageCount = this->swapchainDetails.capabilities.minImageCount + 1;
@@ -712,11 +1350,11 @@ void Engine::CreateSwapchain(VkSwapchainKHR& swapchain, size_t& WIN_W, size_t& W
 	swapChainCreateInfo.imageExtent = swapExtent;
 	swapChainCreateInfo.imageArrayLayers = 1;
 	swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-	swapChainCreateInfo.presentMode = presentMode;
+	swapChainCreateInfo.presentMode = this->presentMode;
 	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainCreateInfo.preTransform = this->swapchainDetails.capabilities.currentTransform;
 	swapChainCreateInfo.clipped = VK_TRUE;
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	swapChainCreateInfo.oldSwapchain = swapchain;
 
 	uint32_t indices[2] = { this->queueFamilies.graphicsQF.value(), this->queueFamilies.presentationQF.value() };
 
@@ -737,6 +1375,22 @@ void Engine::CreateSwapchain(VkSwapchainKHR& swapchain, size_t& WIN_W, size_t& W
 	this->swapImageSize = swapChainCreateInfo.imageExtent;
 }
 
+void Engine::CreateOffscreenImages() {
+	const std::vector<VkFormat> formats = { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB };
+	VkFormatFeatureFlags features = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT;
+
+	this->swapImageFormat = GetSupportedFormat(formats, VK_IMAGE_TILING_OPTIMAL, features);
+	this->swapImageSize = { static_cast<uint32_t>(this->WIN_W), static_cast<uint32_t>(this->WIN_H) };
+
+	this->swapImages.resize(this->MAX_CONCURRENT_FRAMES);
+	this->offscreenImagesMemory.resize(this->MAX_CONCURRENT_FRAMES);
+
+	for (size_t i = 0; i < this->swapImages.size(); i++) {
+		CreateImage(this->swapImages[i], this->offscreenImagesMemory[i], this->swapImageSize.width, this->swapImageSize.height, 1, VK_SAMPLE_COUNT_1_BIT, this->swapImageFormat, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+}
+
 void Engine::CreateColorImageView() {
 
 	VkImageViewCreateInfo imageViewCreateInfo = { };
@@ -817,7 +1471,7 @@ void Engine::CreateRenderPass() {
 	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachmentResolve.finalLayout = this->HEADLESS ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 
 
@@ -848,6 +1502,21 @@ void Engine::CreateRenderPass() {
 	subpassDependency.srcAccessMask = 0;
 	subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+	// Makes the resolved image visible to the readback copy recorded after the render pass.
+	VkSubpassDependency readbackDependency = {};
+	readbackDependency.srcSubpass = 0;
+	readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	std::vector<VkSubpassDependency> dependencies = { subpassDependency };
+
+	if (this->HEADLESS) {
+		dependencies.push_back(readbackDependency);
+	}
+
 	std::vector<VkAttachmentDescription> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
 
 	VkRenderPassCreateInfo renderPassInfo = {};
@@ -856,8 +1525,8 @@ void Engine::CreateRenderPass() {
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpassDescription;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &subpassDependency;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
 	VKCheck("Could not create render pass.", vkCreateRenderPass(this->logicalDevice, &renderPassInfo, nullptr, &this->renderPass));
 }
@@ -866,7 +1535,7 @@ void Engine::CreateDescriptorSetLayout() {
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 	uboLayoutBinding.binding = 0;
 	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -887,8 +1556,106 @@ void Engine::CreateDescriptorSetLayout() {
 	VKCheck("Could not create descriptor set layout.", vkCreateDescriptorSetLayout(this->logicalDevice, &layoutInfo, nullptr, &this->descriptorSetLayout));
 }
 
+void Engine::CreatePipelineCache() {
+	std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	std::vector<char> cacheData;
+	std::ifstream file(this->PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+
+	if (file.is_open()) {
+		cacheData.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(cacheData.data(), cacheData.size());
+		file.close();
+	}
+
+	if (!cacheData.empty()) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+		VkPipelineCacheHeaderVersionOne header = {};
+		bool valid = cacheData.size() >= sizeof(header);
+
+		if (valid) {
+			memcpy(&header, cacheData.data(), sizeof(header));
+
+			// A cache from another driver, device or driver version is rejected by some implementations and silently ignored by others.
+			valid = header.headerSize >= sizeof(header) && header.headerSize <= cacheData.size()
+				&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+				&& header.vendorID == properties.vendorID
+				&& header.deviceID == properties.deviceID
+				&& memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+		}
+
+		if (!valid) {
+			std::cout << "Discarding stale pipeline cache " << this->PIPELINE_CACHE_PATH << std::endl;
+			cacheData.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = cacheData.size();
+	cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	VKCheck("Could not create pipeline cache.", vkCreatePipelineCache(this->logicalDevice, &cacheInfo, nullptr, &this->pipelineCache));
+
+	std::cout << "Loaded pipeline cache (" << cacheData.size() << " bytes) in " << ElapsedMs(startTime) << " ms" << std::endl;
+}
+
+void Engine::SavePipelineCache() {
+	if (this->pipelineCache == VK_NULL_HANDLE) {
+		return;
+	}
+
+	size_t dataSize = 0;
+	vkGetPipelineCacheData(this->logicalDevice, this->pipelineCache, &dataSize, nullptr);
+
+	std::vector<char> cacheData(dataSize);
+	vkGetPipelineCacheData(this->logicalDevice, this->pipelineCache, &dataSize, cacheData.data());
+
+	// Write to a temporary file and rename it over the old cache so a crash never leaves a truncated cache behind.
+	std::string tempPath = std::string(this->PIPELINE_CACHE_PATH) + ".tmp";
+
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) {
+		std::cout << "Could not write pipeline cache " << tempPath << std::endl;
+		return;
+	}
+
+	file.write(cacheData.data(), dataSize);
+	file.close();
+
+	if (file.fail()) {
+		std::cout << "Could not write pipeline cache " << tempPath << std::endl;
+		std::remove(tempPath.c_str());
+		return;
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(tempPath.c_str(), this->PIPELINE_CACHE_PATH, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = std::rename(tempPath.c_str(), this->PIPELINE_CACHE_PATH) == 0;
+#endif
+
+	if (!renamed) {
+		std::cout << "Could not replace pipeline cache " << this->PIPELINE_CACHE_PATH << std::endl;
+		std::remove(tempPath.c_str());
+	}
+}
+
+void Engine::ResolveVertexLayout() {
+	// A missing shader variant costs vertex bandwidth rather than failing Load.
+	this->fullPrecisionVertices = !std::is_same_v<GpuVertex, FullVertex> && !std::ifstream(GpuVertex::GetShaderPath()).is_open();
+
+	if (this->fullPrecisionVertices) {
+		std::cout << "Vertices: " << GpuVertex::GetShaderPath() << " is missing, using full precision vertices" << std::endl;
+	}
+}
+
 void Engine::CreateGraphicsPipeline() {
-	std::vector<char> shaderVert = ReadFile("shaders/vert.spv");
+	std::vector<char> shaderVert = ReadFile(this->fullPrecisionVertices ? FullVertex::GetShaderPath() : GpuVertex::GetShaderPath());
 	std::vector<char> shaderFrag = ReadFile("shaders/frag.spv");
 
 	VkShaderModule shaderVertModule = CreateShaderModule(shaderVert);
@@ -920,14 +1687,14 @@ void Engine::CreateGraphicsPipeline() {
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { shaderStageCreateInfo, fragStageCreateInfo };
 
-	std::vector<VkVertexInputAttributeDescription> attributeDescriptions = Vertex::GetAttributeDescriptions();
-	VkVertexInputBindingDescription bindingDescriptions = Vertex::GetBindingDescription();
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions = this->fullPrecisionVertices ? FullVertex::GetAttributeDescriptions() : GpuVertex::GetAttributeDescriptions();
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions = this->fullPrecisionVertices ? FullVertex::GetBindingDescriptions() : GpuVertex::GetBindingDescriptions();
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescriptions;
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
 	VkPipelineInputAssemblyStateCreateInfo assemblyInputInfo = {};
@@ -935,24 +1702,19 @@ void Engine::CreateGraphicsPipeline() {
 	assemblyInputInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	assemblyInputInfo.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewPort = {};
-	viewPort.x = 0.0f;
-	viewPort.y = 0.0f;
-	viewPort.width = (float)this->swapImageSize.width;
-	viewPort.height = (float)this->swapImageSize.height;
-	viewPort.minDepth = 0.0f;
-	viewPort.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.extent = this->swapImageSize;
-
+	// Viewport and scissor are set when recording, so the pipeline survives swapchain resizes.
 	VkPipelineViewportStateCreateInfo viewPortStateInfo = {};
 	viewPortStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewPortStateInfo.pScissors = &scissor;
-	viewPortStateInfo.pViewports = &viewPort;
 	viewPortStateInfo.scissorCount = 1;
 	viewPortStateInfo.viewportCount = 1;
 
+	std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
 	VkPipelineRasterizationStateCreateInfo rasterizationStateInfo = {};
 	rasterizationStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 	rasterizationStateInfo.rasterizerDiscardEnable = VK_FALSE;
@@ -1018,7 +1780,7 @@ void Engine::CreateGraphicsPipeline() {
 	graphicsPipelineInfo.pInputAssemblyState = &assemblyInputInfo;
 	graphicsPipelineInfo.pVertexInputState = &vertexInputInfo;
 	graphicsPipelineInfo.pViewportState = &viewPortStateInfo;
-	graphicsPipelineInfo.pDynamicState = nullptr;
+	graphicsPipelineInfo.pDynamicState = &dynamicStateInfo;
 	graphicsPipelineInfo.pDepthStencilState = &depthStencilInfo;
 	graphicsPipelineInfo.layout = this->pipelineLayout;
 	graphicsPipelineInfo.renderPass = this->renderPass;
@@ -1026,7 +1788,9 @@ void Engine::CreateGraphicsPipeline() {
 	graphicsPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	graphicsPipelineInfo.basePipelineIndex = -1;
 
-	VKCheck("Could not create graphics pipeline.", vkCreateGraphicsPipelines(this->logicalDevice, VK_NULL_HANDLE, 1, &graphicsPipelineInfo, nullptr, &this->pipeline));
+	std::chrono::time_point pipelineStart = std::chrono::high_resolution_clock::now();
+	VKCheck("Could not create graphics pipeline.", vkCreateGraphicsPipelines(this->logicalDevice, this->pipelineCache, 1, &graphicsPipelineInfo, nullptr, &this->pipeline));
+	std::cout << "Created graphics pipeline in " << ElapsedMs(pipelineStart) << " ms" << std::endl;
 
 	vkDestroyShaderModule(this->logicalDevice, shaderVertModule, nullptr);
 	vkDestroyShaderModule(this->logicalDevice, shaderFragModule, nullptr);
@@ -1053,10 +1817,10 @@ void Engine::CreateFramebuffers() {
 	}
 }
 
-void Engine::CreateCommandPool(VkCommandPool& commandPool, uint32_t& familyIndex) {
+void Engine::CreateCommandPool(VkCommandPool& commandPool, uint32_t& familyIndex, VkCommandPoolCreateFlags flags) {
 	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
 	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	commandPoolCreateInfo.flags = 0;
+	commandPoolCreateInfo.flags = flags;
 	commandPoolCreateInfo.queueFamilyIndex = familyIndex;
 
 	VKCheck("Could not create command pool.", vkCreateCommandPool(this->logicalDevice, &commandPoolCreateInfo, nullptr, &commandPool));
@@ -1110,7 +1874,7 @@ void Engine::CreateColorResources() {
 	CreateColorImageView();
 }
 
-void Engine::CreateImage(VkImage& image, VkDeviceMemory& imageMemory, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties) {
+void Engine::CreateImage(VkImage& image, Allocation& imageMemory, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties) {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.arrayLayers = 1;
@@ -1132,57 +1896,59 @@ void Engine::CreateImage(VkImage& image, VkDeviceMemory& imageMemory, uint32_t w
 	VkMemoryRequirements memoryRequirements = {};
 	vkGetImageMemoryRequirements(this->logicalDevice, image, &memoryRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memoryRequirements.size;
-	allocInfo.memoryTypeIndex = GetMemoryType(memoryRequirements.memoryTypeBits, properties);
-
-	VKCheck("Could not allocate memory to image.", vkAllocateMemory(this->logicalDevice, &allocInfo, nullptr, &imageMemory));
+	uint32_t memoryType = GetMemoryType(memoryRequirements.memoryTypeBits, properties);
+	imageMemory = this->allocator.Allocate(memoryRequirements, memoryType, tiling == VK_IMAGE_TILING_LINEAR);
 
-	vkBindImageMemory(this->logicalDevice, image, imageMemory, 0);
+	VKCheck("Could not bind image memory.", vkBindImageMemory(this->logicalDevice, image, imageMemory.memory, imageMemory.offset));
 }
 
 void Engine::CreateModel(const char* name) {
-	tinyobj::attrib_t attrib;
+	std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	bool useCache = this->ASSET_CACHE_DIRECTORY != nullptr && this->ASSET_CACHE_DIRECTORY[0] != '\0';
+	std::string cachePath = useCache ? GetMeshCachePath(this->ASSET_CACHE_DIRECTORY, name) : "";
+
+	if (useCache && this->meshCache.Open(cachePath, name, this->OPTIMIZE_MESHES, this->LOD_LEVELS)) {
+		this->indexCount = this->meshCache.GetIndexCount();
+		this->modelShapes = this->meshCache.GetShapes();
 
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
+		glm::vec3 boundsMin, boundsMax;
+		this->meshCache.GetBounds(boundsMin, boundsMax);
+		this->meshBoundingSpheres = { GetBoundingSphere(boundsMin, boundsMax) };
+		this->meshLodErrors = { this->meshCache.GetLodErrors() };
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, name)) {
-		throw std::runtime_error("Could not load model " + *name + *": " + warn + err);
+		std::cout << "Mapped model " << name << " from " << cachePath << " (" << this->meshCache.GetVertexCount() << " vertices, " << (this->indexCount / 3) << " triangles) in " << ElapsedMs(startTime) << " ms" << std::endl;
+		return;
 	}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+	ObjMesh mesh = LoadObjParallel(name);
 
-	for (tinyobj::shape_t shape : shapes) {
-		for (tinyobj::index_t index : shape.mesh.indices) {
-			Vertex vertex = {};
+	if (this->LOD_LEVELS > 1) {
+		BuildLoadedMeshLods(mesh, name, this->LOD_LEVELS);
+	}
 
-			vertex.position = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2],
-			};
+	if (this->OPTIMIZE_MESHES) {
+		OptimizeLoadedMesh(mesh, name);
+	}
 
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1],
-			};
+	if (useCache && !WriteMeshCache(cachePath, name, mesh, this->OPTIMIZE_MESHES, this->LOD_LEVELS)) {
+		std::cout << "Could not write mesh cache " << cachePath << std::endl;
+	}
 
-			vertex.color = { 1.0f, 1.0f, 1.0f };
+	this->vertices = std::move(mesh.vertices);
+	this->indices = std::move(mesh.indices);
+	this->indexCount = static_cast<uint32_t>(this->indices.size());
+	this->modelShapes = std::move(mesh.shapes);
+	this->meshLodErrors = { std::move(mesh.lodErrors) };
 
-			if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(this->vertices.size());
-				this->vertices.push_back(vertex);
-			}
+	glm::vec3 boundsMin, boundsMax;
+	GetVertexBounds(this->vertices.data(), this->vertices.size(), boundsMin, boundsMax);
+	this->meshBoundingSpheres = { GetBoundingSphere(boundsMin, boundsMax) };
 
-			this->indices.push_back(uniqueVertices[vertex]);
-		}
-	}
+	std::cout << "Loaded model " << name << " (" << this->vertices.size() << " vertices, " << (this->indexCount / 3) << " triangles) in " << ElapsedMs(startTime) << " ms" << std::endl;
 }
 
-void Engine::GenerateMipmaps(VkImage& image, int32_t im_w, int32_t im_h, uint32_t mipLevels, VkFormat imgFormat) {
+void Engine::GenerateMipmaps(VkCommandBuffer commandBuffer, VkImage& image, int32_t im_w, int32_t im_h, uint32_t mipLevels, VkFormat imgFormat) {
 
 	VkFormatProperties properties;
 
@@ -1192,9 +1958,6 @@ void Engine::GenerateMipmaps(VkImage& image, int32_t im_w, int32_t im_h, uint32_
 		throw std::runtime_error("Texture image format not supported for linear blitting.");
 	}
 
-	VkCommandBuffer commandBuffer;
-	BeginSingleTimeCommands(commandBuffer, this->commandPool);
-
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.image = image;
@@ -1257,50 +2020,284 @@ void Engine::GenerateMipmaps(VkImage& image, int32_t im_w, int32_t im_h, uint32_
 	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
 	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	EndSingleTimeCommands(commandBuffer, this->commandPool);
 }
 
-void Engine::CreateTextureImage(const char* name) {
-	VkImage image;
-	VkDeviceMemory imageMemory;
+void Engine::CreateTextureImage(const char* name, UploadBatch& batch) {
+	std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	// Cached textures come with their whole mip chain, so there is no decode and no blit chain at startup.
+	if (this->ASSET_CACHE_DIRECTORY != nullptr && this->ASSET_CACHE_DIRECTORY[0] != '\0') {
+		VkFormat format = GetTextureCacheFormat();
+		std::string cachePath = GetTextureCachePath(this->ASSET_CACHE_DIRECTORY, name, format);
+
+		TextureCache cache;
+
+		if (!cache.Open(cachePath, name)) {
+			if (BuildTextureCache(cachePath, name, format)) {
+				cache.Open(cachePath, name);
+			}
+			else {
+				std::cout << "Could not write texture cache " << cachePath << std::endl;
+			}
+		}
+
+		if (cache.IsOpen()) {
+			CreateTextureImageFromCache(cache, batch);
+
+			std::cout << "Loaded texture " << name << " from " << cachePath << " (" << cache.GetWidth() << "x" << cache.GetHeight() << ", " << cache.GetMipLevels() << " levels) in " << ElapsedMs(startTime) << " ms" << std::endl;
+			return;
+		}
+	}
 
 	int im_w, im_h, channels;
 
 	stbi_uc* pixels = stbi_load(name, &im_w, &im_h, &channels, STBI_rgb_alpha);
 
-	this->mipLevels = static_cast<uint32_t>(std::floor(std::log2(max(im_w, im_h)))) + 1;
-
 	if (!pixels) {
-		throw std::runtime_error("Could not load image " + *name);
+		throw std::runtime_error("Could not load image " + std::string(name));
 	}
 
-	VkDeviceSize imageSize = im_w * im_h * 4;
+	uint32_t width = static_cast<uint32_t>(im_w);
+	uint32_t height = static_cast<uint32_t>(im_h);
 
-	VkDeviceMemory stagingMemory = 0;
-	VkBuffer stagingBuffer = CreateBuffer(stagingMemory, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	
-	void* data;
-	vkMapMemory(this->logicalDevice, stagingMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(this->logicalDevice, stagingMemory);
+	VkImage image;
+	Allocation imageMemory;
 
-	stbi_image_free(pixels);
+	this->mipLevels = GetMipLevelCount(width, height);
+	this->textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
 
-	CreateImage(image, imageMemory, im_w, im_h, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (PreferCPUMipmaps(this->textureFormat)) {
+		MipChain chain = GenerateMipChain(pixels, width, height, this->MIPMAP_FILTER);
+		stbi_image_free(pixels);
 
-	TransitionImageLayout(image, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyBufferToImage(stagingBuffer, image, im_w, im_h);
-	GenerateMipmaps(image, im_w, im_h, mipLevels, VK_FORMAT_R8G8B8A8_SRGB);
-	//TransitionImageLayout(image, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	
-	vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(this->logicalDevice, stagingMemory, nullptr);
+		UploadTextureImage(batch, image, imageMemory, chain.data.data(), chain.data.size(), this->textureFormat, width, height, GetMipChainRegions(chain));
+
+		std::cout << "Generated " << this->mipLevels << " mip levels on the CPU (" << GetMipFilterName(this->MIPMAP_FILTER) << ", " << GetMipInstructionSetName(GetBestMipInstructionSet()) << ") in " << ElapsedMs(startTime) << " ms" << std::endl;
+	}
+	else {
+		UploadTextureImageWithBlits(batch, image, imageMemory, pixels, width, height);
+		stbi_image_free(pixels);
+	}
+
+	this->textureImages.push_back(image);
+	this->textureImagesMemory.push_back(imageMemory);
+}
+
+void Engine::CreateTextureImageFromCache(const TextureCache& cache, UploadBatch& batch) {
+	VkImage image;
+	Allocation imageMemory;
+
+	this->mipLevels = cache.GetMipLevels();
+	this->textureFormat = cache.GetFormat();
+
+	UploadTextureImage(batch, image, imageMemory, cache.GetData(), cache.GetDataSize(), this->textureFormat, cache.GetWidth(), cache.GetHeight(), GetTextureCacheRegions(cache));
 
 	this->textureImages.push_back(image);
 	this->textureImagesMemory.push_back(imageMemory);
 }
 
+VkFormat Engine::GetTextureCacheFormat() {
+	bool compress = this->TEXTURE_COMPRESSION && this->textureCompressionBC && SupportsSampledFormat(VK_FORMAT_BC1_RGB_SRGB_BLOCK);
+
+	return compress ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+std::vector<VkBufferImageCopy> Engine::GetTextureCacheRegions(const TextureCache& cache) {
+	const TextureCacheLevel* levels = cache.GetLevels();
+	std::vector<VkBufferImageCopy> regions(cache.GetMipLevels());
+
+	for (uint32_t i = 0; i < regions.size(); i++) {
+		regions[i].bufferOffset = levels[i].offset;
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.baseArrayLayer = 0;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageExtent = { levels[i].width, levels[i].height, 1 };
+	}
+
+	return regions;
+}
+
+std::vector<VkBufferImageCopy> Engine::GetMipChainRegions(const MipChain& chain) {
+	std::vector<VkBufferImageCopy> regions(chain.levels.size());
+
+	for (uint32_t i = 0; i < regions.size(); i++) {
+		regions[i].bufferOffset = chain.levels[i].offset;
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.baseArrayLayer = 0;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageExtent = { chain.levels[i].width, chain.levels[i].height, 1 };
+	}
+
+	return regions;
+}
+
+void Engine::UploadTextureImage(UploadBatch& batch, VkImage& image, Allocation& imageMemory, const void* data, VkDeviceSize dataSize, VkFormat format, uint32_t width, uint32_t height, const std::vector<VkBufferImageCopy>& regions) {
+	uint32_t levelCount = static_cast<uint32_t>(regions.size());
+
+	StagingRegion staging = CreateStagingBuffer(batch, data, dataSize);
+
+	std::vector<VkBufferImageCopy> copies = regions;
+
+	for (VkBufferImageCopy& copy : copies) {
+		copy.bufferOffset += staging.offset;
+	}
+
+	CreateImage(image, imageMemory, width, height, levelCount, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	TransitionImageLayout(batch.commandBuffer, image, levelCount, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	BeginUploadTimestamp(batch, "CopyBufferToImage");
+	CopyBufferToImage(batch.commandBuffer, staging.buffer, image, copies);
+	EndUploadTimestamp(batch);
+	TransitionImageLayout(batch.commandBuffer, image, levelCount, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void Engine::UploadTextureImageWithBlits(UploadBatch& batch, VkImage& image, Allocation& imageMemory, const uint8_t* pixels, uint32_t width, uint32_t height) {
+	uint32_t levelCount = GetMipLevelCount(width, height);
+	VkDeviceSize imageSize = static_cast<VkDeviceSize>(width) * height * 4;
+
+	StagingRegion staging = CreateStagingBuffer(batch, pixels, imageSize);
+
+	CreateImage(image, imageMemory, width, height, levelCount, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	TransitionImageLayout(batch.commandBuffer, image, levelCount, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	BeginUploadTimestamp(batch, "CopyBufferToImage");
+	CopyBufferToImage(batch.commandBuffer, staging.buffer, image, width, height, staging.offset);
+	EndUploadTimestamp(batch);
+	BeginUploadTimestamp(batch, "GenerateMipmaps");
+	GenerateMipmaps(batch.commandBuffer, image, static_cast<int32_t>(width), static_cast<int32_t>(height), levelCount, VK_FORMAT_R8G8B8A8_SRGB);
+	EndUploadTimestamp(batch);
+}
+
+bool Engine::SupportsLinearBlit(VkFormat format) {
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(this->physicalDevice, format, &properties);
+
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	return (properties.optimalTilingFeatures & required) == required;
+}
+
+bool Engine::PreferCPUMipmaps(VkFormat format) {
+	if (this->CPU_MIPMAPS || !SupportsLinearBlit(format)) {
+		return true;
+	}
+
+	// Software rasterizers run blits on the CPU anyway, one level at a time and without SIMD-friendly kernels.
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+	return properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+}
+
+void Engine::BenchmarkMipmaps(const char* name, size_t runs) {
+	int im_w, im_h, channels;
+	stbi_uc* pixels = stbi_load(name, &im_w, &im_h, &channels, STBI_rgb_alpha);
+
+	if (!pixels) {
+		throw std::runtime_error("Could not load image " + std::string(name));
+	}
+
+	uint32_t width = static_cast<uint32_t>(im_w);
+	uint32_t height = static_cast<uint32_t>(im_h);
+
+	std::cout << "Mipmap generation: " << name << " (" << width << "x" << height << ", " << GetMipLevelCount(width, height) << " levels), " << runs << " runs, "
+		<< std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+	const MipInstructionSet instructionSets[] = { MipInstructionSet::Scalar, MipInstructionSet::SSE2, MipInstructionSet::AVX2, MipInstructionSet::NEON };
+	MipInstructionSet best = GetBestMipInstructionSet();
+
+	for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser }) {
+		MipChain reference = GenerateMipChain(pixels, width, height, filter, 0, MipInstructionSet::Scalar);
+
+		for (MipInstructionSet instructionSet : instructionSets) {
+			if (!IsMipInstructionSetSupported(instructionSet)) {
+				continue;
+			}
+
+			// The widest instruction set is also run on a single thread, to show how much the row bands gain.
+			for (unsigned threadCount : { 0u, 1u }) {
+				if (threadCount == 1 && instructionSet != best) {
+					continue;
+				}
+
+				std::vector<double> timings;
+				MipChain chain;
+
+				for (size_t i = 0; i < runs; i++) {
+					std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+					chain = GenerateMipChain(pixels, width, height, filter, threadCount, instructionSet);
+					timings.push_back(ElapsedMs(startTime));
+				}
+
+				BenchmarkStats stats = ComputeBenchmarkStats(timings);
+
+				std::cout << "  cpu " << GetMipFilterName(filter) << " " << GetMipInstructionSetName(instructionSet) << (threadCount == 1 ? " (1 thread)" : "") << ": mean " << stats.mean << " ms, p50 " << stats.p50
+					<< " ms, max " << stats.max << " ms, " << (chain.data == reference.data ? "matches scalar" : "differs from scalar") << std::endl;
+			}
+		}
+	}
+
+	// End to end, from decoded pixels to a sampled image with every level filled.
+	std::vector<double> cpuTimings;
+	std::vector<double> blitTimings;
+	bool blitSupported = SupportsLinearBlit(VK_FORMAT_R8G8B8A8_SRGB);
+
+	for (size_t i = 0; i < runs; i++) {
+		VkImage image;
+		Allocation imageMemory;
+
+		UploadBatch batch;
+
+		std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+		MipChain chain = GenerateMipChain(pixels, width, height, this->MIPMAP_FILTER);
+		BeginUploadBatch(batch);
+		UploadTextureImage(batch, image, imageMemory, chain.data.data(), chain.data.size(), VK_FORMAT_R8G8B8A8_SRGB, width, height, GetMipChainRegions(chain));
+		SubmitUploadBatch(batch);
+		FinishUploadBatch(batch);
+		cpuTimings.push_back(ElapsedMs(startTime));
+
+		vkDestroyImage(this->logicalDevice, image, nullptr);
+		this->allocator.Free(imageMemory);
+
+		if (blitSupported) {
+			startTime = std::chrono::high_resolution_clock::now();
+			BeginUploadBatch(batch);
+			UploadTextureImageWithBlits(batch, image, imageMemory, pixels, width, height);
+			SubmitUploadBatch(batch);
+			FinishUploadBatch(batch);
+			blitTimings.push_back(ElapsedMs(startTime));
+
+			vkDestroyImage(this->logicalDevice, image, nullptr);
+			this->allocator.Free(imageMemory);
+		}
+	}
+
+	stbi_image_free(pixels);
+
+	BenchmarkStats cpuStats = ComputeBenchmarkStats(cpuTimings);
+	std::cout << "  cpu " << GetMipFilterName(this->MIPMAP_FILTER) << " + upload: mean " << cpuStats.mean << " ms, p50 " << cpuStats.p50 << " ms, max " << cpuStats.max << " ms" << std::endl;
+
+	if (blitSupported) {
+		BenchmarkStats blitStats = ComputeBenchmarkStats(blitTimings);
+		std::cout << "  upload + blit: mean " << blitStats.mean << " ms, p50 " << blitStats.p50 << " ms, max " << blitStats.max << " ms" << std::endl;
+		std::cout << "  cpu " << GetMipFilterName(this->MIPMAP_FILTER) << " speedup over blit: " << (blitStats.mean / cpuStats.mean) << "x (mean blit / mean cpu)" << std::endl;
+	}
+	else {
+		std::cout << "  upload + blit: not supported for VK_FORMAT_R8G8B8A8_SRGB on this device" << std::endl;
+	}
+}
+
+bool Engine::SupportsSampledFormat(VkFormat format) {
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(this->physicalDevice, format, &properties);
+
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+
+	return (properties.optimalTilingFeatures & required) == required;
+}
+
 void Engine::CreateTextureImageViews(uint32_t mipLevels) {
 	this->textureImageViews.resize(this->textureImages.size());
 
@@ -1310,7 +2307,7 @@ void Engine::CreateTextureImageViews(uint32_t mipLevels) {
 		imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		imageViewCreateInfo.image = image;
 		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewCreateInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+		imageViewCreateInfo.format = this->textureFormat;
 		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
 		imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -1343,15 +2340,13 @@ void Engine::CreateTextureSampler() {
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = static_cast<float>(this->mipLevels);
+	// Not tied to mipLevels, which changes when a streamed texture replaces the placeholder.
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 	VKCheck("Could not create texture sampler.", vkCreateSampler(this->logicalDevice, &samplerInfo, nullptr, &this->sampler));
 }
 
-void Engine::TransitionImageLayout(VkImage& image, uint32_t mipLevels, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-	VkCommandBuffer commandBuffer;
-	BeginSingleTimeCommands(commandBuffer, this->commandPool);
-
+void Engine::TransitionImageLayout(VkCommandBuffer commandBuffer, VkImage& image, uint32_t mipLevels, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
 	VkImageMemoryBarrier memoryBarrier = {};
 	memoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	memoryBarrier.image = image;
@@ -1398,16 +2393,11 @@ void Engine::TransitionImageLayout(VkImage& image, uint32_t mipLevels, VkFormat
 	}
 
 	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &memoryBarrier);
-
-	EndSingleTimeCommands(commandBuffer, this->commandPool);
 }
 
-void Engine::CopyBufferToImage(VkBuffer& srcBuffer, VkImage& srcImage, uint32_t width, uint32_t height) {
-	VkCommandBuffer commandBuffer;
-	BeginSingleTimeCommands(commandBuffer, this->commandPool);
-
+void Engine::CopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer& srcBuffer, VkImage& srcImage, uint32_t width, uint32_t height, VkDeviceSize bufferOffset) {
 	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
+	region.bufferOffset = bufferOffset;
 	region.bufferRowLength = 0;
 	region.bufferImageHeight = 0;
 
@@ -1423,9 +2413,11 @@ void Engine::CopyBufferToImage(VkBuffer& srcBuffer, VkImage& srcImage, uint32_t
 		1
 	};
 
-	vkCmdCopyBufferToImage(commandBuffer, srcBuffer, srcImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	CopyBufferToImage(commandBuffer, srcBuffer, srcImage, std::vector<VkBufferImageCopy>{ region });
+}
 
-	EndSingleTimeCommands(commandBuffer, this->commandPool);
+void Engine::CopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer& srcBuffer, VkImage& srcImage, const std::vector<VkBufferImageCopy>& regions) {
+	vkCmdCopyBufferToImage(commandBuffer, srcBuffer, srcImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
 }
 
 void Engine::BeginSingleTimeCommands(VkCommandBuffer& commandBuffer, VkCommandPool& commandPool) {
@@ -1457,150 +2449,277 @@ void Engine::EndSingleTimeCommands(VkCommandBuffer& commandBuffer, VkCommandPool
 	vkFreeCommandBuffers(this->logicalDevice, commandPool, 1, &commandBuffer);
 }
 
-void Engine::CopyBuffer(VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size, VkCommandPool& commandPool) {
-	VkCommandBuffer commandBuffer;
-	BeginSingleTimeCommands(commandBuffer, commandPool);
-
+void Engine::CopyBuffer(VkCommandBuffer commandBuffer, VkBuffer& srcBuffer, VkDeviceSize srcOffset, VkBuffer& dstBuffer, VkDeviceSize size) {
 	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = srcOffset;
 	copyRegion.size = size;
 
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+}
 
-	EndSingleTimeCommands(commandBuffer, commandPool);
+void Engine::CreateStagingRing() {
+	if (this->STAGING_RING_SIZE == 0) {
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+	VkDeviceSize size = this->STAGING_RING_SIZE;
+	VkDeviceSize alignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+
+	this->stagingRingBuffer = CreateBuffer(this->stagingRingMemory, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	this->stagingRing.Init(this->logicalDevice, this->stagingRingBuffer, this->stagingRingMemory.mapped, size, alignment);
+}
 
+void Engine::DestroyStagingRing() {
+	vkDestroyBuffer(this->logicalDevice, this->stagingRingBuffer, nullptr);
+	this->allocator.Free(this->stagingRingMemory);
 }
 
-void Engine::CreateVertexBuffer() {
-	VkDeviceSize stagingBufferSize = sizeof(this->vertices[0]) * this->vertices.size();
-	VkDeviceMemory stagingBufferMemory = 0;
-	VkBuffer stagingBuffer = 0;
-	stagingBuffer = CreateBuffer(stagingBufferMemory, stagingBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+StagingRegion Engine::AllocateStaging(const void* data, VkDeviceSize size) {
+	StagingRegion region;
 
-	void* data;
-	vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, stagingBufferSize, 0, &data);
-	memcpy(data, this->vertices.data(), (size_t) stagingBufferSize);
-	vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+	// Too large for the ring, or the ring is full of regions that have not been submitted yet.
+	if (!this->stagingRing.Allocate(size, region)) {
+		region.buffer = CreateBuffer(region.memory, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		region.size = size;
+		region.mapped = region.memory.mapped;
+	}
 
-	VkDeviceSize vertexBufferSize = stagingBufferSize;
-	VkDeviceMemory vertexBufferMemory = 0;
-	this->vertexBuffer = CreateBuffer(vertexBufferMemory, vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	this->vertexMemory = vertexBufferMemory;
+	if (data != nullptr) {
+		memcpy(region.mapped, data, static_cast<size_t>(size));
+	}
 
-	CopyBuffer(stagingBuffer, this->vertexBuffer, vertexBufferSize, this->copyPool);
-	vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(this->logicalDevice, stagingBufferMemory, nullptr);
+	return region;
 }
 
-void Engine::CreateIndicesBuffer() {
-	VkDeviceSize stagingBufferSize = sizeof(this->indices[0]) * this->indices.size();
-	VkDeviceMemory stagingBufferMemory = 0;
-	VkBuffer stagingBuffer = 0;
-	stagingBuffer = CreateBuffer(stagingBufferMemory, stagingBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+void Engine::ReleaseStaging(StagingRegion& region) {
+	if (region.entry != UINT64_MAX) {
+		this->stagingRing.Release(region);
+	}
+	else if (region.buffer != VK_NULL_HANDLE) {
+		vkDestroyBuffer(this->logicalDevice, region.buffer, nullptr);
+		this->allocator.Free(region.memory);
+	}
+
+	region = StagingRegion();
+}
 
-	void* data;
-	vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, stagingBufferSize, 0, &data);
-	memcpy(data, this->indices.data(), (size_t)stagingBufferSize);
-	vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+void Engine::BeginUploadBatch(UploadBatch& batch) {
+	BeginSingleTimeCommands(batch.commandBuffer, this->commandPool);
 
-	VkDeviceSize indicesBufferSize = stagingBufferSize;
-	VkDeviceMemory indicesBufferMemory = 0;
-	this->indicesBuffer = CreateBuffer(indicesBufferMemory, indicesBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	this->indicesMemory = indicesBufferMemory;
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-	CopyBuffer(stagingBuffer, this->indicesBuffer, indicesBufferSize, this->copyPool);
-	vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(this->logicalDevice, stagingBufferMemory, nullptr);
+	VKCheck("Could not create upload fence.", vkCreateFence(this->logicalDevice, &fenceCreateInfo, nullptr, &batch.fence));
 }
 
-void Engine::CreateUniformBuffers() {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+StagingRegion Engine::CreateStagingBuffer(UploadBatch& batch, const void* data, VkDeviceSize size) {
+	StagingRegion staging = AllocateStaging(data, size);
 
-	this->uniformBuffers.resize(this->swapImages.size());
-	this->uniformBuffersMemory.resize(this->swapImages.size());
+	batch.staging.push_back(staging);
+	batch.stagingBytes += size;
 
+	return staging;
+}
 
+void Engine::SubmitUploadBatch(UploadBatch& batch) {
+	VKCheck("Could not record upload command buffer.", vkEndCommandBuffer(batch.commandBuffer));
 
-	//UniformBufferObject obj = {  };
-	//obj.model = glm::mat4(0.0f);
-	//obj.view = glm::mat4(2.0f);
-	//obj.projection = glm::mat4(1.0f);
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
 
-	for (int i = 0; i < this->swapImages.size(); i++) {
-		this->uniformBuffers[i] = CreateBuffer(this->uniformBuffersMemory[i], bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	VKCheck("Could not submit uploads.", vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, batch.fence));
+
+	for (const StagingRegion& staging : batch.staging) {
+		this->stagingRing.Submitted(staging, batch.fence);
 	}
 }
 
-void Engine::CreateDescriptorPool() {
-	VkDescriptorPoolSize swapPoolSize = {};
-	swapPoolSize.descriptorCount = static_cast<uint32_t>(this->swapImages.size());
-	swapPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+void Engine::FinishUploadBatch(UploadBatch& batch) {
+	std::chrono::time_point waitStart = std::chrono::high_resolution_clock::now();
+	vkWaitForFences(this->logicalDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+	double waitMs = ElapsedMs(waitStart);
 
-	VkDescriptorPoolSize texPoolSize = {};
-	texPoolSize.descriptorCount = static_cast<uint32_t>(this->swapImages.size());
-	texPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	ResolveUploadTimestamps(batch);
 
-	std::vector<VkDescriptorPoolSize> poolSizes = { swapPoolSize, texPoolSize };
+	if (!batch.staging.empty()) {
+		std::cout << "Uploaded " << batch.staging.size() << " staging regions (" << (batch.stagingBytes / (1024.0 * 1024.0)) << " MB) in one submission, waited " << waitMs << " ms" << std::endl;
+	}
 
-	VkDescriptorPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.poolSizeCount = poolSizes.size();
-	poolInfo.maxSets = static_cast<uint32_t>(this->swapImages.size());
+	for (StagingRegion& staging : batch.staging) {
+		ReleaseStaging(staging);
+	}
 
-	VKCheck("Could not create descriptor pool.", vkCreateDescriptorPool(this->logicalDevice, &poolInfo, nullptr, &this->descriptorPool));
+	vkFreeCommandBuffers(this->logicalDevice, this->commandPool, 1, &batch.commandBuffer);
+	vkDestroyFence(this->logicalDevice, batch.fence, nullptr);
+
+	batch = UploadBatch();
 }
 
-void Engine::CreateDescriptorSets() {
-	std::vector<VkDescriptorSetLayout> descriptorSetLayouts(this->swapImages.size(), this->descriptorSetLayout);
+void Engine::CreateGeometryBuffer(UploadBatch& batch, VkBuffer& buffer, Allocation& bufferMemory, const void* data, VkDeviceSize size, VkBufferUsageFlags usage) {
+	memcpy(CreateGeometryBuffer(batch, buffer, bufferMemory, size, usage), data, (size_t)size);
+}
 
-	VkDescriptorSetAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocateInfo.descriptorPool = this->descriptorPool;
-	allocateInfo.descriptorSetCount = static_cast<uint32_t>(this->swapImages.size());
-	allocateInfo.pSetLayouts = descriptorSetLayouts.data();
+// Returns where the caller writes the buffer's contents before the batch is submitted.
+void* Engine::CreateGeometryBuffer(UploadBatch& batch, VkBuffer& buffer, Allocation& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage) {
+	if (this->DIRECT_GEOMETRY_UPLOAD && this->deviceLocalHostVisible) {
+		// Resizable BAR / unified memory: the CPU can write VRAM directly, no staging copy needed.
+		buffer = CreateBuffer(bufferMemory, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		return bufferMemory.mapped;
+	}
+
+	StagingRegion staging = CreateStagingBuffer(batch, nullptr, size);
+
+	buffer = CreateBuffer(bufferMemory, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	BeginUploadTimestamp(batch, "CopyBuffer");
+	CopyBuffer(batch.commandBuffer, staging.buffer, staging.offset, buffer, size);
+	EndUploadTimestamp(batch);
+
+	return staging.mapped;
+}
 
-	this->descriptorSets.resize(this->swapImages.size());
-	vkAllocateDescriptorSets(this->logicalDevice, &allocateInfo, this->descriptorSets.data());
+template<typename Layout> static void PackVertexLayout(const Vertex* vertices, size_t count, VertexQuantization& quantization, void* packed) {
+	quantization = Layout::GetQuantization(vertices, count);
+	Layout::Pack(vertices, count, quantization, static_cast<Layout*>(packed));
+}
+
+VkDeviceSize Engine::GetPackedVertexSize(size_t count) const {
+	return static_cast<VkDeviceSize>(this->fullPrecisionVertices ? sizeof(FullVertex) : sizeof(GpuVertex)) * count;
+}
+
+// Packs the vertices in the layout the pipeline was built for into GetPackedVertexSize(count) bytes at packed, returning
+// the quantization that unpacks them.
+void Engine::PackVertices(const Vertex* vertices, size_t count, VertexQuantization& quantization, void* packed) const {
+	if (this->fullPrecisionVertices) {
+		PackVertexLayout<FullVertex>(vertices, count, quantization, packed);
+		return;
+	}
 
-	for (int i = 0; i < this->swapImages.size(); i++) {
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = this->uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
+	PackVertexLayout<GpuVertex>(vertices, count, quantization, packed);
+}
 
-		VkDescriptorImageInfo imageInfo = {};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = this->textureImageViews[0];
-		imageInfo.sampler = this->sampler;
+void Engine::CreateVertexBuffer(UploadBatch& batch) {
+	// The cache holds full-precision vertices, packed straight from the mapped file into staging or mapped VRAM.
+	const Vertex* vertices = this->meshCache.IsOpen() ? this->meshCache.GetVertices() : this->vertices.data();
+	size_t vertexCount = this->meshCache.IsOpen() ? this->meshCache.GetVertexCount() : this->vertices.size();
 
-		VkWriteDescriptorSet uboWrite = {};
-		uboWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		uboWrite.descriptorCount = 1;
-		uboWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		uboWrite.pBufferInfo = &bufferInfo;
-		uboWrite.pImageInfo = nullptr;
-		uboWrite.pTexelBufferView = nullptr;
-		uboWrite.dstSet = this->descriptorSets[i];
-		uboWrite.dstArrayElement = 0;
-		uboWrite.dstBinding = 0;
+	void* packed = CreateGeometryBuffer(batch, this->vertexBuffer, this->vertexMemory, GetPackedVertexSize(vertexCount), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	PackVertices(vertices, vertexCount, this->vertexQuantization, packed);
+}
 
-		VkWriteDescriptorSet imgWrite = {};
-		imgWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		imgWrite.descriptorCount = 1;
-		imgWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		imgWrite.dstSet = this->descriptorSets[i];
-		imgWrite.dstArrayElement = 0;
-		imgWrite.dstBinding = 1;
-		imgWrite.pImageInfo = &imageInfo;
+void Engine::CreateIndicesBuffer(UploadBatch& batch) {
+	const uint32_t* indices = this->meshCache.IsOpen() ? this->meshCache.GetIndices() : this->indices.data();
+	size_t indexCount = this->meshCache.IsOpen() ? this->meshCache.GetIndexCount() : this->indices.size();
+	size_t vertexCount = this->meshCache.IsOpen() ? this->meshCache.GetVertexCount() : this->vertices.size();
 
-		std::vector<VkWriteDescriptorSet> descriptorWrites = { uboWrite, imgWrite };
+	PackedIndices packed = PackIndices(indices, indexCount, vertexCount, this->modelShapes, this->SIXTEEN_BIT_INDICES);
+	this->indexChunks = std::move(packed.chunks);
 
-		vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	if (!packed.indices16.empty()) {
+		this->indexType = VK_INDEX_TYPE_UINT16;
+		CreateGeometryBuffer(batch, this->indicesBuffer, this->indicesMemory, packed.indices16.data(), sizeof(uint16_t) * indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		return;
 	}
 
+	this->indexType = VK_INDEX_TYPE_UINT32;
+	CreateGeometryBuffer(batch, this->indicesBuffer, this->indicesMemory, indices, sizeof(uint32_t) * indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+}
+
+void Engine::CreateUniformBuffer() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+	VkDeviceSize alignment = std::max<VkDeviceSize>(1, properties.limits.minUniformBufferOffsetAlignment);
+	this->uniformBufferStride = (sizeof(UniformBufferObject) + alignment - 1) / alignment * alignment;
+
+	//UniformBufferObject obj = {  };
+	//obj.model = glm::mat4(0.0f);
+	//obj.view = glm::mat4(2.0f);
+	//obj.projection = glm::mat4(1.0f);
+
+	VkDeviceSize bufferSize = this->uniformBufferStride * this->swapImages.size();
+	this->uniformBuffer = CreateBuffer(this->uniformBufferMemory, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void Engine::CreateDescriptorPool() {
+	VkDescriptorPoolSize swapPoolSize = {};
+	swapPoolSize.descriptorCount = 1;
+	swapPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+	VkDescriptorPoolSize texPoolSize = {};
+	texPoolSize.descriptorCount = 1;
+	texPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	std::vector<VkDescriptorPoolSize> poolSizes = { swapPoolSize, texPoolSize };
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.poolSizeCount = poolSizes.size();
+	poolInfo.maxSets = 1;
+
+	VKCheck("Could not create descriptor pool.", vkCreateDescriptorPool(this->logicalDevice, &poolInfo, nullptr, &this->descriptorPool));
+}
+
+void Engine::CreateDescriptorSet() {
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = this->descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &this->descriptorSetLayout;
+
+	VKCheck("Could not allocate descriptor set.", vkAllocateDescriptorSets(this->logicalDevice, &allocateInfo, &this->descriptorSet));
+
+	WriteDescriptorSet();
+}
+
+void Engine::WriteDescriptorSet() {
+	// The range covers one slice; the dynamic offset bound with the set picks the swap image's slice.
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = this->uniformBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = sizeof(UniformBufferObject);
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = this->textureImageViews[0];
+	imageInfo.sampler = this->sampler;
+
+	VkWriteDescriptorSet uboWrite = {};
+	uboWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	uboWrite.descriptorCount = 1;
+	uboWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uboWrite.pBufferInfo = &bufferInfo;
+	uboWrite.pImageInfo = nullptr;
+	uboWrite.pTexelBufferView = nullptr;
+	uboWrite.dstSet = this->descriptorSet;
+	uboWrite.dstArrayElement = 0;
+	uboWrite.dstBinding = 0;
+
+	VkWriteDescriptorSet imgWrite = {};
+	imgWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	imgWrite.descriptorCount = 1;
+	imgWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	imgWrite.dstSet = this->descriptorSet;
+	imgWrite.dstArrayElement = 0;
+	imgWrite.dstBinding = 1;
+	imgWrite.pImageInfo = &imageInfo;
+
+	std::vector<VkWriteDescriptorSet> descriptorWrites = { uboWrite, imgWrite };
+
+	vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
 void Engine::CreateCommandBuffers() {
+	if (this->RECORD_EVERY_FRAME) {
+		return;
+	}
+
 	this->commandBuffers.resize(this->framebuffers.size());
 
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
@@ -1611,12 +2730,6 @@ void Engine::CreateCommandBuffers() {
 
 	VKCheck("Could not allocate command buffers.", vkAllocateCommandBuffers(this->logicalDevice, &commandBufferAllocateInfo, this->commandBuffers.data()));
 
-
-	VkClearValue clearColor = { 0.25f, 0.50f, 0.75f, 1.0f };
-	VkClearValue depthStencil = { 1.0f, 0.0f };
-
-	std::vector<VkClearValue> clearValues = { clearColor, depthStencil };
-
 	for (size_t i = 0; i < this->commandBuffers.size(); i++) {
 		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
 		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1625,47 +2738,1419 @@ void Engine::CreateCommandBuffers() {
 
 		VKCheck("Could not begin command buffer.", vkBeginCommandBuffer(this->commandBuffers[i], &commandBufferBeginInfo));
 
-		VkRenderPassBeginInfo renderPassBeginInfo = {};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.framebuffer = this->framebuffers[i];
-		renderPassBeginInfo.renderPass = this->renderPass;
-		renderPassBeginInfo.renderArea.extent = this->swapImageSize;
-		renderPassBeginInfo.renderArea.offset = { 0, 0 };
-		renderPassBeginInfo.clearValueCount = clearValues.size();
-		renderPassBeginInfo.pClearValues = clearValues.data();
+		BeginFrameRenderPass(this->commandBuffers[i], static_cast<uint32_t>(i), VK_SUBPASS_CONTENTS_INLINE);
+		RecordDraws(this->commandBuffers[i], static_cast<uint32_t>(i), 0, this->drawList.size());
+		EndFrameRenderPass(this->commandBuffers[i], static_cast<uint32_t>(i));
+
+		VKCheck("Failed to record command buffer.", vkEndCommandBuffer(this->commandBuffers[i]));
+	}
+}
+
+void Engine::DestroyCommandBuffers() {
+	if (!this->commandBuffers.empty()) {
+		vkFreeCommandBuffers(this->logicalDevice, this->commandPool, static_cast<uint32_t>(this->commandBuffers.size()), this->commandBuffers.data());
+		this->commandBuffers.clear();
+	}
+}
 
-		vkCmdBeginRenderPass(this->commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(this->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline);
+void Engine::BuildDrawList() {
+	this->drawList.clear();
+	this->batchLods.assign(this->instanceBatches.size(), 0);
 
-		VkBuffer vertexBuffers[] = { this->vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(this->commandBuffers[i], 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(this->commandBuffers[i], this->indicesBuffer, 0, VK_INDEX_TYPE_UINT32);
+	// The model's shapes hold every level in turn, so a chunk's level follows from its shape.
+	this->lodLevelCount = this->meshLodErrors.empty() ? 1 : std::max<uint32_t>(1, static_cast<uint32_t>(this->meshLodErrors[0].size()));
+	uint32_t shapesPerLevel = std::max<uint32_t>(1, static_cast<uint32_t>(this->modelShapes.size()) / this->lodLevelCount);
 
-		vkCmdBindDescriptorSets(this->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &this->descriptorSets[i], 0, nullptr);
+	for (uint32_t b = 0; b < this->instanceBatches.size(); b++) {
+		const InstanceBatch& batch = this->instanceBatches[b];
 
-		vkCmdDrawIndexed(this->commandBuffers[i], static_cast<uint32_t>(this->indices.size()), 1, 0, 0, 0);
-		vkCmdEndRenderPass(this->commandBuffers[i]);
-		VKCheck("Failed to record command buffer.", vkEndCommandBuffer(this->commandBuffers[i]));
+		// Only the loaded model exists so far.
+		if (batch.meshId != 0) {
+			continue;
+		}
+
+		for (const IndexChunk& chunk : this->indexChunks) {
+			uint32_t step = this->DRAW_SPLIT_TRIANGLES > 0 ? this->DRAW_SPLIT_TRIANGLES * 3 : chunk.indexCount;
+
+			for (uint32_t offset = 0; offset < chunk.indexCount; offset += step) {
+				DrawCommand draw = {};
+				draw.firstIndex = chunk.firstIndex + offset;
+				draw.indexCount = std::min(step, chunk.indexCount - offset);
+				draw.vertexOffset = chunk.vertexOffset;
+				draw.firstInstance = batch.firstInstance;
+				draw.instanceCount = batch.instanceCount;
+				draw.batch = b;
+				draw.lod = std::min(chunk.shape / shapesPerLevel, this->lodLevelCount - 1);
+				this->drawList.push_back(draw);
+			}
+		}
 	}
 }
 
-void Engine::CreateSyncObjects() {
-	this->imagesAvailableSemaphores.resize(this->MAX_CONCURRENT_FRAMES);
-	this->imagesRenderedSemaphores.resize(this->MAX_CONCURRENT_FRAMES);
-	this->inFlightFences.resize(this->MAX_CONCURRENT_FRAMES);
-	this->imagesInFlight.resize(this->swapImages.size(), VK_NULL_HANDLE);
+void Engine::CreateScene() {
+	if (this->scene.GetObjectCount() == 0) {
+		CreateGridScene(this->scene, std::max<size_t>(1, this->SCENE_INSTANCES), this->SCENE_SPACING, 0, 0);
+	}
 
-	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	// Push the far plane out so the whole grid is visible from the camera.
+	if (this->scene.GetObjectCount() > 1) {
+		float side = std::ceil(std::sqrt(static_cast<float>(this->scene.GetObjectCount()))) * this->SCENE_SPACING;
+		this->FARTHEST = std::max(this->FARTHEST, glm::length(this->CAMERA_POSITION) + side);
+	}
+}
 
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+void Engine::CreateInstanceBuffer(UploadBatch& batch) {
+	this->instanceBatches = BuildInstanceBatches(this->scene, this->instanceTransforms);
 
-	for (size_t i = 0; i < this->MAX_CONCURRENT_FRAMES; i++) {
-		VKCheck("Could not create signal sempahores.", vkCreateSemaphore(this->logicalDevice, &semaphoreCreateInfo, nullptr, &this->imagesAvailableSemaphores[i]));
-		VKCheck("Could not create wait sempahores.", vkCreateSemaphore(this->logicalDevice, &semaphoreCreateInfo, nullptr, &this->imagesRenderedSemaphores[i]));
-		VKCheck("Could not create working fences.", vkCreateFence(this->logicalDevice, &fenceCreateInfo, nullptr, &this->inFlightFences[i]));
+	// Also read by the culling pass.
+	VkDeviceSize instanceBufferSize = sizeof(glm::mat4) * this->instanceTransforms.size();
+	CreateGeometryBuffer(batch, this->instanceBuffer, this->instanceMemory, this->instanceTransforms.data(), instanceBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	std::cout << "Scene: " << this->scene.GetObjectCount() << " objects in " << this->instanceBatches.size() << " instance batches" << std::endl;
+}
+
+void Engine::ResolveCullMode() {
+	this->cullMode = this->CULL_MODE;
+
+	if (this->cullMode == CullMode::GPU && this->cullPipeline == VK_NULL_HANDLE) {
+		this->cullMode = CullMode::CPU;
+	}
+
+	// Every batch but the first starts at a non-zero instance.
+	if (this->cullMode != CullMode::Off && !this->drawIndirectFirstInstance) {
+		this->cullMode = CullMode::Off;
+	}
+
+	if (this->cullMode != this->CULL_MODE) {
+		std::cout << "Culling: " << GetCullModeName(this->CULL_MODE) << " is not supported, using " << GetCullModeName(this->cullMode) << std::endl;
+	}
+}
+
+void Engine::SetCullMode(CullMode mode) {
+	vkWaitForFences(this->logicalDevice, static_cast<uint32_t>(this->inFlightFences.size()), this->inFlightFences.data(), VK_TRUE, UINT64_MAX);
+
+	this->CULL_MODE = mode;
+	ResolveCullMode();
+	RecreateCullingResources();
+
+	DestroyCommandBuffers();
+	CreateCommandBuffers();
+}
+
+void Engine::CreateCullingPipeline() {
+	if ((this->CULL_MODE != CullMode::GPU && !this->BENCHMARK_CULLING) || !this->drawIndirectCount || !this->multiDrawIndirect || !this->graphicsCompute) {
+		return;
+	}
+
+	std::vector<char> shaderCull;
+
+	try {
+		shaderCull = ReadFile("shaders/cull.spv");
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return;
+	}
+
+	// Binding 0 is the uniform buffer; 4, 5 and 6 are per swap image slices.
+	std::vector<VkDescriptorSetLayoutBinding> bindings(7);
+
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].descriptorType = i >= 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VKCheck("Could not create culling descriptor set layout.", vkCreateDescriptorSetLayout(this->logicalDevice, &layoutInfo, nullptr, &this->cullDescriptorSetLayout));
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullPushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &this->cullDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	VKCheck("Could not create culling pipeline layout.", vkCreatePipelineLayout(this->logicalDevice, &pipelineLayoutInfo, nullptr, &this->cullPipelineLayout));
+
+	VkShaderModule cullModule = CreateShaderModule(shaderCull);
+
+	VkPipelineShaderStageCreateInfo stageInfo = {};
+	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	stageInfo.module = cullModule;
+	stageInfo.pName = "main";
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = stageInfo;
+	pipelineInfo.layout = this->cullPipelineLayout;
+
+	VKCheck("Could not create culling pipeline.", vkCreateComputePipelines(this->logicalDevice, this->pipelineCache, 1, &pipelineInfo, nullptr, &this->cullPipeline));
+
+	vkDestroyShaderModule(this->logicalDevice, cullModule, nullptr);
+}
+
+void Engine::DestroyCullingPipeline() {
+	vkDestroyPipeline(this->logicalDevice, this->cullPipeline, nullptr);
+	vkDestroyPipelineLayout(this->logicalDevice, this->cullPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(this->logicalDevice, this->cullDescriptorSetLayout, nullptr);
+}
+
+void Engine::CreateCullingBuffers(UploadBatch& batch) {
+	if (this->cullMode == CullMode::Off) {
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+	VkDeviceSize alignment = std::max<VkDeviceSize>(4, properties.limits.minStorageBufferOffsetAlignment);
+	VkDeviceSize batchCount = this->instanceBatches.size();
+	VkDeviceSize drawCount = this->drawList.size();
+
+	// The draw count, padded to 16 bytes, then one visible-instance counter per level of detail and batch.
+	this->indirectCountersSize = 16 + sizeof(uint32_t) * this->lodLevelCount * batchCount;
+	this->indirectCommandsOffset = (this->indirectCountersSize + alignment - 1) / alignment * alignment;
+	this->indirectStride = (this->indirectCommandsOffset + sizeof(VkDrawIndexedIndirectCommand) * drawCount + alignment - 1) / alignment * alignment;
+	this->culledInstanceStride = (sizeof(glm::mat4) * this->lodLevelCount * this->instanceTransforms.size() + alignment - 1) / alignment * alignment;
+
+	VkDeviceSize indirectBufferSize = this->indirectStride * this->swapImages.size();
+	VkDeviceSize culledInstanceBufferSize = this->culledInstanceStride * this->swapImages.size();
+
+	if (this->cullMode == CullMode::CPU) {
+		this->indirectBuffer = CreateBuffer(this->indirectMemory, indirectBufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		this->culledInstanceBuffer = CreateBuffer(this->culledInstanceMemory, culledInstanceBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		return;
+	}
+
+	this->indirectBuffer = CreateBuffer(this->indirectMemory, indirectBufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	this->culledInstanceBuffer = CreateBuffer(this->culledInstanceMemory, culledInstanceBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	std::vector<CullBatch> cullBatches(this->instanceBatches.size());
+
+	for (size_t i = 0; i < cullBatches.size(); i++) {
+		const InstanceBatch& instanceBatch = this->instanceBatches[i];
+
+		// Batches of meshes that don't exist get an empty sphere behind every plane.
+		cullBatches[i].boundingSphere = instanceBatch.meshId < this->meshBoundingSpheres.size() ? this->meshBoundingSpheres[instanceBatch.meshId] : glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+		cullBatches[i].firstInstance = instanceBatch.firstInstance;
+		cullBatches[i].instanceCount = instanceBatch.instanceCount;
+
+		if (instanceBatch.meshId < this->meshLodErrors.size()) {
+			const std::vector<float>& lodErrors = this->meshLodErrors[instanceBatch.meshId];
+			cullBatches[i].lodCount = std::max<uint32_t>(1, std::min<uint32_t>(static_cast<uint32_t>(lodErrors.size()), this->lodLevelCount));
+			std::copy(lodErrors.begin(), lodErrors.begin() + std::min<size_t>(lodErrors.size(), MAX_LOD_LEVELS), cullBatches[i].lodErrors);
+		}
+	}
+
+	std::vector<CullDraw> cullDraws(this->drawList.size());
+
+	for (size_t i = 0; i < cullDraws.size(); i++) {
+		cullDraws[i].indexCount = this->drawList[i].indexCount;
+		cullDraws[i].firstIndex = this->drawList[i].firstIndex;
+		cullDraws[i].vertexOffset = this->drawList[i].vertexOffset;
+		cullDraws[i].batch = this->drawList[i].batch;
+		cullDraws[i].lod = this->drawList[i].lod;
+	}
+
+	CreateGeometryBuffer(batch, this->cullBatchBuffer, this->cullBatchMemory, cullBatches.data(), sizeof(CullBatch) * cullBatches.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	CreateGeometryBuffer(batch, this->cullDrawBuffer, this->cullDrawMemory, cullDraws.data(), sizeof(CullDraw) * cullDraws.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void Engine::CreateCullingDescriptorSet() {
+	if (this->cullMode != CullMode::GPU) {
+		return;
+	}
+
+	VkDescriptorPoolSize uniformPoolSize = {};
+	uniformPoolSize.descriptorCount = 1;
+	uniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+	VkDescriptorPoolSize storagePoolSize = {};
+	storagePoolSize.descriptorCount = 3;
+	storagePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+	VkDescriptorPoolSize dynamicStoragePoolSize = {};
+	dynamicStoragePoolSize.descriptorCount = 3;
+	dynamicStoragePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+	std::vector<VkDescriptorPoolSize> poolSizes = { uniformPoolSize, storagePoolSize, dynamicStoragePoolSize };
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.maxSets = 1;
+
+	VKCheck("Could not create culling descriptor pool.", vkCreateDescriptorPool(this->logicalDevice, &poolInfo, nullptr, &this->cullDescriptorPool));
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = this->cullDescriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &this->cullDescriptorSetLayout;
+
+	VKCheck("Could not allocate culling descriptor set.", vkAllocateDescriptorSets(this->logicalDevice, &allocateInfo, &this->cullDescriptorSet));
+
+	// Dynamic bindings cover one slice each; the offsets bound with the set pick the swap image's slices.
+	std::vector<VkDescriptorBufferInfo> bufferInfos(7);
+	bufferInfos[0] = { this->uniformBuffer, 0, sizeof(UniformBufferObject) };
+	bufferInfos[1] = { this->instanceBuffer, 0, VK_WHOLE_SIZE };
+	bufferInfos[2] = { this->cullBatchBuffer, 0, VK_WHOLE_SIZE };
+	bufferInfos[3] = { this->cullDrawBuffer, 0, VK_WHOLE_SIZE };
+	bufferInfos[4] = { this->culledInstanceBuffer, 0, sizeof(glm::mat4) * this->lodLevelCount * this->instanceTransforms.size() };
+	bufferInfos[5] = { this->indirectBuffer, 0, this->indirectCountersSize };
+	bufferInfos[6] = { this->indirectBuffer, this->indirectCommandsOffset, sizeof(VkDrawIndexedIndirectCommand) * this->drawList.size() };
+
+	std::vector<VkWriteDescriptorSet> descriptorWrites(bufferInfos.size());
+
+	for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = this->cullDescriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].descriptorType = i >= 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+	vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void Engine::DestroyCullingResources() {
+	vkDestroyDescriptorPool(this->logicalDevice, this->cullDescriptorPool, nullptr);
+	vkDestroyBuffer(this->logicalDevice, this->cullBatchBuffer, nullptr);
+	this->allocator.Free(this->cullBatchMemory);
+	vkDestroyBuffer(this->logicalDevice, this->cullDrawBuffer, nullptr);
+	this->allocator.Free(this->cullDrawMemory);
+	vkDestroyBuffer(this->logicalDevice, this->culledInstanceBuffer, nullptr);
+	this->allocator.Free(this->culledInstanceMemory);
+	vkDestroyBuffer(this->logicalDevice, this->indirectBuffer, nullptr);
+	this->allocator.Free(this->indirectMemory);
+
+	this->cullDescriptorPool = VK_NULL_HANDLE;
+	this->cullBatchBuffer = VK_NULL_HANDLE;
+	this->cullDrawBuffer = VK_NULL_HANDLE;
+	this->culledInstanceBuffer = VK_NULL_HANDLE;
+	this->indirectBuffer = VK_NULL_HANDLE;
+}
+
+void Engine::RecreateCullingResources() {
+	DestroyCullingResources();
+
+	UploadBatch batch;
+	BeginUploadBatch(batch);
+	CreateCullingBuffers(batch);
+	SubmitUploadBatch(batch);
+	CreateCullingDescriptorSet();
+	FinishUploadBatch(batch);
+}
+
+void Engine::CullOnCPU(uint32_t imageIndex) {
+	glm::mat4* culledTransforms = reinterpret_cast<glm::mat4*>(static_cast<uint8_t*>(this->culledInstanceMemory.mapped) + imageIndex * this->culledInstanceStride);
+
+	std::vector<uint32_t> visibleCounts;
+	CullInstanceBatches(this->instanceBatches, this->instanceTransforms, this->meshBoundingSpheres, this->meshLodErrors, this->frameUBO.model, this->frameUBO.view, GetFrustum(this->frameUBO.projection * this->frameUBO.view),
+		GetLodScale(), this->lodLevelCount, culledTransforms, visibleCounts);
+
+	// Every draw keeps its slot; draws of batches with nothing visible get no instances.
+	VkDrawIndexedIndirectCommand* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(static_cast<uint8_t*>(this->indirectMemory.mapped) + imageIndex * this->indirectStride + this->indirectCommandsOffset);
+
+	for (size_t i = 0; i < this->drawList.size(); i++) {
+		const DrawCommand& draw = this->drawList[i];
+
+		commands[i].indexCount = draw.indexCount;
+		commands[i].instanceCount = visibleCounts[draw.lod * this->instanceBatches.size() + draw.batch];
+		commands[i].firstIndex = draw.firstIndex;
+		commands[i].vertexOffset = draw.vertexOffset;
+		commands[i].firstInstance = static_cast<uint32_t>(draw.lod * this->instanceTransforms.size()) + draw.firstInstance;
+	}
+}
+
+float Engine::GetLodScale() const {
+	// An error e at distance d covers e * (height / 2) / (d * tan(FOV / 2)) pixels.
+	float pixels = std::max(this->LOD_ERROR_PIXELS, 0.01f);
+	return this->swapImageSize.height * 0.5f / (std::tan(glm::radians(this->FOV) * 0.5f) * pixels);
+}
+
+void Engine::UpdateBatchLods() {
+	SelectBatchLods(this->instanceBatches, this->instanceTransforms, this->meshBoundingSpheres, this->meshLodErrors, this->frameUBO.view * this->frameUBO.model, GetLodScale(), this->batchLods);
+}
+
+void Engine::RecordGPUCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	VkDeviceSize indirectOffset = imageIndex * this->indirectStride;
+
+	// The counters start at zero every frame.
+	vkCmdFillBuffer(commandBuffer, this->indirectBuffer, indirectOffset, this->indirectCommandsOffset, 0);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	uint32_t dynamicOffsets[] = {
+		static_cast<uint32_t>(imageIndex * this->uniformBufferStride),
+		static_cast<uint32_t>(imageIndex * this->culledInstanceStride),
+		static_cast<uint32_t>(indirectOffset),
+		static_cast<uint32_t>(indirectOffset),
+	};
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipelineLayout, 0, 1, &this->cullDescriptorSet, 4, dynamicOffsets);
+
+	CullPushConstants pushConstants = {};
+	pushConstants.instanceCount = static_cast<uint32_t>(this->instanceTransforms.size());
+	pushConstants.drawCount = static_cast<uint32_t>(this->drawList.size());
+	pushConstants.batchCount = static_cast<uint32_t>(this->instanceBatches.size());
+	pushConstants.lodCount = this->lodLevelCount;
+	pushConstants.lodScale = GetLodScale();
+
+	// Pass 0 culls the instances and counts them per batch; pass 1 turns the counts into indirect draws.
+	pushConstants.pass = 0;
+	vkCmdPushConstants(commandBuffer, this->cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDispatch(commandBuffer, (pushConstants.instanceCount + 63) / 64, 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	pushConstants.pass = 1;
+	vkCmdPushConstants(commandBuffer, this->cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDispatch(commandBuffer, (pushConstants.drawCount + 63) / 64, 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Engine::BeginFrameRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkSubpassContents contents) {
+	if (this->frameQueryPool != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(commandBuffer, this->frameQueryPool, imageIndex * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->frameQueryPool, imageIndex * 2);
+	}
+
+	if (this->cullMode == CullMode::GPU) {
+		RecordGPUCulling(commandBuffer, imageIndex);
 	}
-}
\ No newline at end of file
+
+	VkClearValue clearColor = { 0.25f, 0.50f, 0.75f, 1.0f };
+	VkClearValue depthStencil = { 1.0f, 0.0f };
+
+	std::vector<VkClearValue> clearValues = { clearColor, depthStencil };
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.framebuffer = this->framebuffers[imageIndex];
+	renderPassBeginInfo.renderPass = this->renderPass;
+	renderPassBeginInfo.renderArea.extent = this->swapImageSize;
+	renderPassBeginInfo.renderArea.offset = { 0, 0 };
+	renderPassBeginInfo.clearValueCount = clearValues.size();
+	renderPassBeginInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, contents);
+}
+
+void Engine::EndFrameRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	vkCmdEndRenderPass(commandBuffer);
+
+	if (this->frameQueryPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->frameQueryPool, imageIndex * 2 + 1);
+	}
+
+	if (!this->readbackBuffers.empty()) {
+		RecordReadback(commandBuffer, imageIndex);
+	}
+}
+
+void Engine::RecordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t firstDraw, size_t drawCount) {
+	// Secondary command buffers inherit no state, so every buffer binds everything it draws with.
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline);
+
+	VkViewport viewPort = {};
+	viewPort.x = 0.0f;
+	viewPort.y = 0.0f;
+	viewPort.width = (float)this->swapImageSize.width;
+	viewPort.height = (float)this->swapImageSize.height;
+	viewPort.minDepth = 0.0f;
+	viewPort.maxDepth = 1.0f;
+
+	VkRect2D scissor = {};
+	scissor.extent = this->swapImageSize;
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewPort);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// Culled frames read the visible instances from the swap image's slice instead of the whole scene.
+	VkBuffer vertexBuffers[] = { this->vertexBuffer, this->instanceBuffer };
+	VkDeviceSize offsets[] = { 0, 0 };
+
+	if (this->cullMode != CullMode::Off) {
+		vertexBuffers[1] = this->culledInstanceBuffer;
+		offsets[1] = imageIndex * this->culledInstanceStride;
+	}
+
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, this->indicesBuffer, 0, this->indexType);
+
+	uint32_t uniformOffset = static_cast<uint32_t>(imageIndex * this->uniformBufferStride);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &this->descriptorSet, 1, &uniformOffset);
+
+	VkDeviceSize indirectOffset = imageIndex * this->indirectStride;
+	uint32_t commandStride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (this->cullMode == CullMode::GPU) {
+		// The commands are compacted on the GPU, so the whole list is drawn at once.
+		vkCmdDrawIndexedIndirectCount(commandBuffer, this->indirectBuffer, indirectOffset + this->indirectCommandsOffset, this->indirectBuffer, indirectOffset, static_cast<uint32_t>(this->drawList.size()), commandStride);
+		return;
+	}
+
+	if (this->cullMode == CullMode::CPU) {
+		VkDeviceSize commandsOffset = indirectOffset + this->indirectCommandsOffset + firstDraw * commandStride;
+
+		if (this->multiDrawIndirect) {
+			vkCmdDrawIndexedIndirect(commandBuffer, this->indirectBuffer, commandsOffset, static_cast<uint32_t>(drawCount), commandStride);
+			return;
+		}
+
+		for (size_t i = 0; i < drawCount; i++) {
+			vkCmdDrawIndexedIndirect(commandBuffer, this->indirectBuffer, commandsOffset + i * commandStride, 1, commandStride);
+		}
+
+		return;
+	}
+
+	for (size_t i = firstDraw; i < firstDraw + drawCount; i++) {
+		const DrawCommand& draw = this->drawList[i];
+
+		if (draw.lod != this->batchLods[draw.batch]) {
+			continue;
+		}
+
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+	}
+}
+
+void Engine::CreateFrameCommands() {
+	if (!this->RECORD_EVERY_FRAME) {
+		return;
+	}
+
+	unsigned threadCount = this->RECORD_THREADS > 0 ? this->RECORD_THREADS : std::max(1u, std::thread::hardware_concurrency());
+	this->recordWorkers.Start(threadCount);
+
+	this->frameCommands.resize(this->MAX_CONCURRENT_FRAMES);
+
+	for (FrameCommands& frame : this->frameCommands) {
+		CreateCommandPool(frame.pool, this->queueFamilies.graphicsQF.value(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+		VkCommandBufferAllocateInfo primaryAllocateInfo = {};
+		primaryAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		primaryAllocateInfo.commandPool = frame.pool;
+		primaryAllocateInfo.commandBufferCount = 1;
+		primaryAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+		VKCheck("Could not allocate command buffers.", vkAllocateCommandBuffers(this->logicalDevice, &primaryAllocateInfo, &frame.primary));
+
+		frame.slotPools.resize(threadCount);
+		frame.secondaries.resize(threadCount);
+
+		for (unsigned i = 0; i < threadCount; i++) {
+			CreateCommandPool(frame.slotPools[i], this->queueFamilies.graphicsQF.value(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+			VkCommandBufferAllocateInfo secondaryAllocateInfo = {};
+			secondaryAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			secondaryAllocateInfo.commandPool = frame.slotPools[i];
+			secondaryAllocateInfo.commandBufferCount = 1;
+			secondaryAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+			VKCheck("Could not allocate command buffers.", vkAllocateCommandBuffers(this->logicalDevice, &secondaryAllocateInfo, &frame.secondaries[i]));
+		}
+	}
+}
+
+void Engine::DestroyFrameCommands() {
+	this->recordWorkers.Stop();
+
+	// Destroying a pool frees the command buffers allocated from it.
+	for (FrameCommands& frame : this->frameCommands) {
+		for (VkCommandPool pool : frame.slotPools) {
+			vkDestroyCommandPool(this->logicalDevice, pool, nullptr);
+		}
+
+		vkDestroyCommandPool(this->logicalDevice, frame.pool, nullptr);
+	}
+
+	this->frameCommands.clear();
+}
+
+VkCommandBuffer Engine::RecordFrame(uint32_t imageIndex) {
+	FrameCommands& frame = this->frameCommands[this->currentFrame];
+
+	// Without culling the level of detail can only change per batch, with the draws that are recorded.
+	if (this->cullMode == CullMode::Off) {
+		UpdateBatchLods();
+	}
+
+	// The frame's fence has signaled, so nothing recorded from these pools is still executing.
+	VKCheck("Could not reset command pool.", vkResetCommandPool(this->logicalDevice, frame.pool, 0));
+
+	// A single indirect draw covers the GPU-culled list.
+	size_t slotCount = std::min(this->cullMode == CullMode::GPU ? 1 : frame.slotPools.size(), this->drawList.size());
+
+	for (size_t i = 0; i < slotCount; i++) {
+		VKCheck("Could not reset command pool.", vkResetCommandPool(this->logicalDevice, frame.slotPools[i], 0));
+	}
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = this->renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = this->framebuffers[imageIndex];
+
+	// Contiguous, equally sized runs of the draw list, one per slot.
+	this->recordWorkers.Run(slotCount, [&](size_t slot) {
+		size_t firstDraw = slot * this->drawList.size() / slotCount;
+		size_t lastDraw = (slot + 1) * this->drawList.size() / slotCount;
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VKCheck("Could not begin command buffer.", vkBeginCommandBuffer(frame.secondaries[slot], &beginInfo));
+		RecordDraws(frame.secondaries[slot], imageIndex, firstDraw, lastDraw - firstDraw);
+		VKCheck("Failed to record command buffer.", vkEndCommandBuffer(frame.secondaries[slot]));
+	});
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VKCheck("Could not begin command buffer.", vkBeginCommandBuffer(frame.primary, &beginInfo));
+
+	BeginFrameRenderPass(frame.primary, imageIndex, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	if (slotCount > 0) {
+		vkCmdExecuteCommands(frame.primary, static_cast<uint32_t>(slotCount), frame.secondaries.data());
+	}
+
+	EndFrameRenderPass(frame.primary, imageIndex);
+
+	VKCheck("Failed to record command buffer.", vkEndCommandBuffer(frame.primary));
+
+	return frame.primary;
+}
+
+void Engine::CreateReadbackBuffers() {
+	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(this->swapImageSize.width) * this->swapImageSize.height * 4;
+
+	this->readbackBuffers.resize(this->MAX_CONCURRENT_FRAMES);
+	this->readbackBuffersMemory.resize(this->MAX_CONCURRENT_FRAMES);
+	this->readbackPending.resize(this->MAX_CONCURRENT_FRAMES, false);
+	this->readbackFrameNumbers.resize(this->MAX_CONCURRENT_FRAMES, 0);
+
+	for (size_t i = 0; i < this->MAX_CONCURRENT_FRAMES; i++) {
+		// Host-visible allocations stay mapped for their whole lifetime; callers read straight out of them.
+		this->readbackBuffers[i] = CreateBuffer(this->readbackBuffersMemory[i], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+	}
+}
+
+void Engine::RecordReadback(VkCommandBuffer& commandBuffer, uint32_t imageIndex) {
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = {
+		this->swapImageSize.width,
+		this->swapImageSize.height,
+		1
+	};
+
+	vkCmdCopyImageToBuffer(commandBuffer, this->swapImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->readbackBuffers[imageIndex], 1, &region);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = this->readbackBuffers[imageIndex];
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void Engine::QueryTimestampSupport() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+	uint32_t qfCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &qfCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> qfProperties(qfCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &qfCount, qfProperties.data());
+
+	uint32_t validBits = qfProperties[this->queueFamilies.graphicsQF.value()].timestampValidBits;
+
+	if (!this->GPU_TIMESTAMPS || validBits == 0) {
+		this->GPU_TIMESTAMPS = false;
+		return;
+	}
+
+	this->timestampPeriod = properties.limits.timestampPeriod;
+	this->timestampMask = validBits >= 64 ? UINT64_MAX : ((uint64_t)1 << validBits) - 1;
+}
+
+void Engine::CreateFrameQueryPool() {
+	if (!this->GPU_TIMESTAMPS) {
+		return;
+	}
+
+	// Two timestamps per swap image, bracketing its GPU culling dispatch, if any, and its render pass.
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = static_cast<uint32_t>(this->swapImages.size()) * 2;
+
+	VKCheck("Could not create frame query pool.", vkCreateQueryPool(this->logicalDevice, &queryPoolInfo, nullptr, &this->frameQueryPool));
+
+	this->frameQueriesPending.assign(this->swapImages.size(), false);
+}
+
+void Engine::BeginUploadTimestamp(UploadBatch& batch, const std::string& name) {
+	if (!this->GPU_TIMESTAMPS) {
+		return;
+	}
+
+	// A pair per operation, so a batch ends up with twice as many queries as it records copies and blits.
+	UploadTimestamp timestamp;
+	timestamp.name = name;
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2;
+
+	VKCheck("Could not create upload query pool.", vkCreateQueryPool(this->logicalDevice, &queryPoolInfo, nullptr, &timestamp.queryPool));
+
+	vkCmdResetQueryPool(batch.commandBuffer, timestamp.queryPool, 0, 2);
+	vkCmdWriteTimestamp(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp.queryPool, 0);
+
+	batch.timestamps.push_back(timestamp);
+}
+
+void Engine::EndUploadTimestamp(UploadBatch& batch) {
+	if (!this->GPU_TIMESTAMPS) {
+		return;
+	}
+
+	vkCmdWriteTimestamp(batch.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, batch.timestamps.back().queryPool, 1);
+}
+
+void Engine::ResolveUploadTimestamps(UploadBatch& batch) {
+	// The upload batch fence has already been waited on, so this never blocks.
+	for (UploadTimestamp& timestamp : batch.timestamps) {
+		ReadTimestamps(timestamp.queryPool, 0, timestamp.name);
+		vkDestroyQueryPool(this->logicalDevice, timestamp.queryPool, nullptr);
+	}
+
+	batch.timestamps.clear();
+}
+
+void Engine::CollectFrameTimestamps(uint32_t imageIndex) {
+	if (this->frameQueryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Called after the fence guarding imageIndex has signalled, right before its command buffer is resubmitted.
+	if (this->frameQueriesPending[imageIndex]) {
+		ReadTimestamps(this->frameQueryPool, imageIndex * 2, "Frame");
+	}
+
+	this->frameQueriesPending[imageIndex] = true;
+}
+
+bool Engine::ReadTimestamps(VkQueryPool queryPool, uint32_t firstQuery, const std::string& name) {
+	// Pairs of (timestamp, availability).
+	uint64_t results[4] = {};
+
+	VkResult result = vkGetQueryPoolResults(this->logicalDevice, queryPool, firstQuery, 2, sizeof(results), results, sizeof(uint64_t) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[1] == 0 || results[3] == 0) {
+		return false;
+	}
+
+	uint64_t ticks = ((results[2] & this->timestampMask) - (results[0] & this->timestampMask)) & this->timestampMask;
+	double ms = ticks * static_cast<double>(this->timestampPeriod) / 1000000.0;
+
+	TimestampStats& stats = this->timestampStats[name];
+
+	if (stats.count == 0 || ms < stats.minMs) {
+		stats.minMs = ms;
+	}
+
+	if (ms > stats.maxMs) {
+		stats.maxMs = ms;
+	}
+
+	stats.totalMs += ms;
+	stats.count++;
+
+	return true;
+}
+
+void Engine::PrintTimestampStats() {
+	if (this->timestampStats.empty()) {
+		return;
+	}
+
+	std::cout << "GPU timestamps (period " << this->timestampPeriod << " ns):" << std::endl;
+
+	for (const std::pair<const std::string, TimestampStats>& entry : this->timestampStats) {
+		const TimestampStats& stats = entry.second;
+		std::cout << "  " << entry.first << ": count " << stats.count << ", mean " << (stats.totalMs / stats.count) << " ms, min " << stats.minMs << " ms, max " << stats.maxMs << " ms, total " << stats.totalMs << " ms" << std::endl;
+	}
+}
+
+void Engine::CreateSyncObjects() {
+	this->imagesAvailableSemaphores.resize(this->MAX_CONCURRENT_FRAMES);
+	this->imagesRenderedSemaphores.resize(this->MAX_CONCURRENT_FRAMES);
+	this->inFlightFences.resize(this->MAX_CONCURRENT_FRAMES);
+	this->imagesInFlight.resize(this->swapImages.size(), VK_NULL_HANDLE);
+	this->frameInputTimes.resize(this->MAX_CONCURRENT_FRAMES);
+	this->frameLatencyPending.resize(this->MAX_CONCURRENT_FRAMES, false);
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (size_t i = 0; i < this->MAX_CONCURRENT_FRAMES; i++) {
+		VKCheck("Could not create signal sempahores.", vkCreateSemaphore(this->logicalDevice, &semaphoreCreateInfo, nullptr, &this->imagesAvailableSemaphores[i]));
+		VKCheck("Could not create wait sempahores.", vkCreateSemaphore(this->logicalDevice, &semaphoreCreateInfo, nullptr, &this->imagesRenderedSemaphores[i]));
+		VKCheck("Could not create working fences.", vkCreateFence(this->logicalDevice, &fenceCreateInfo, nullptr, &this->inFlightFences[i]));
+	}
+}
+
+bool Engine::UseAssetStreaming() {
+	return this->ASYNC_STREAMING && this->timelineSemaphores && this->queueFamilies.transferQF.has_value();
+}
+
+void Engine::CreatePlaceholderAssets(UploadBatch& batch) {
+	const uint32_t size = 64;
+	std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			uint8_t value = ((x / 8 + y / 8) % 2) ? 200 : 56;
+			uint8_t* texel = &pixels[(static_cast<size_t>(y) * size + x) * 4];
+
+			texel[0] = value;
+			texel[1] = value;
+			texel[2] = value;
+			texel[3] = 255;
+		}
+	}
+
+	MipChain chain = GenerateMipChain(pixels.data(), size, size);
+
+	VkImage image;
+	Allocation imageMemory;
+
+	this->mipLevels = static_cast<uint32_t>(chain.levels.size());
+	this->textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+	UploadTextureImage(batch, image, imageMemory, chain.data.data(), chain.data.size(), this->textureFormat, size, size, GetMipChainRegions(chain));
+
+	this->textureImages.push_back(image);
+	this->textureImagesMemory.push_back(imageMemory);
+
+	// A unit cube with one quad per face, each showing the whole checkerboard.
+	const glm::vec3 normals[] = { { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f } };
+	const glm::vec2 corners[] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+
+	for (const glm::vec3& normal : normals) {
+		glm::vec3 u = normal.x != 0.0f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		glm::vec3 v = glm::cross(normal, u);
+		uint32_t base = static_cast<uint32_t>(this->vertices.size());
+
+		for (const glm::vec2& corner : corners) {
+			Vertex vertex = {};
+			vertex.position = 0.5f * (normal + corner.x * u + corner.y * v);
+			vertex.color = glm::vec3(1.0f);
+			vertex.texCoord = 0.5f * (corner + 1.0f);
+
+			this->vertices.push_back(vertex);
+		}
+
+		for (uint32_t index : { 0u, 1u, 2u, 2u, 3u, 0u }) {
+			this->indices.push_back(base + index);
+		}
+	}
+
+	this->indexCount = static_cast<uint32_t>(this->indices.size());
+	this->modelShapes.clear();
+	this->meshLodErrors = { { 0.0f } };
+
+	glm::vec3 boundsMin, boundsMax;
+	GetVertexBounds(this->vertices.data(), this->vertices.size(), boundsMin, boundsMax);
+	this->meshBoundingSpheres = { GetBoundingSphere(boundsMin, boundsMax) };
+
+	CreateVertexBuffer(batch);
+	CreateIndicesBuffer(batch);
+
+	this->vertices.clear();
+	this->indices.clear();
+}
+
+void Engine::StreamAsset(StreamedAssetType type, const char* name) {
+	std::unique_ptr<StreamedAsset> asset = std::make_unique<StreamedAsset>();
+	asset->type = type;
+	asset->name = name;
+	asset->startTime = std::chrono::high_resolution_clock::now();
+
+	VkSemaphoreTypeCreateInfo semaphoreTypeInfo = {};
+	semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphoreTypeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &semaphoreTypeInfo;
+
+	VKCheck("Could not create timeline semaphore.", vkCreateSemaphore(this->logicalDevice, &semaphoreCreateInfo, nullptr, &asset->semaphore));
+
+	StreamedAsset& entry = *asset;
+	this->streamedAssets.push_back(std::move(asset));
+	entry.worker = std::thread(&Engine::RunStreamWorker, this, std::ref(entry));
+}
+
+void Engine::RunStreamWorker(StreamedAsset& asset) {
+	try {
+		if (asset.type == StreamedAssetType::Texture) {
+			StreamTexture(asset);
+		}
+		else {
+			StreamModel(asset);
+		}
+
+		asset.state.store(StreamState::Uploaded, std::memory_order_release);
+	}
+	catch (const std::exception& e) {
+		asset.error = e.what();
+		asset.state.store(StreamState::Failed, std::memory_order_release);
+	}
+}
+
+void Engine::StreamTexture(StreamedAsset& asset) {
+	const char* name = asset.name.c_str();
+
+	TextureCache cache;
+	MipChain chain;
+	const void* data = nullptr;
+	VkDeviceSize dataSize = 0;
+	std::vector<VkBufferImageCopy> regions;
+
+	if (this->ASSET_CACHE_DIRECTORY != nullptr && this->ASSET_CACHE_DIRECTORY[0] != '\0') {
+		VkFormat format = GetTextureCacheFormat();
+		std::string cachePath = GetTextureCachePath(this->ASSET_CACHE_DIRECTORY, name, format);
+
+		if (!cache.Open(cachePath, name)) {
+			if (BuildTextureCache(cachePath, name, format)) {
+				cache.Open(cachePath, name);
+			}
+			else {
+				std::cout << "Could not write texture cache " << cachePath << std::endl;
+			}
+		}
+
+		if (cache.IsOpen()) {
+			asset.format = cache.GetFormat();
+			asset.width = cache.GetWidth();
+			asset.height = cache.GetHeight();
+			asset.mipLevels = cache.GetMipLevels();
+			data = cache.GetData();
+			dataSize = cache.GetDataSize();
+			regions = GetTextureCacheRegions(cache);
+		}
+	}
+
+	// Transfer queues cannot blit, so uncached textures always get their mip chain from the CPU.
+	if (!cache.IsOpen()) {
+		int im_w, im_h, channels;
+		stbi_uc* pixels = stbi_load(name, &im_w, &im_h, &channels, STBI_rgb_alpha);
+
+		if (!pixels) {
+			throw std::runtime_error("Could not load image " + asset.name);
+		}
+
+		asset.width = static_cast<uint32_t>(im_w);
+		asset.height = static_cast<uint32_t>(im_h);
+
+		chain = GenerateMipChain(pixels, asset.width, asset.height, this->MIPMAP_FILTER);
+		stbi_image_free(pixels);
+
+		asset.format = VK_FORMAT_R8G8B8A8_SRGB;
+		asset.mipLevels = static_cast<uint32_t>(chain.levels.size());
+		data = chain.data.data();
+		dataSize = chain.data.size();
+		regions = GetMipChainRegions(chain);
+	}
+
+	asset.staging = AllocateStaging(data, dataSize);
+
+	for (VkBufferImageCopy& region : regions) {
+		region.bufferOffset += asset.staging.offset;
+	}
+
+	CreateImage(asset.image, asset.imageMemory, asset.width, asset.height, asset.mipLevels, VK_SAMPLE_COUNT_1_BIT, asset.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkCommandBuffer commandBuffer = BeginStreamTransfer(asset);
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = asset.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = asset.mipLevels;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	vkCmdCopyBufferToImage(commandBuffer, asset.staging.buffer, asset.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+	// The release half of the ownership transfer; SubmitAssetAcquire records the matching acquire.
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	if (asset.released) {
+		barrier.srcQueueFamilyIndex = this->queueFamilies.transferQF.value();
+		barrier.dstQueueFamilyIndex = this->queueFamilies.graphicsQF.value();
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	EndStreamTransfer(asset, commandBuffer);
+}
+
+void Engine::StreamModel(StreamedAsset& asset) {
+	const char* name = asset.name.c_str();
+
+	bool useCache = this->ASSET_CACHE_DIRECTORY != nullptr && this->ASSET_CACHE_DIRECTORY[0] != '\0';
+	std::string cachePath = useCache ? GetMeshCachePath(this->ASSET_CACHE_DIRECTORY, name) : "";
+
+	MeshCache cache;
+	ObjMesh mesh;
+	const Vertex* vertices = nullptr;
+	const uint32_t* indices = nullptr;
+
+	if (useCache && cache.Open(cachePath, name, this->OPTIMIZE_MESHES, this->LOD_LEVELS)) {
+		vertices = cache.GetVertices();
+		indices = cache.GetIndices();
+		asset.vertexCount = cache.GetVertexCount();
+		asset.indexCount = cache.GetIndexCount();
+		asset.shapes = cache.GetShapes();
+		asset.lodErrors = cache.GetLodErrors();
+
+		glm::vec3 boundsMin, boundsMax;
+		cache.GetBounds(boundsMin, boundsMax);
+		asset.boundingSphere = GetBoundingSphere(boundsMin, boundsMax);
+	}
+	else {
+		mesh = LoadObjParallel(name);
+
+		if (this->LOD_LEVELS > 1) {
+			BuildLoadedMeshLods(mesh, name, this->LOD_LEVELS);
+		}
+
+		if (this->OPTIMIZE_MESHES) {
+			OptimizeLoadedMesh(mesh, name);
+		}
+
+		if (useCache && !WriteMeshCache(cachePath, name, mesh, this->OPTIMIZE_MESHES, this->LOD_LEVELS)) {
+			std::cout << "Could not write mesh cache " << cachePath << std::endl;
+		}
+
+		vertices = mesh.vertices.data();
+		indices = mesh.indices.data();
+		asset.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		asset.indexCount = static_cast<uint32_t>(mesh.indices.size());
+		asset.shapes = mesh.shapes;
+		asset.lodErrors = mesh.lodErrors;
+
+		glm::vec3 boundsMin, boundsMax;
+		GetVertexBounds(mesh.vertices.data(), mesh.vertices.size(), boundsMin, boundsMax);
+		asset.boundingSphere = GetBoundingSphere(boundsMin, boundsMax);
+	}
+
+	PackedIndices packedIndices = PackIndices(indices, asset.indexCount, asset.vertexCount, asset.shapes, this->SIXTEEN_BIT_INDICES);
+	asset.indexChunks = std::move(packedIndices.chunks);
+	asset.indexType = packedIndices.indices16.empty() ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+
+	const void* indexData = packedIndices.indices16.empty() ? static_cast<const void*>(indices) : packedIndices.indices16.data();
+
+	VkDeviceSize vertexBufferSize = GetPackedVertexSize(asset.vertexCount);
+	VkDeviceSize indicesBufferSize = (packedIndices.indices16.empty() ? sizeof(uint32_t) : sizeof(uint16_t)) * asset.indexCount;
+
+	if (this->DIRECT_GEOMETRY_UPLOAD && this->deviceLocalHostVisible) {
+		asset.vertexBuffer = CreateBuffer(asset.vertexMemory, vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		asset.indicesBuffer = CreateBuffer(asset.indicesMemory, indicesBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		PackVertices(vertices, asset.vertexCount, asset.quantization, asset.vertexMemory.mapped);
+		memcpy(asset.indicesMemory.mapped, indexData, static_cast<size_t>(indicesBufferSize));
+
+		// Nothing is copied on the GPU, so the host marks the upload as done.
+		VkSemaphoreSignalInfo signalInfo = {};
+		signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+		signalInfo.semaphore = asset.semaphore;
+		signalInfo.value = 1;
+
+		VKCheck("Could not signal timeline semaphore.", vkSignalSemaphore(this->logicalDevice, &signalInfo));
+		return;
+	}
+
+	// Vertices and indices share one staging buffer and one submission.
+	asset.staging = AllocateStaging(nullptr, vertexBufferSize + indicesBufferSize);
+	PackVertices(vertices, asset.vertexCount, asset.quantization, asset.staging.mapped);
+	memcpy(static_cast<uint8_t*>(asset.staging.mapped) + vertexBufferSize, indexData, static_cast<size_t>(indicesBufferSize));
+
+	asset.vertexBuffer = CreateBuffer(asset.vertexMemory, vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	asset.indicesBuffer = CreateBuffer(asset.indicesMemory, indicesBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkCommandBuffer commandBuffer = BeginStreamTransfer(asset);
+
+	VkBufferCopy vertexCopy = {};
+	vertexCopy.srcOffset = asset.staging.offset;
+	vertexCopy.size = vertexBufferSize;
+
+	VkBufferCopy indicesCopy = {};
+	indicesCopy.srcOffset = asset.staging.offset + vertexBufferSize;
+	indicesCopy.size = indicesBufferSize;
+
+	vkCmdCopyBuffer(commandBuffer, asset.staging.buffer, asset.vertexBuffer, 1, &vertexCopy);
+	vkCmdCopyBuffer(commandBuffer, asset.staging.buffer, asset.indicesBuffer, 1, &indicesCopy);
+
+	if (asset.released) {
+		std::vector<VkBufferMemoryBarrier> barriers(2);
+
+		for (VkBufferMemoryBarrier& barrier : barriers) {
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = this->queueFamilies.transferQF.value();
+			barrier.dstQueueFamilyIndex = this->queueFamilies.graphicsQF.value();
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+		}
+
+		barriers[0].buffer = asset.vertexBuffer;
+		barriers[1].buffer = asset.indicesBuffer;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+	}
+
+	EndStreamTransfer(asset, commandBuffer);
+}
+
+VkCommandBuffer Engine::BeginStreamTransfer(StreamedAsset& asset) {
+	// Command pools are externally synchronized, so every worker records into a pool of its own.
+	CreateCommandPool(asset.transferPool, this->queueFamilies.transferQF.value());
+
+	VkCommandBuffer commandBuffer;
+	BeginSingleTimeCommands(commandBuffer, asset.transferPool);
+
+	// A second queue of the graphics family needs no ownership transfer, only the semaphore.
+	asset.released = this->queueFamilies.transferQF.value() != this->queueFamilies.graphicsQF.value();
+
+	return commandBuffer;
+}
+
+void Engine::EndStreamTransfer(StreamedAsset& asset, VkCommandBuffer commandBuffer) {
+	VKCheck("Could not record transfer command buffer.", vkEndCommandBuffer(commandBuffer));
+
+	uint64_t signalValue = 1;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &asset.semaphore;
+
+	std::lock_guard<std::mutex> lock(this->transferQueueMutex);
+	VKCheck("Could not submit transfer.", vkQueueSubmit(this->transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+	this->stagingRing.Submitted(asset.staging, asset.semaphore, 1);
+}
+
+void Engine::SubmitAssetAcquire(StreamedAsset& asset) {
+	BeginSingleTimeCommands(asset.acquireCommandBuffer, this->commandPool);
+
+	if (asset.released && asset.type == StreamedAssetType::Texture) {
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image = asset.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.subresourceRange.levelCount = asset.mipLevels;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcQueueFamilyIndex = this->queueFamilies.transferQF.value();
+		barrier.dstQueueFamilyIndex = this->queueFamilies.graphicsQF.value();
+
+		vkCmdPipelineBarrier(asset.acquireCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	else if (asset.released) {
+		std::vector<VkBufferMemoryBarrier> barriers(2);
+
+		for (VkBufferMemoryBarrier& barrier : barriers) {
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+			barrier.srcQueueFamilyIndex = this->queueFamilies.transferQF.value();
+			barrier.dstQueueFamilyIndex = this->queueFamilies.graphicsQF.value();
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+		}
+
+		barriers[0].buffer = asset.vertexBuffer;
+		barriers[1].buffer = asset.indicesBuffer;
+
+		vkCmdPipelineBarrier(asset.acquireCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+	}
+
+	VKCheck("Could not record acquire command buffer.", vkEndCommandBuffer(asset.acquireCommandBuffer));
+
+	// Waits for the upload (1) and marks the resources as usable by the graphics queue (2).
+	uint64_t waitValue = 1;
+	uint64_t signalValue = 2;
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = 1;
+	timelineInfo.pWaitSemaphoreValues = &waitValue;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &asset.acquireCommandBuffer;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &asset.semaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &asset.semaphore;
+
+	VKCheck("Could not submit acquire.", vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+	asset.state.store(StreamState::Acquiring, std::memory_order_relaxed);
+}
+
+void Engine::MakeAssetResident(StreamedAsset& asset) {
+	if (asset.type == StreamedAssetType::Texture) {
+		vkDestroyImage(this->logicalDevice, this->textureImages[0], nullptr);
+		this->allocator.Free(this->textureImagesMemory[0]);
+
+		this->textureImages[0] = asset.image;
+		this->textureImagesMemory[0] = asset.imageMemory;
+		this->mipLevels = asset.mipLevels;
+		this->textureFormat = asset.format;
+
+		asset.image = VK_NULL_HANDLE;
+		asset.imageMemory = {};
+
+		std::cout << "Streamed texture " << asset.name << " (" << asset.width << "x" << asset.height << ", " << asset.mipLevels << " levels) in " << ElapsedMs(asset.startTime) << " ms" << std::endl;
+		return;
+	}
+
+	vkDestroyBuffer(this->logicalDevice, this->vertexBuffer, nullptr);
+	this->allocator.Free(this->vertexMemory);
+	vkDestroyBuffer(this->logicalDevice, this->indicesBuffer, nullptr);
+	this->allocator.Free(this->indicesMemory);
+
+	this->vertexBuffer = asset.vertexBuffer;
+	this->vertexMemory = asset.vertexMemory;
+	this->indicesBuffer = asset.indicesBuffer;
+	this->indicesMemory = asset.indicesMemory;
+	this->indexCount = asset.indexCount;
+	this->modelShapes = std::move(asset.shapes);
+	this->meshBoundingSpheres = { asset.boundingSphere };
+	this->meshLodErrors = { std::move(asset.lodErrors) };
+	this->vertexQuantization = asset.quantization;
+	this->indexType = asset.indexType;
+	this->indexChunks = std::move(asset.indexChunks);
+
+	asset.vertexBuffer = VK_NULL_HANDLE;
+	asset.vertexMemory = {};
+	asset.indicesBuffer = VK_NULL_HANDLE;
+	asset.indicesMemory = {};
+
+	std::cout << "Streamed model " << asset.name << " (" << asset.vertexCount << " vertices, " << (asset.indexCount / 3) << " triangles) in " << ElapsedMs(asset.startTime) << " ms" << std::endl;
+}
+
+void Engine::DestroyStreamedAsset(StreamedAsset& asset) {
+	ReleaseStaging(asset.staging);
+	vkDestroyImage(this->logicalDevice, asset.image, nullptr);
+	this->allocator.Free(asset.imageMemory);
+	vkDestroyBuffer(this->logicalDevice, asset.vertexBuffer, nullptr);
+	this->allocator.Free(asset.vertexMemory);
+	vkDestroyBuffer(this->logicalDevice, asset.indicesBuffer, nullptr);
+	this->allocator.Free(asset.indicesMemory);
+
+	if (asset.acquireCommandBuffer != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(this->logicalDevice, this->commandPool, 1, &asset.acquireCommandBuffer);
+	}
+
+	vkDestroyCommandPool(this->logicalDevice, asset.transferPool, nullptr);
+	vkDestroySemaphore(this->logicalDevice, asset.semaphore, nullptr);
+}
+
+void Engine::PollAssetStreaming(bool wait) {
+	std::vector<StreamedAsset*> ready;
+	std::vector<StreamedAsset*> finished;
+
+	for (std::unique_ptr<StreamedAsset>& asset : this->streamedAssets) {
+		if (!wait && asset->state.load(std::memory_order_acquire) == StreamState::Loading) {
+			continue;
+		}
+
+		if (asset->worker.joinable()) {
+			asset->worker.join();
+		}
+
+		StreamState state = asset->state.load(std::memory_order_acquire);
+
+		if (state == StreamState::Failed) {
+			std::cout << "Could not stream " << asset->name << ": " << asset->error << std::endl;
+			finished.push_back(asset.get());
+			continue;
+		}
+
+		if (state == StreamState::Uploaded) {
+			SubmitAssetAcquire(*asset);
+		}
+
+		if (wait) {
+			uint64_t waitValue = 2;
+
+			VkSemaphoreWaitInfo waitInfo = {};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &asset->semaphore;
+			waitInfo.pValues = &waitValue;
+
+			VKCheck("Could not wait for timeline semaphore.", vkWaitSemaphores(this->logicalDevice, &waitInfo, UINT64_MAX));
+		}
+
+		uint64_t value = 0;
+		VKCheck("Could not read timeline semaphore.", vkGetSemaphoreCounterValue(this->logicalDevice, asset->semaphore, &value));
+
+		if (value >= 2) {
+			ready.push_back(asset.get());
+			finished.push_back(asset.get());
+		}
+	}
+
+	if (!ready.empty()) {
+		// Frames in flight and the pre-recorded command buffers still reference the placeholder.
+		vkWaitForFences(this->logicalDevice, static_cast<uint32_t>(this->inFlightFences.size()), this->inFlightFences.data(), VK_TRUE, UINT64_MAX);
+
+		DestroyTextureImageViews();
+
+		for (StreamedAsset* asset : ready) {
+			MakeAssetResident(*asset);
+		}
+
+		CreateTextureImageViews(this->mipLevels);
+		WriteDescriptorSet();
+		BuildDrawList();
+		RecreateCullingResources();
+
+		DestroyCommandBuffers();
+		CreateCommandBuffers();
+	}
+
+	for (StreamedAsset* asset : finished) {
+		DestroyStreamedAsset(*asset);
+	}
+
+	this->streamedAssets.erase(std::remove_if(this->streamedAssets.begin(), this->streamedAssets.end(), [&finished](const std::unique_ptr<StreamedAsset>& asset) {
+		return std::find(finished.begin(), finished.end(), asset.get()) != finished.end();
+	}), this->streamedAssets.end());
+}
+
+void Engine::FinishAssetStreaming() {
+	while (!this->streamedAssets.empty()) {
+		PollAssetStreaming(true);
+	}
+}
+
+void Engine::CancelAssetStreaming() {
+	if (this->streamedAssets.empty()) {
+		return;
+	}
+
+	for (std::unique_ptr<StreamedAsset>& asset : this->streamedAssets) {
+		if (asset->worker.joinable()) {
+			asset->worker.join();
+		}
+	}
+
+	vkDeviceWaitIdle(this->logicalDevice);
+
+	for (std::unique_ptr<StreamedAsset>& asset : this->streamedAssets) {
+		DestroyStreamedAsset(*asset);
+	}
+
+	this->streamedAssets.clear();
+}
@@ -1,14 +1,14 @@
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
-#define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/glm.hpp>
+#define NOMINMAX
+#endif
+#include "VertexLayout.h"
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/hash.hpp>
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #include <GLFW/glfw3native.h>
-#include <vulkan/vulkan.h>
 #include <vulkan/vulkan_win32.h>
+#endif
 #include <iostream>
 #include <vector>
 #include <assert.h>
@@ -18,6 +18,28 @@
 #include <stdexcept>
 #include <chrono>
 #include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include "Benchmark.h"
+#include "Allocator.h"
+#include "StagingRing.h"
+#include "ObjLoader.h"
+#include "VertexWeld.h"
+#include "MeshCache.h"
+#include "TextureCache.h"
+#include "MipGenerator.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "IndexPacking.h"
+#include "Parallel.h"
+#include "Scene.h"
+#include "FramePacer.h"
 
 #pragma once
 
@@ -26,6 +48,9 @@ struct QueueFamilies {
 
 	std::optional<uint32_t> graphicsQF = {};
 	std::optional<uint32_t> presentationQF = {};
+	// Background uploads: a transfer-only family if there is one, otherwise an async compute family or a second graphics queue.
+	std::optional<uint32_t> transferQF = {};
+	uint32_t transferQueueIndex = 0;
 
 	bool isComplete() {
 		return graphicsQF.has_value() && presentationQF.has_value();
@@ -42,56 +67,154 @@ struct SwapchainDetails {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
-struct UniformBufferObject {
-	alignas(16) glm::mat4 model;
-	alignas(16) glm::mat4 view;
-	alignas(16) glm::mat4 projection;
+// A resolved offscreen frame. pixels points into persistently mapped memory and is only valid for the duration of the readback callback.
+struct ReadbackFrame {
+	const void* pixels = nullptr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint64_t frameNumber = 0;
 };
 
-struct Vertex {
-	glm::vec3 position;
-	glm::vec3 color;
-	glm::vec2 texCoord;
+struct TimestampStats {
+	uint32_t count = 0;
+	double totalMs = 0.0;
+	double minMs = 0.0;
+	double maxMs = 0.0;
+};
 
-	static VkVertexInputBindingDescription GetBindingDescription() {
-		VkVertexInputBindingDescription inputBindingDescription = {};
-		inputBindingDescription.binding = 0;
-		inputBindingDescription.stride = sizeof(Vertex);
-		inputBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+enum class StreamedAssetType {
+	Texture,
+	Model,
+};
 
-		return inputBindingDescription;
-	}
+enum class StreamState {
+	// A worker thread is decoding the asset and submitting its upload to the transfer queue.
+	Loading,
+	// The upload signals the asset's timeline semaphore with 1 once it completes.
+	Uploaded,
+	// The graphics queue acquires the resources after the upload and signals 2.
+	Acquiring,
+	Failed,
+};
 
-	static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions() {
-		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(3);
+// A texture or model loaded in the background while the placeholder is drawn. Only the resources of its type are used.
+struct StreamedAsset {
+	StreamedAssetType type = StreamedAssetType::Texture;
+	std::string name;
+	std::chrono::high_resolution_clock::time_point startTime;
+	std::thread worker;
+	std::atomic<StreamState> state{ StreamState::Loading };
+	std::string error;
+
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	VkCommandPool transferPool = VK_NULL_HANDLE;
+	VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+	// Set when the upload released the resources from the transfer family, so the graphics family has to acquire them.
+	bool released = false;
+
+	StagingRegion staging = {};
+
+	VkImage image = VK_NULL_HANDLE;
+	Allocation imageMemory = {};
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t mipLevels = 0;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indicesBuffer = VK_NULL_HANDLE;
+	Allocation vertexMemory = {};
+	Allocation indicesMemory = {};
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	VertexQuantization quantization = {};
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	std::vector<IndexChunk> indexChunks = {};
+	std::vector<ObjShape> shapes = {};
+	std::vector<float> lodErrors = {};
+	glm::vec4 boundingSphere = {};
+};
 
-		attributeDescriptions[0].binding = 0;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, position);
+// A begin/end timestamp pair around one copy or blit recorded into an upload batch.
+struct UploadTimestamp {
+	std::string name = "";
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+};
 
-		attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+// Transitions, copies and blits for any number of uploads, recorded into one command buffer and submitted once.
+// The staging regions and timestamp queries are kept until the fence signals.
+struct UploadBatch {
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	std::vector<StagingRegion> staging = {};
+	VkDeviceSize stagingBytes = 0;
+	std::vector<UploadTimestamp> timestamps = {};
+};
 
-		attributeDescriptions[2].binding = 0;
-		attributeDescriptions[2].location = 2;
-		attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+// A range of the index buffer drawn with one vkCmdDrawIndexed, for a run of the instance buffer.
+struct DrawCommand {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	int32_t vertexOffset = 0;
+	uint32_t firstInstance = 0;
+	uint32_t instanceCount = 1;
+	// Index into instanceBatches.
+	uint32_t batch = 0;
+	// Level of detail the index range belongs to.
+	uint32_t lod = 0;
+};
 
-		return attributeDescriptions;
-	}
+enum class CullMode {
+	// Every instance is drawn with direct draws.
+	Off,
+	// The CPU culls into host-visible instance and indirect draw buffers.
+	CPU,
+	// A compute pass culls and writes the indirect draws and their count.
+	GPU,
+};
 
-	bool operator==(const Vertex& other) const {
-		return this->position == other.position && this->texCoord == other.texCoord && this->color == other.color;
-	}
+// Layouts read by shaders/cull.comp.
+struct CullBatch {
+	glm::vec4 boundingSphere;
+	uint32_t firstInstance = 0;
+	uint32_t instanceCount = 0;
+	uint32_t lodCount = 1;
+	uint32_t padding = 0;
+	float lodErrors[MAX_LOD_LEVELS] = {};
 };
 
-template<> struct std::hash<Vertex> {
-	size_t operator()(Vertex const& vertex) const {
-		return ((std::hash<glm::vec3>()(vertex.position) ^ (std::hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (std::hash<glm::vec2>()(vertex.texCoord) << 1);
-	}
+struct CullDraw {
+	uint32_t indexCount = 0;
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+	uint32_t batch = 0;
+	uint32_t lod = 0;
+};
+
+struct CullPushConstants {
+	uint32_t pass = 0;
+	uint32_t instanceCount = 0;
+	uint32_t drawCount = 0;
+	uint32_t batchCount = 0;
+	uint32_t lodCount = 1;
+	float lodScale = 0.0f;
+};
+
+// Command buffers recorded every frame for one in-flight frame. Each recording slot has a pool of its own, so
+// workers never share a pool, and all of them are reset once the frame's fence has signaled.
+struct FrameCommands {
+	VkCommandPool pool = VK_NULL_HANDLE;
+	VkCommandBuffer primary = VK_NULL_HANDLE;
+	std::vector<VkCommandPool> slotPools = {};
+	std::vector<VkCommandBuffer> secondaries = {};
+};
+
+struct UniformBufferObject {
+	alignas(16) glm::mat4 model;
+	alignas(16) glm::mat4 view;
+	alignas(16) glm::mat4 projection;
+	VertexQuantization quantization;
 };
 
 class Engine
@@ -99,10 +222,9 @@ class Engine
 private:
 	const char* TITLE = "V-Renderer";
 
-	const uint32_t MAX_CONCURRENT_FRAMES = 2;
-
 	const std::vector<const char*> debugLayers = { "VK_LAYER_KHRONOS_validation" };
 	const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	const std::vector<const char*> headlessDeviceExtensions = {};
 
 	GLFWwindow* window = nullptr;
 
@@ -111,6 +233,7 @@ private:
 	VkPhysicalDevice physicalDevice = 0;
 	VkQueue graphicsQueue = 0;
 	VkQueue presentationQueue = 0;
+	VkQueue transferQueue = 0;
 	VkDevice logicalDevice = 0;
 	VkSwapchainKHR swapchain = 0;
 	VkRenderPass renderPass = 0;
@@ -119,9 +242,13 @@ private:
 	VkDescriptorSetLayout descriptorSetLayout = 0;
 	VkBuffer vertexBuffer = 0;
 	VkBuffer indicesBuffer = 0;
-	VkDeviceMemory vertexMemory = 0;
-	VkDeviceMemory indicesMemory = 0;
-	VkCommandPool copyPool = 0;
+	Allocation vertexMemory = {};
+	Allocation indicesMemory = {};
+	// Unpacks the GpuVertex attributes in the current vertex buffer.
+	VertexQuantization vertexQuantization = {};
+	// Set when GpuVertex's shader variant is missing; vertices are then uploaded and drawn as FullVertex.
+	bool fullPrecisionVertices = false;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 	VkCommandPool commandPool = 0;
 
 	std::vector<VkSemaphore> imagesAvailableSemaphores = {};
@@ -143,36 +270,153 @@ private:
 	std::vector<VkFramebuffer> framebuffers = {};
 	std::vector<VkCommandBuffer> commandBuffers = {};
 
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
+	// Used instead of commandBuffers when RECORD_EVERY_FRAME is set.
+	std::vector<FrameCommands> frameCommands = {};
+	WorkerPool recordWorkers;
+
+	// Everything drawn each frame: every index chunk of the model for every instance batch.
+	std::vector<DrawCommand> drawList = {};
+	std::vector<ObjShape> modelShapes = {};
+	// The model's shapes, split where their 16-bit indices need a new base vertex.
+	std::vector<IndexChunk> indexChunks = {};
+
+	// The scene's transforms in batch order, read through vertex binding 1 when nothing is culled.
+	std::vector<InstanceBatch> instanceBatches = {};
+	std::vector<glm::mat4> instanceTransforms = {};
+	VkBuffer instanceBuffer = 0;
+	Allocation instanceMemory = {};
+	// Indexed by mesh id.
+	std::vector<glm::vec4> meshBoundingSpheres = {};
+	std::vector<std::vector<float>> meshLodErrors = {};
+	// Levels of detail in modelShapes, each level holding the same number of shapes.
+	uint32_t lodLevelCount = 1;
+	// The level every batch is drawn at when nothing is culled.
+	std::vector<uint32_t> batchLods = {};
+
+	// CULL_MODE once the device's support is known.
+	CullMode cullMode = CullMode::Off;
+	bool graphicsCompute = false;
+	bool multiDrawIndirect = false;
+	bool drawIndirectFirstInstance = false;
+	bool drawIndirectCount = false;
+
+	// Culling inputs, rebuilt with the draw list.
+	VkBuffer cullBatchBuffer = 0;
+	Allocation cullBatchMemory = {};
+	VkBuffer cullDrawBuffer = 0;
+	Allocation cullDrawMemory = {};
+
+	// One slice per swap image, like the uniform buffer: the visible instances in batch order for every level of
+	// detail in turn, and the draw count, per-level per-batch counters and indirect draws. Host-visible for CPU
+	// culling, device-local for GPU culling.
+	VkBuffer culledInstanceBuffer = 0;
+	Allocation culledInstanceMemory = {};
+	VkDeviceSize culledInstanceStride = 0;
+	VkBuffer indirectBuffer = 0;
+	Allocation indirectMemory = {};
+	VkDeviceSize indirectStride = 0;
+	VkDeviceSize indirectCountersSize = 0;
+	VkDeviceSize indirectCommandsOffset = 0;
+
+	VkDescriptorSetLayout cullDescriptorSetLayout = 0;
+	VkPipelineLayout cullPipelineLayout = 0;
+	VkPipeline cullPipeline = 0;
+	VkDescriptorPool cullDescriptorPool = 0;
+	VkDescriptorSet cullDescriptorSet = 0;
+
+	// The matrices last written to the uniform buffer, for CPU culling.
+	UniformBufferObject frameUBO = {};
+
+	// One persistently mapped slice per swap image, each aligned to minUniformBufferOffsetAlignment and selected with a dynamic offset.
+	VkBuffer uniformBuffer = 0;
+	Allocation uniformBufferMemory = {};
+	VkDeviceSize uniformBufferStride = 0;
 
 	VkDescriptorPool descriptorPool = 0;
 
-	std::vector<VkDescriptorSet> descriptorSets;
+	VkDescriptorSet descriptorSet = 0;
 
 	VkSampler sampler = 0;
 
 	std::vector<VkImage> textureImages = {};
 	std::vector<VkImageView> textureImageViews = {};
-	std::vector<VkDeviceMemory> textureImagesMemory = {};
+	std::vector<Allocation> textureImagesMemory = {};
 
 	VkImage depthImage;
 	VkImageView depthImageView;
-	VkDeviceMemory depthImageMemory;
+	Allocation depthImageMemory;
 
 	uint32_t mipLevels;
+	VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	bool textureCompressionBC = false;
 
 	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
 	VkImage colorImage;
 	VkImageView colorImageView;
-	VkDeviceMemory colorImageMemory;
+	Allocation colorImageMemory;
+
+	// Engine-owned render targets that replace the swapchain images in headless mode.
+	std::vector<Allocation> offscreenImagesMemory = {};
+
+	// One host-visible readback buffer per in-flight frame, guarded by inFlightFences.
+	std::vector<VkBuffer> readbackBuffers = {};
+	std::vector<Allocation> readbackBuffersMemory = {};
+	std::vector<bool> readbackPending = {};
+	std::vector<uint64_t> readbackFrameNumbers = {};
+
+	uint64_t frameNumber = 0;
+
+	MemoryAllocator allocator;
+
+	// Every upload path takes its staging memory from here, falling back to dedicated buffers when it is full.
+	StagingRing stagingRing;
+	VkBuffer stagingRingBuffer = 0;
+	Allocation stagingRingMemory = {};
+
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	// Mapped from CreateModel until the geometry buffers have been filled from it.
+	MeshCache meshCache;
+
+	// Assets still being streamed in. Worker threads only touch their own entry and submit to transferQueue under the mutex.
+	std::vector<std::unique_ptr<StreamedAsset>> streamedAssets = {};
+	std::mutex transferQueueMutex;
+	bool timelineSemaphores = false;
+
+	// Set when a large device-local heap is also host-visible (resizable BAR or unified memory).
+	bool deviceLocalHostVisible = false;
+
+	FrameTiming frameTiming = {};
+	std::vector<double> resizeTimings = {};
+
+	FramePacer framePacer;
+	// When every in-flight frame started, right after its input was polled, and whether its latency is still to be
+	// taken once its fence signals.
+	std::vector<std::chrono::high_resolution_clock::time_point> frameInputTimes = {};
+	std::vector<bool> frameLatencyPending = {};
+	// The present mode the swapchain was created with, which is PRESENT_MODE when the surface supports it.
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+	// GPU timestamp queries. frameQueryPool holds a begin/end pair per command buffer, around culling and the render pass. Uploads keep theirs in the batch.
+	VkQueryPool frameQueryPool = VK_NULL_HANDLE;
+	std::vector<bool> frameQueriesPending = {};
+	float timestampPeriod = 1.0f;
+	uint64_t timestampMask = UINT64_MAX;
+	std::map<std::string, TimestampStats> timestampStats = {};
 public:
 	size_t WIN_W = 800;
 	size_t WIN_H = 600;
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
+	uint32_t indexCount = 0;
+
+	// Objects to draw. Mesh 0 is the loaded model and material 0 its texture; objects with other ids are not drawn yet.
+	// Left empty, it is filled with a grid of SCENE_INSTANCES copies of the model SCENE_SPACING apart.
+	Scene scene;
+	size_t SCENE_INSTANCES = 1;
+	float SCENE_SPACING = 2.5f;
 
 	float FOV = 45.0f;
 	float NEAREST = 0.1f;
@@ -185,9 +429,76 @@ public:
 
 	const char* MODEL_PATH = "models/chalet.obj";
 	const char* TEXTURE_PATH = "textures/chalet.jpg";
+	const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+	// Binary copies of loaded models and textures (with their mip chains), mapped instead of re-decoding the source
+	// while it is unchanged. Empty disables both caches.
+	const char* ASSET_CACHE_DIRECTORY = "cache";
+	// Store cached textures as BC1 when the device can sample it.
+	bool TEXTURE_COMPRESSION = true;
+	// Build uncached mip chains on the CPU instead of blitting. Always done when the format can't be blitted or the device is a software rasterizer.
+	bool CPU_MIPMAPS = false;
+	MipFilter MIPMAP_FILTER = MipFilter::Box;
+	// Reorder uncached models for the post-transform cache, overdraw and vertex fetch before they are cached and uploaded.
+	bool OPTIMIZE_MESHES = true;
+	// Upload 16-bit indices, rebased per chunk of at most 65536 vertices, whenever the model allows it.
+	bool SIXTEEN_BIT_INDICES = true;
+	// Levels of detail generated for uncached models, each with about half the triangles of the one before. 1 draws the full model only.
+	uint32_t LOD_LEVELS = 6;
+	// Every instance is drawn at the coarsest level whose geometric error projects to at most this many pixels.
+	float LOD_ERROR_PIXELS = 1.0f;
 
 	bool resizeTriggered = false;
 
+	// Renders into offscreen images without a window, surface or swapchain.
+	bool HEADLESS = false;
+	size_t HEADLESS_FRAMES = 1000;
+
+	// Called once per headless frame after its fence signals. Must be set before Load; frames are only copied back when it is.
+	std::function<void(const ReadbackFrame&)> readbackCallback;
+
+	// Runs a fixed number of frames (or a fixed duration when BENCHMARK_SECONDS > 0) with a fixed camera and reports frame time statistics.
+	bool BENCHMARK = false;
+	size_t BENCHMARK_FRAMES = 1000;
+	size_t BENCHMARK_WARMUP_FRAMES = 10;
+	double BENCHMARK_SECONDS = 0.0;
+	std::string BENCHMARK_OUTPUT = "";
+	// Number of window resizes spread over a windowed benchmark run, to measure swapchain recreation latency.
+	size_t BENCHMARK_RESIZES = 0;
+
+	bool GPU_TIMESTAMPS = true;
+
+	// Write geometry straight into device-local host-visible memory instead of staging it, when available.
+	bool DIRECT_GEOMETRY_UPLOAD = true;
+
+	// Size of the persistently mapped staging ring. 0 gives every upload a dedicated staging buffer instead.
+	VkDeviceSize STAGING_RING_SIZE = 64ull * 1024 * 1024;
+
+	// Load the texture and model on worker threads and upload them on the transfer queue, drawing a placeholder until
+	// they are resident. Needs timeline semaphores and a queue besides the graphics queue; otherwise loading is synchronous.
+	bool ASYNC_STREAMING = true;
+
+	// Record the frame's commands every frame, with the draw list split over worker threads that each record a
+	// secondary command buffer, instead of replaying one pre-recorded command buffer per swap image.
+	bool RECORD_EVERY_FRAME = true;
+	// Recording threads including the main thread; 0 uses all hardware threads.
+	unsigned RECORD_THREADS = 0;
+	// Frustum culling of the scene's instances. GPU falls back to CPU culling when the device lacks drawIndirectCount, multiDrawIndirect or compute on the graphics
+	// queue, or shaders/cull.spv is missing, and to Off without drawIndirectFirstInstance.
+	CullMode CULL_MODE = CullMode::GPU;
+	// Runs the benchmark once per culling mode instead.
+	bool BENCHMARK_CULLING = false;
+	// Split the model's shapes into draws of at most this many triangles; 0 draws every shape whole.
+	uint32_t DRAW_SPLIT_TRIANGLES = 0;
+
+	// Frames the CPU may get ahead of the GPU, 1 to 4, fixed at Load. Fewer frames lower the input latency, more
+	// absorb uneven frame times.
+	uint32_t MAX_CONCURRENT_FRAMES = 2;
+	// Falls back to FIFO, which every surface supports. MAILBOX and IMMEDIATE don't wait for vertical blank; FIFO_RELAXED
+	// only tears when a frame is late. P cycles through the modes while running.
+	VkPresentModeKHR PRESENT_MODE = VK_PRESENT_MODE_MAILBOX_KHR;
+	// Caps the frame rate of the windowed and benchmark loops; 0 renders as fast as presentation allows.
+	double FPS_LIMIT = 0.0;
+
 	Engine();
 	~Engine();
 
@@ -195,14 +506,24 @@ public:
 
 	void Load();
 	void Start();
+	void RunBenchmark();
 	void Render();
-	void UpdateUniformBuffers(uint32_t currentImage);
+	void RenderOffscreen();
+	// Takes the latency of every frame whose fence has signaled since the last call.
+	void CollectFrameLatencies();
+	void DeliverReadback(size_t frame);
+	void FlushReadbacks();
+	void UpdateUniformBuffer(uint32_t currentImage);
 	void RecreateSwapchain();
 	void CloseSwapchain();
 	void Close();
 
+	void DestroySizeDependentResources();
+	void DestroyUniformBuffer();
 	void DestroyFramebuffers();
 	void DestroySwapImageViews();
+	void DestroyOffscreenImages();
+	void DestroyReadbackBuffers();
 	void DestroyTextureImageViews();
 	void DestroySyncObjects();
 
@@ -212,14 +533,16 @@ public:
 	std::vector<char> ReadFile(const std::string& fileName);
 
 	VkShaderModule CreateShaderModule(const std::vector<char>& byteCode);
-	VkBuffer CreateBuffer(VkDeviceMemory& bufferMemory, VkDeviceSize& size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlagBits);
+	VkBuffer CreateBuffer(Allocation& bufferMemory, VkDeviceSize& size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlagBits, VkMemoryPropertyFlags preferredPropertyFlagBits = 0);
 
 	VkSurfaceFormatKHR GetSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats);
 	VkPresentModeKHR GetSurfacePresentMode(const std::vector<VkPresentModeKHR>& presentModes);
+	void CyclePresentMode();
 	VkExtent2D GetSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, size_t& WIN_W, size_t& WIN_H);
 	VkFormat GetSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkSampleCountFlagBits GetMSAASupport();
-	uint32_t GetMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	uint32_t GetMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties = 0);
+	bool HasDeviceLocalHostVisibleMemory();
 	void GetQueueFamilies();
 	void GetSwapImages(VkSwapchainKHR& swapchain, std::vector<VkImage>& swapImages);
 	void GetSwapchainDetails(VkPhysicalDevice& physicalDevice, SwapchainDetails& details);
@@ -235,29 +558,110 @@ public:
 	void CreatePhysicalDevice();
 	void CreateLogicalDevice();
 	void CreateSwapchain(VkSwapchainKHR& swapchain, size_t& WIN_W, size_t& WIN_H);
+	void CreateOffscreenImages();
 	void CreateImageViews();
 	void CreateRenderPass();
 	void CreateDescriptorSetLayout();
+	void CreatePipelineCache();
+	void SavePipelineCache();
+	void ResolveVertexLayout();
 	void CreateGraphicsPipeline();
 	void CreateFramebuffers();
-	void CreateCommandPool(VkCommandPool& commandPool, uint32_t& familyIndex);
+	void CreateCommandPool(VkCommandPool& commandPool, uint32_t& familyIndex, VkCommandPoolCreateFlags flags = 0);
 	bool hasStencil(VkFormat format);
 	void CreateDepthResources();
 	void CreateDepthImageView(VkFormat& depthFormat);
-	void CreateImage(VkImage& image, VkDeviceMemory& imageMemory, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
+	void CreateImage(VkImage& image, Allocation& imageMemory, uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
 	void CreateModel(const char* name);
-	void CreateTextureImage(const char* name);
+	void CreateTextureImage(const char* name, UploadBatch& batch);
 	void CreateTextureImageViews(uint32_t mipLevels);
 	void CreateTextureSampler();
-	void TransitionImageLayout(VkImage& image, uint32_t mipLevels, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-	void GenerateMipmaps(VkImage& image, int32_t im_w, int32_t im_h, uint32_t mipLevels, VkFormat imgFormat);
-	void CopyBufferToImage(VkBuffer& srcBuffer, VkImage& srcImage, uint32_t width, uint32_t height);
-	void CopyBuffer(VkBuffer& srcBuffer, VkBuffer& dstBuffer, VkDeviceSize& size, VkCommandPool& commandPool);
-	void CreateVertexBuffer();
-	void CreateIndicesBuffer();
-	void CreateUniformBuffers();
+	void TransitionImageLayout(VkCommandBuffer commandBuffer, VkImage& image, uint32_t mipLevels, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+	void GenerateMipmaps(VkCommandBuffer commandBuffer, VkImage& image, int32_t im_w, int32_t im_h, uint32_t mipLevels, VkFormat imgFormat);
+	void CreateTextureImageFromCache(const TextureCache& cache, UploadBatch& batch);
+	std::vector<VkBufferImageCopy> GetMipChainRegions(const MipChain& chain);
+	void UploadTextureImage(UploadBatch& batch, VkImage& image, Allocation& imageMemory, const void* data, VkDeviceSize dataSize, VkFormat format, uint32_t width, uint32_t height, const std::vector<VkBufferImageCopy>& regions);
+	void UploadTextureImageWithBlits(UploadBatch& batch, VkImage& image, Allocation& imageMemory, const uint8_t* pixels, uint32_t width, uint32_t height);
+	bool SupportsSampledFormat(VkFormat format);
+	bool SupportsLinearBlit(VkFormat format);
+	bool PreferCPUMipmaps(VkFormat format);
+	VkFormat GetTextureCacheFormat();
+	std::vector<VkBufferImageCopy> GetTextureCacheRegions(const TextureCache& cache);
+	// Times CPU mip generation per filter and instruction set, then CPU generation + upload against upload + blit.
+	void BenchmarkMipmaps(const char* name, size_t runs);
+	void CopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer& srcBuffer, VkImage& srcImage, uint32_t width, uint32_t height, VkDeviceSize bufferOffset = 0);
+	void CopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer& srcBuffer, VkImage& srcImage, const std::vector<VkBufferImageCopy>& regions);
+	void CopyBuffer(VkCommandBuffer commandBuffer, VkBuffer& srcBuffer, VkDeviceSize srcOffset, VkBuffer& dstBuffer, VkDeviceSize size);
+	void CreateStagingRing();
+	void DestroyStagingRing();
+	// Copies data into the staging ring, or into a dedicated buffer if the ring cannot take it. A null data leaves the region for the caller to fill.
+	StagingRegion AllocateStaging(const void* data, VkDeviceSize size);
+	void ReleaseStaging(StagingRegion& region);
+	void BeginUploadBatch(UploadBatch& batch);
+	StagingRegion CreateStagingBuffer(UploadBatch& batch, const void* data, VkDeviceSize size);
+	void SubmitUploadBatch(UploadBatch& batch);
+	// Waits for the batch's fence, then frees its staging buffers and command buffer.
+	void FinishUploadBatch(UploadBatch& batch);
+	void CreateGeometryBuffer(UploadBatch& batch, VkBuffer& buffer, Allocation& bufferMemory, const void* data, VkDeviceSize size, VkBufferUsageFlags usage);
+	void* CreateGeometryBuffer(UploadBatch& batch, VkBuffer& buffer, Allocation& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage);
+	VkDeviceSize GetPackedVertexSize(size_t count) const;
+	void PackVertices(const Vertex* vertices, size_t count, VertexQuantization& quantization, void* packed) const;
+	void CreateVertexBuffer(UploadBatch& batch);
+	void CreateIndicesBuffer(UploadBatch& batch);
+	void CreateUniformBuffer();
 	void CreateDescriptorPool();
-	void CreateDescriptorSets();
+	void CreateDescriptorSet();
+	void WriteDescriptorSet();
+	void CreateReadbackBuffers();
+	void RecordReadback(VkCommandBuffer& commandBuffer, uint32_t imageIndex);
+	void QueryTimestampSupport();
+	void CreateFrameQueryPool();
+	void BeginUploadTimestamp(UploadBatch& batch, const std::string& name);
+	void EndUploadTimestamp(UploadBatch& batch);
+	void ResolveUploadTimestamps(UploadBatch& batch);
+	void CollectFrameTimestamps(uint32_t imageIndex);
+	bool ReadTimestamps(VkQueryPool queryPool, uint32_t firstQuery, const std::string& name);
+	void PrintTimestampStats();
 	void CreateSyncObjects();
 	void CreateCommandBuffers();
+	void DestroyCommandBuffers();
+	void BuildDrawList();
+	void CreateScene();
+	void CreateInstanceBuffer(UploadBatch& batch);
+	void ResolveCullMode();
+	void SetCullMode(CullMode mode);
+	void CreateCullingPipeline();
+	void DestroyCullingPipeline();
+	void CreateCullingBuffers(UploadBatch& batch);
+	void CreateCullingDescriptorSet();
+	void DestroyCullingResources();
+	// Rebuilds the culling buffers and descriptor set after the draw list, the model or the swap image count changed.
+	void RecreateCullingResources();
+	void CullOnCPU(uint32_t imageIndex);
+	// Converts a level's geometric error to the view distance it is first drawn at.
+	float GetLodScale() const;
+	void UpdateBatchLods();
+	void RecordGPUCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void BeginFrameRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkSubpassContents contents);
+	void EndFrameRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void RecordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t firstDraw, size_t drawCount);
+	void CreateFrameCommands();
+	void DestroyFrameCommands();
+	// Resets the current frame's pools and records its primary command buffer, with the draws recorded in parallel.
+	VkCommandBuffer RecordFrame(uint32_t imageIndex);
+
+	bool UseAssetStreaming();
+	void CreatePlaceholderAssets(UploadBatch& batch);
+	void StreamAsset(StreamedAssetType type, const char* name);
+	void RunStreamWorker(StreamedAsset& asset);
+	void StreamTexture(StreamedAsset& asset);
+	void StreamModel(StreamedAsset& asset);
+	VkCommandBuffer BeginStreamTransfer(StreamedAsset& asset);
+	void EndStreamTransfer(StreamedAsset& asset, VkCommandBuffer commandBuffer);
+	void SubmitAssetAcquire(StreamedAsset& asset);
+	void MakeAssetResident(StreamedAsset& asset);
+	void DestroyStreamedAsset(StreamedAsset& asset);
+	void PollAssetStreaming(bool wait);
+	void FinishAssetStreaming();
+	void CancelAssetStreaming();
 };
\ No newline at end of file
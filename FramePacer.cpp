@@ -0,0 +1,102 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+FramePacer::FramePacer() {
+#ifdef _WIN32
+	// Needs Windows 10 1803 or later; older systems fall back to sleep_for.
+	this->timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+	if (this->timer != nullptr) {
+		CloseHandle(this->timer);
+	}
+#endif
+}
+
+void FramePacer::SetLimit(double framesPerSecond) {
+	this->period = framesPerSecond > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond)) : Clock::duration::zero();
+	this->deadline = Clock::now();
+}
+
+bool FramePacer::IsLimited() const {
+	return this->period > Clock::duration::zero();
+}
+
+void FramePacer::SleepOnce() {
+	Clock::time_point start = Clock::now();
+
+#ifdef _WIN32
+	if (this->timer != nullptr) {
+		// Relative due time in 100 ns units.
+		LARGE_INTEGER dueTime = {};
+		dueTime.QuadPart = -10000;
+
+		if (SetWaitableTimerEx(this->timer, &dueTime, 0, nullptr, nullptr, nullptr, 0)) {
+			WaitForSingleObject(this->timer, INFINITE);
+		}
+	}
+	else {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+#else
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+
+	double sleptMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	// Old samples are forgotten after a while, so the margin follows changes in system load.
+	if (this->sleepCount >= 1000) {
+		this->sleepM2 *= 0.5;
+		this->sleepCount /= 2;
+	}
+
+	this->sleepCount++;
+	double delta = sleptMs - this->sleepMean;
+	this->sleepMean += delta / this->sleepCount;
+	this->sleepM2 += delta * (sleptMs - this->sleepMean);
+}
+
+void FramePacer::Wait() {
+	if (!IsLimited()) {
+		return;
+	}
+
+	Clock::time_point now = Clock::now();
+
+	// Sleep while even a slow sleep ends before the deadline, then spin.
+	while (true) {
+		double remainingMs = std::chrono::duration<double, std::milli>(this->deadline - now).count();
+		double marginMs = this->sleepMean + std::sqrt(this->sleepM2 / std::max<uint64_t>(1, this->sleepCount - 1));
+
+		if (remainingMs <= marginMs) {
+			break;
+		}
+
+		SleepOnce();
+		now = Clock::now();
+	}
+
+	while (now < this->deadline) {
+		std::this_thread::yield();
+		now = Clock::now();
+	}
+
+	this->deadline += this->period;
+
+	if (this->deadline + this->period < now) {
+		this->deadline = now + this->period;
+	}
+}
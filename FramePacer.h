@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Holds a loop to a fixed frame rate. Each Wait sleeps most of the way to the frame's deadline and spins the rest,
+// keeping back as much time as short sleeps have been overshooting lately, so frames start within microseconds of
+// their deadline without burning a core for the whole frame.
+class FramePacer {
+private:
+	using Clock = std::chrono::steady_clock;
+
+	Clock::duration period = Clock::duration::zero();
+	Clock::time_point deadline = {};
+
+	// Mean and variance (Welford) of how long a 1 ms sleep really takes, in milliseconds.
+	double sleepMean = 1.0;
+	double sleepM2 = 0.0;
+	uint64_t sleepCount = 1;
+
+#ifdef _WIN32
+	// High-resolution waitable timer; Sleep and sleep_for only wake on the 15.6 ms scheduler tick by default.
+	void* timer = nullptr;
+#endif
+
+	void SleepOnce();
+
+public:
+	FramePacer();
+	~FramePacer();
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	// 0 or less removes the limit.
+	void SetLimit(double framesPerSecond);
+	bool IsLimited() const;
+
+	// Returns once the current frame's deadline has passed and schedules the next one a period later. A frame that
+	// missed its deadline by more than a period restarts the schedule instead of letting later frames catch up.
+	void Wait();
+};
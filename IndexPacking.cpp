@@ -0,0 +1,98 @@
+#include "IndexPacking.h"
+
+#include <algorithm>
+
+static const uint32_t MAX_CHUNK_VERTICES = 65536;
+
+static bool SplitShape(const uint32_t* indices, const ObjShape& shape, uint32_t shapeIndex, size_t maxChunks, std::vector<IndexChunk>& chunks) {
+	IndexChunk chunk = {};
+	chunk.firstIndex = shape.firstIndex;
+	chunk.shape = shapeIndex;
+
+	uint32_t chunkMin = UINT32_MAX;
+	uint32_t chunkMax = 0;
+
+	for (uint32_t i = 0; i + 3 <= shape.indexCount; i += 3) {
+		const uint32_t* triangle = indices + shape.firstIndex + i;
+		uint32_t triangleMin = std::min({ triangle[0], triangle[1], triangle[2] });
+		uint32_t triangleMax = std::max({ triangle[0], triangle[1], triangle[2] });
+
+		if (triangleMax - triangleMin >= MAX_CHUNK_VERTICES) {
+			return false;
+		}
+
+		uint32_t newMin = std::min(chunkMin, triangleMin);
+		uint32_t newMax = std::max(chunkMax, triangleMax);
+
+		if (newMax - newMin >= MAX_CHUNK_VERTICES) {
+			chunk.vertexOffset = static_cast<int32_t>(chunkMin);
+			chunks.push_back(chunk);
+
+			if (chunks.size() > maxChunks) {
+				return false;
+			}
+
+			chunk.firstIndex = shape.firstIndex + i;
+			chunk.indexCount = 0;
+			newMin = triangleMin;
+			newMax = triangleMax;
+		}
+
+		chunkMin = newMin;
+		chunkMax = newMax;
+		chunk.indexCount += 3;
+	}
+
+	if (chunk.indexCount > 0) {
+		chunk.vertexOffset = static_cast<int32_t>(chunkMin);
+		chunks.push_back(chunk);
+	}
+
+	return chunks.size() <= maxChunks;
+}
+
+PackedIndices PackIndices(const uint32_t* indices, size_t indexCount, size_t vertexCount, const std::vector<ObjShape>& shapes, bool allow16Bit) {
+	PackedIndices packed;
+
+	std::vector<ObjShape> ranges = shapes;
+	if (ranges.empty()) {
+		ranges.push_back({ "", 0, static_cast<uint32_t>(indexCount) });
+	}
+
+	// Every extra chunk is one more draw per instance batch, which costs more than the index bandwidth it saves once
+	// the indices jump around too much.
+	size_t maxChunks = ranges.size() + 4 * ((vertexCount + MAX_CHUNK_VERTICES - 1) / MAX_CHUNK_VERTICES);
+	bool split = allow16Bit;
+
+	for (uint32_t shape = 0; shape < ranges.size(); shape++) {
+		if (!split || !SplitShape(indices, ranges[shape], shape, maxChunks, packed.chunks)) {
+			split = false;
+			break;
+		}
+	}
+
+	if (!split) {
+		packed.chunks.clear();
+
+		for (uint32_t shape = 0; shape < ranges.size(); shape++) {
+			IndexChunk chunk = {};
+			chunk.firstIndex = ranges[shape].firstIndex;
+			chunk.indexCount = ranges[shape].indexCount;
+			chunk.shape = shape;
+			packed.chunks.push_back(chunk);
+		}
+
+		return packed;
+	}
+
+	// Indices outside every shape are never drawn and stay zero.
+	packed.indices16.resize(indexCount, 0);
+
+	for (const IndexChunk& chunk : packed.chunks) {
+		for (uint32_t i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; i++) {
+			packed.indices16[i] = static_cast<uint16_t>(indices[i] - static_cast<uint32_t>(chunk.vertexOffset));
+		}
+	}
+
+	return packed;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ObjLoader.h"
+
+// A range of the index buffer whose indices are relative to vertexOffset, drawn with one vkCmdDrawIndexed.
+struct IndexChunk {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	int32_t vertexOffset = 0;
+	// Index into the mesh's shapes.
+	uint32_t shape = 0;
+};
+
+struct PackedIndices {
+	// Rebased 16-bit indices, in the same order as the source. Empty when the mesh keeps its 32-bit indices.
+	std::vector<uint16_t> indices16;
+	// Cover every shape in order; a shape is split wherever its triangles reach beyond 65536 consecutive vertices.
+	std::vector<IndexChunk> chunks;
+};
+
+// Narrows the indices to 16 bits when every shape can be drawn as a few chunks of at most 65536 consecutive vertices,
+// which holds for any mesh with fewer vertices and for larger ones in vertex fetch order. Keeps 32-bit indices, one
+// chunk per shape, when allow16Bit is false, a single triangle spans more vertices, or the split would add more than
+// four draws per 65536 vertices.
+PackedIndices PackIndices(const uint32_t* indices, size_t indexCount, size_t vertexCount, const std::vector<ObjShape>& shapes, bool allow16Bit);
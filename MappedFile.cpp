@@ -0,0 +1,174 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (mapped == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	this->fileHandle = file;
+	this->mappingHandle = mapping;
+	this->data = static_cast<const char*>(mapped);
+	this->size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(path.c_str(), O_RDONLY);
+
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat info;
+
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		close(file);
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	// Cache files are about to be copied into a staging buffer front to back. The advice values are not flags, so each needs its own call.
+	madvise(mapped, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+	madvise(mapped, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+
+	this->data = static_cast<const char*>(mapped);
+	this->size = static_cast<size_t>(info.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close() {
+	if (this->data != nullptr) {
+#ifdef _WIN32
+		UnmapViewOfFile(this->data);
+		CloseHandle(this->mappingHandle);
+		CloseHandle(this->fileHandle);
+#else
+		munmap(const_cast<char*>(this->data), this->size);
+#endif
+	}
+
+	this->data = nullptr;
+	this->size = 0;
+	this->fileHandle = nullptr;
+	this->mappingHandle = nullptr;
+}
+
+bool GetFileStamp(const std::string& path, uint64_t& size, int64_t& time) {
+	std::error_code error;
+
+	size = std::filesystem::file_size(path, error);
+
+	if (error) {
+		return false;
+	}
+
+	time = static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+
+	return !error;
+}
+
+uint64_t HashFilePath(const std::string& path) {
+	std::error_code error;
+	std::filesystem::path absolute = std::filesystem::absolute(path, error);
+	std::string canonical = error ? path : absolute.lexically_normal().string();
+
+	// FNV-1a
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	for (char c : canonical) {
+		hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+std::string GetCacheFilePath(const std::string& cacheDirectory, const std::string& sourcePath, const std::string& extension) {
+	char hash[17];
+	snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(HashFilePath(sourcePath)));
+
+	std::string fileName = std::filesystem::path(sourcePath).stem().string() + "." + hash + "." + extension;
+
+	return (std::filesystem::path(cacheDirectory) / fileName).string();
+}
+
+std::ofstream OpenCacheFile(const std::string& path) {
+	std::error_code error;
+	std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+	if (!directory.empty()) {
+		std::filesystem::create_directories(directory, error);
+	}
+
+	return std::ofstream(path + ".tmp", std::ios::binary | std::ios::trunc);
+}
+
+bool CommitCacheFile(std::ofstream& file, const std::string& path) {
+	std::string tempPath = path + ".tmp";
+
+	file.close();
+
+	if (file.fail()) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+
+	if (error) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
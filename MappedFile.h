@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <fstream>
+
+// A whole file mapped read-only into memory.
+class MappedFile {
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+
+	// Win32 file and mapping handles; unused on POSIX where the descriptor is closed right after mapping.
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	// Returns false for a missing or empty file.
+	bool Open(const std::string& path);
+	void Close();
+
+	const char* GetData() const {
+		return this->data;
+	}
+
+	size_t GetSize() const {
+		return this->size;
+	}
+};
+
+// Size and modification time of a source asset, used to tell whether a cache built from it is still current.
+bool GetFileStamp(const std::string& path, uint64_t& size, int64_t& time);
+
+// Hash of the absolute, normalized path, so cache files of different sources with the same name don't collide.
+uint64_t HashFilePath(const std::string& path);
+
+// <cacheDirectory>/<source file stem>.<path hash>.<extension>
+std::string GetCacheFilePath(const std::string& cacheDirectory, const std::string& sourcePath, const std::string& extension);
+
+// Cache files are written to <path>.tmp, creating the directory if needed, and renamed into place once complete,
+// so a crash never leaves a truncated cache behind. CommitCacheFile removes the temporary file if the write failed.
+std::ofstream OpenCacheFile(const std::string& path);
+bool CommitCacheFile(std::ofstream& file, const std::string& path);
@@ -0,0 +1,202 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static const uint32_t MESH_CACHE_MAGIC = 0x48534D56; // "VMSH"
+static const uint32_t MESH_CACHE_VERSION = 5;
+
+// 0 and 1 both ask for the base mesh alone, and BuildLodChain stops at MAX_LOD_LEVELS.
+static uint32_t GetRequestedLodLevels(uint32_t lodLevels) {
+	return std::min(std::max(lodLevels, 1u), MAX_LOD_LEVELS);
+}
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Every submesh lies within the index stream and every index within the vertex stream, so nothing downstream, on the
+// CPU or the GPU, can be sent out of bounds by a corrupted file.
+static bool HasValidRanges(const MeshCacheHeader* header, const char* data) {
+	const uint32_t* indices = reinterpret_cast<const uint32_t*>(data + header->indexOffset);
+	const MeshCacheSubmesh* submeshes = reinterpret_cast<const MeshCacheSubmesh*>(data + header->submeshOffset);
+
+	for (uint32_t i = 0; i < header->submeshCount; i++) {
+		if (static_cast<uint64_t>(submeshes[i].firstIndex) + submeshes[i].indexCount > header->indexCount) {
+			return false;
+		}
+	}
+
+	uint32_t maxIndex = 0;
+
+	for (uint32_t i = 0; i < header->indexCount; i++) {
+		maxIndex = std::max(maxIndex, indices[i]);
+	}
+
+	return header->indexCount == 0 || maxIndex < header->vertexCount;
+}
+
+bool MeshCache::Open(const std::string& cachePath, const std::string& sourcePath, bool optimized, uint32_t lodLevels) {
+	Close();
+
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+
+	if (!GetFileStamp(sourcePath, sourceSize, sourceTime) || !this->file.Open(cachePath)) {
+		return false;
+	}
+
+	const MeshCacheHeader* candidate = reinterpret_cast<const MeshCacheHeader*>(this->file.GetData());
+
+	bool valid = this->file.GetSize() >= sizeof(MeshCacheHeader)
+		&& candidate->magic == MESH_CACHE_MAGIC
+		&& candidate->version == MESH_CACHE_VERSION
+		&& candidate->vertexSize == sizeof(Vertex)
+		&& candidate->sourceSize == sourceSize
+		&& candidate->sourceTime == sourceTime
+		&& candidate->sourcePathHash == HashFilePath(sourcePath)
+		&& candidate->fileSize == this->file.GetSize()
+		&& candidate->optimized == (optimized ? 1u : 0u)
+		&& candidate->lodLevels == GetRequestedLodLevels(lodLevels)
+		&& candidate->lodCount >= 1 && candidate->lodCount <= MAX_LOD_LEVELS && candidate->submeshCount % candidate->lodCount == 0;
+
+	// Bounds checks on every stream, so a truncated or corrupted file is rejected instead of read past its end.
+	valid = valid
+		&& candidate->vertexOffset % alignof(Vertex) == 0 && candidate->indexOffset % sizeof(uint32_t) == 0 && candidate->submeshOffset % alignof(MeshCacheSubmesh) == 0
+		&& candidate->vertexOffset >= sizeof(MeshCacheHeader)
+		&& candidate->vertexOffset + static_cast<uint64_t>(candidate->vertexCount) * sizeof(Vertex) <= candidate->indexOffset
+		&& candidate->indexOffset + static_cast<uint64_t>(candidate->indexCount) * sizeof(uint32_t) <= candidate->submeshOffset
+		&& candidate->submeshOffset + static_cast<uint64_t>(candidate->submeshCount) * sizeof(MeshCacheSubmesh) <= this->file.GetSize()
+		&& HasValidRanges(candidate, this->file.GetData());
+
+	if (!valid) {
+		std::cout << "Discarding stale mesh cache " << cachePath << std::endl;
+		Close();
+		return false;
+	}
+
+	this->header = candidate;
+	return true;
+}
+
+void MeshCache::Close() {
+	this->file.Close();
+	this->header = nullptr;
+}
+
+const Vertex* MeshCache::GetVertices() const {
+	return reinterpret_cast<const Vertex*>(this->file.GetData() + this->header->vertexOffset);
+}
+
+uint32_t MeshCache::GetVertexCount() const {
+	return this->header->vertexCount;
+}
+
+const uint32_t* MeshCache::GetIndices() const {
+	return reinterpret_cast<const uint32_t*>(this->file.GetData() + this->header->indexOffset);
+}
+
+uint32_t MeshCache::GetIndexCount() const {
+	return this->header->indexCount;
+}
+
+std::vector<ObjShape> MeshCache::GetShapes() const {
+	const MeshCacheSubmesh* submeshes = reinterpret_cast<const MeshCacheSubmesh*>(this->file.GetData() + this->header->submeshOffset);
+	std::vector<ObjShape> shapes(this->header->submeshCount);
+
+	for (uint32_t i = 0; i < this->header->submeshCount; i++) {
+		shapes[i].name = std::string(submeshes[i].name, strnlen(submeshes[i].name, sizeof(submeshes[i].name)));
+		shapes[i].firstIndex = submeshes[i].firstIndex;
+		shapes[i].indexCount = submeshes[i].indexCount;
+	}
+
+	return shapes;
+}
+
+std::vector<float> MeshCache::GetLodErrors() const {
+	return std::vector<float>(this->header->lodErrors, this->header->lodErrors + this->header->lodCount);
+}
+
+void MeshCache::GetBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const {
+	boundsMin = { this->header->boundsMin[0], this->header->boundsMin[1], this->header->boundsMin[2] };
+	boundsMax = { this->header->boundsMax[0], this->header->boundsMax[1], this->header->boundsMax[2] };
+}
+
+std::string GetMeshCachePath(const std::string& cacheDirectory, const std::string& sourcePath) {
+	return GetCacheFilePath(cacheDirectory, sourcePath, "mesh");
+}
+
+static void WritePadding(std::ofstream& file, uint64_t& written, uint64_t offset) {
+	static const char zeros[16] = {};
+
+	file.write(zeros, static_cast<std::streamsize>(offset - written));
+	written = offset;
+}
+
+bool WriteMeshCache(const std::string& cachePath, const std::string& sourcePath, const ObjMesh& mesh, bool optimized, uint32_t lodLevels) {
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+	header.submeshCount = static_cast<uint32_t>(mesh.shapes.size());
+	header.sourcePathHash = HashFilePath(sourcePath);
+	header.optimized = optimized ? 1 : 0;
+	header.lodLevels = GetRequestedLodLevels(lodLevels);
+	header.lodCount = std::max<uint32_t>(1, static_cast<uint32_t>(std::min<size_t>(mesh.lodErrors.size(), MAX_LOD_LEVELS)));
+
+	for (uint32_t i = 0; i < header.lodCount && i < mesh.lodErrors.size(); i++) {
+		header.lodErrors[i] = mesh.lodErrors[i];
+	}
+
+	if (!GetFileStamp(sourcePath, header.sourceSize, header.sourceTime)) {
+		return false;
+	}
+
+	glm::vec3 boundsMin = mesh.vertices.empty() ? glm::vec3(0.0f) : mesh.vertices[0].position;
+	glm::vec3 boundsMax = boundsMin;
+
+	for (const Vertex& vertex : mesh.vertices) {
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+
+	for (int i = 0; i < 3; i++) {
+		header.boundsMin[i] = boundsMin[i];
+		header.boundsMax[i] = boundsMax[i];
+	}
+
+	header.vertexOffset = AlignUp(sizeof(MeshCacheHeader), 16);
+	header.indexOffset = header.vertexOffset + mesh.vertices.size() * sizeof(Vertex);
+	header.submeshOffset = AlignUp(header.indexOffset + mesh.indices.size() * sizeof(uint32_t), alignof(MeshCacheSubmesh));
+	header.fileSize = header.submeshOffset + mesh.shapes.size() * sizeof(MeshCacheSubmesh);
+
+	std::vector<MeshCacheSubmesh> submeshes(mesh.shapes.size());
+
+	for (size_t i = 0; i < mesh.shapes.size(); i++) {
+		submeshes[i].firstIndex = mesh.shapes[i].firstIndex;
+		submeshes[i].indexCount = mesh.shapes[i].indexCount;
+		strncpy(submeshes[i].name, mesh.shapes[i].name.c_str(), sizeof(submeshes[i].name) - 1);
+	}
+
+	std::ofstream file = OpenCacheFile(cachePath);
+
+	if (!file.is_open()) {
+		return false;
+	}
+
+	uint64_t written = sizeof(MeshCacheHeader);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+
+	WritePadding(file, written, header.vertexOffset);
+	file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+	file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+	written = header.indexOffset + mesh.indices.size() * sizeof(uint32_t);
+
+	WritePadding(file, written, header.submeshOffset);
+	file.write(reinterpret_cast<const char*>(submeshes.data()), submeshes.size() * sizeof(MeshCacheSubmesh));
+
+	return CommitCacheFile(file, cachePath);
+}
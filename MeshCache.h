@@ -0,0 +1,76 @@
+#pragma once
+
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include <string>
+
+// On-disk layout of a mesh cache file: this header, then the vertex stream (16-byte aligned), the 32-bit index stream
+// and one MeshCacheSubmesh per shape. Everything is stored in host byte order.
+struct MeshCacheHeader {
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t vertexSize = 0;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	uint32_t submeshCount = 0;
+
+	// The cache is only used while the source file still has this size, modification time and path.
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	uint64_t sourcePathHash = 0;
+
+	float boundsMin[3] = {};
+	float boundsMax[3] = {};
+
+	// The submeshes hold lodCount levels of submeshCount / lodCount shapes each.
+	uint32_t lodCount = 0;
+	float lodErrors[MAX_LOD_LEVELS] = {};
+
+	// Settings the mesh was built with: whether it went through the optimizer and how many levels of detail were
+	// asked for (the chain can come out shorter). A cache built with other settings is stale.
+	uint32_t optimized = 0;
+	uint32_t lodLevels = 0;
+
+	uint64_t vertexOffset = 0;
+	uint64_t indexOffset = 0;
+	uint64_t submeshOffset = 0;
+	uint64_t fileSize = 0;
+};
+
+struct MeshCacheSubmesh {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	char name[56] = {};
+};
+
+// A mesh cache file mapped read-only into memory. The vertex and index streams point straight into the mapping,
+// so they can be copied into a staging buffer without going through a std::vector first.
+class MeshCache {
+private:
+	MappedFile file;
+	const MeshCacheHeader* header = nullptr;
+
+public:
+	// Maps the cache file for sourcePath. Returns false, leaving the cache closed, if it is missing, stale, malformed or
+	// was built with other settings.
+	bool Open(const std::string& cachePath, const std::string& sourcePath, bool optimized, uint32_t lodLevels);
+	void Close();
+
+	bool IsOpen() const {
+		return this->header != nullptr;
+	}
+
+	const Vertex* GetVertices() const;
+	uint32_t GetVertexCount() const;
+	const uint32_t* GetIndices() const;
+	uint32_t GetIndexCount() const;
+	std::vector<ObjShape> GetShapes() const;
+	std::vector<float> GetLodErrors() const;
+	void GetBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+};
+
+// Cache file name for a model, derived from its file name and a hash of its full path so models with the same name don't collide.
+std::string GetMeshCachePath(const std::string& cacheDirectory, const std::string& sourcePath);
+
+// Writes the mesh atomically (temporary file + rename). Returns false if the cache could not be written.
+bool WriteMeshCache(const std::string& cachePath, const std::string& sourcePath, const ObjMesh& mesh, bool optimized, uint32_t lodLevels);
@@ -0,0 +1,541 @@
+#include "MeshOptimizer.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+	VertexCacheStats stats = {};
+	size_t triangleCount = indexCount / 3;
+
+	if (triangleCount == 0) {
+		return stats;
+	}
+
+	// A vertex is cached while fewer than cacheSize misses happened since it was loaded.
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+	size_t uniqueVertices = 0;
+
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		uint32_t vertex = indices[i];
+
+		if (time - timestamps[vertex] > cacheSize) {
+			timestamps[vertex] = time++;
+			misses++;
+		}
+
+		if (!referenced[vertex]) {
+			referenced[vertex] = true;
+			uniqueVertices++;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(triangleCount);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+
+	return stats;
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+	size_t triangleCount = indexCount / 3;
+
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles around every vertex, flattened: adjacency[offsets[v]..offsets[v + 1]].
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		offsets[indices[i] + 1]++;
+	}
+
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<uint32_t> liveTriangles(vertexCount);
+
+	for (size_t v = 0; v < vertexCount; v++) {
+		liveTriangles[v] = offsets[v + 1] - offsets[v];
+	}
+
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+
+	uint32_t time = cacheSize + 1;
+	size_t cursor = 0;
+	int64_t fanning = indices[0];
+
+	while (fanning >= 0) {
+		uint32_t center = static_cast<uint32_t>(fanning);
+		candidates.clear();
+
+		// Emit the whole fan around the current vertex.
+		for (uint32_t k = offsets[center]; k < offsets[center + 1]; k++) {
+			uint32_t triangle = adjacency[k];
+
+			if (emitted[triangle]) {
+				continue;
+			}
+
+			for (uint32_t c = 0; c < 3; c++) {
+				uint32_t vertex = indices[triangle * 3 + c];
+
+				result.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+
+				if (time - timestamps[vertex] > cacheSize) {
+					timestamps[vertex] = time++;
+				}
+			}
+
+			emitted[triangle] = true;
+		}
+
+		// Continue with the oldest candidate that will still be cached after its own fan is emitted.
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+
+		for (uint32_t vertex : candidates) {
+			if (liveTriangles[vertex] == 0) {
+				continue;
+			}
+
+			int64_t priority = 0;
+
+			if (time - timestamps[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+				priority = time - timestamps[vertex];
+			}
+
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		// Dead end: back up to a recently used vertex, then fall back to the next unfinished vertex in input order.
+		while (next < 0 && !deadEnds.empty()) {
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+
+			if (liveTriangles[vertex] > 0) {
+				next = vertex;
+			}
+		}
+
+		while (next < 0 && cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0) {
+				next = static_cast<int64_t>(cursor);
+			}
+
+			cursor++;
+		}
+
+		fanning = next;
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold, uint32_t cacheSize) {
+	size_t triangleCount = indexCount / 3;
+
+	if (triangleCount == 0) {
+		return;
+	}
+
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+
+	auto simulateTriangle = [&](size_t triangle) {
+		uint32_t misses = 0;
+
+		for (uint32_t c = 0; c < 3; c++) {
+			uint32_t vertex = indices[triangle * 3 + c];
+
+			if (time - timestamps[vertex] > cacheSize) {
+				timestamps[vertex] = time++;
+				misses++;
+			}
+		}
+
+		return misses;
+	};
+
+	auto flushCache = [&]() {
+		time += cacheSize + 1;
+	};
+
+	// Triangles that miss on every vertex are where Tipsify started a new fan; splitting there costs nothing.
+	std::vector<size_t> hardBoundaries = { 0 };
+
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (simulateTriangle(t) == 3 && t > 0) {
+			hardBoundaries.push_back(t);
+		}
+	}
+
+	hardBoundaries.push_back(triangleCount);
+
+	// Split further wherever the running ACMR is already close to that of the whole hard cluster.
+	std::vector<size_t> clusterStarts;
+
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); h++) {
+		size_t start = hardBoundaries[h];
+		size_t end = hardBoundaries[h + 1];
+
+		if (start == end) {
+			continue;
+		}
+
+		flushCache();
+		uint32_t clusterMisses = 0;
+
+		for (size_t t = start; t < end; t++) {
+			clusterMisses += simulateTriangle(t);
+		}
+
+		float clusterACMR = static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+		flushCache();
+		clusterStarts.push_back(start);
+		size_t subStart = start;
+		uint32_t misses = 0;
+
+		for (size_t t = start; t < end; t++) {
+			misses += simulateTriangle(t);
+
+			if (t + 1 < end && static_cast<float>(misses) <= clusterACMR * threshold * static_cast<float>(t + 1 - subStart)) {
+				clusterStarts.push_back(t + 1);
+				subStart = t + 1;
+				misses = 0;
+				flushCache();
+			}
+		}
+	}
+
+	size_t clusterCount = clusterStarts.size();
+	clusterStarts.push_back(triangleCount);
+
+	// Area-weighted centroid and summed face normal of every cluster and of the whole mesh.
+	std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> clusterAreas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid = glm::vec3(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+		for (size_t t = clusterStarts[cluster]; t < clusterStarts[cluster + 1]; t++) {
+			glm::vec3 p0 = vertices[indices[t * 3 + 0]].position;
+			glm::vec3 p1 = vertices[indices[t * 3 + 1]].position;
+			glm::vec3 p2 = vertices[indices[t * 3 + 2]].position;
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+			clusterCentroids[cluster] += centroid * area;
+			clusterNormals[cluster] += normal;
+			clusterAreas[cluster] += area;
+		}
+
+		meshCentroid += clusterCentroids[cluster];
+		meshArea += clusterAreas[cluster];
+	}
+
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	std::vector<float> sortKeys(clusterCount, 0.0f);
+
+	for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+		float normalLength = glm::length(clusterNormals[cluster]);
+
+		if (clusterAreas[cluster] > 0.0f && normalLength > 0.0f) {
+			glm::vec3 centroid = clusterCentroids[cluster] / clusterAreas[cluster];
+			sortKeys[cluster] = glm::dot(centroid - meshCentroid, clusterNormals[cluster] / normalLength);
+		}
+	}
+
+	std::vector<uint32_t> clusterOrder(clusterCount);
+	std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint32_t a, uint32_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+
+	for (uint32_t cluster : clusterOrder) {
+		result.insert(result.end(), indices + clusterStarts[cluster] * 3, indices + clusterStarts[cluster + 1] * 3);
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+size_t OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+
+		index = remap[index];
+	}
+
+	vertices = std::move(reordered);
+
+	return vertices.size();
+}
+
+MeshOptimizationStats OptimizeMesh(ObjMesh& mesh) {
+	MeshOptimizationStats stats = {};
+	stats.before = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+	std::vector<ObjShape> shapes = mesh.shapes;
+
+	if (shapes.empty()) {
+		shapes.push_back({ "", 0, static_cast<uint32_t>(mesh.indices.size()) });
+	}
+
+	// Every shape is optimized on its own compact vertex range, so the per-shape buffers stay small.
+	std::vector<uint32_t> localIndex(mesh.vertices.size(), UINT32_MAX);
+	std::vector<uint32_t> globalIndex;
+	std::vector<uint32_t> localIndices;
+	std::vector<Vertex> localVertices;
+
+	for (const ObjShape& shape : shapes) {
+		globalIndex.clear();
+		localVertices.clear();
+		localIndices.resize(shape.indexCount);
+
+		for (uint32_t i = 0; i < shape.indexCount; i++) {
+			uint32_t vertex = mesh.indices[shape.firstIndex + i];
+
+			if (localIndex[vertex] == UINT32_MAX) {
+				localIndex[vertex] = static_cast<uint32_t>(globalIndex.size());
+				globalIndex.push_back(vertex);
+				localVertices.push_back(mesh.vertices[vertex]);
+			}
+
+			localIndices[i] = localIndex[vertex];
+		}
+
+		OptimizeVertexCache(localIndices.data(), localIndices.size(), globalIndex.size());
+		OptimizeOverdraw(localIndices.data(), localIndices.size(), localVertices.data(), globalIndex.size());
+
+		for (uint32_t i = 0; i < shape.indexCount; i++) {
+			mesh.indices[shape.firstIndex + i] = globalIndex[localIndices[i]];
+		}
+
+		for (uint32_t vertex : globalIndex) {
+			localIndex[vertex] = UINT32_MAX;
+		}
+	}
+
+	OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+	stats.after = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+	return stats;
+}
+
+static void ComputeMeshletBounds(Meshlet& meshlet, const MeshletData& data, const Vertex* vertices) {
+	glm::vec3 minimum = vertices[data.meshletVertices[meshlet.vertexOffset]].position;
+	glm::vec3 maximum = minimum;
+
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+		glm::vec3 position = vertices[data.meshletVertices[meshlet.vertexOffset + i]].position;
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+
+	meshlet.center = (minimum + maximum) * 0.5f;
+	meshlet.radius = 0.0f;
+
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+		glm::vec3 position = vertices[data.meshletVertices[meshlet.vertexOffset + i]].position;
+		meshlet.radius = std::max(meshlet.radius, glm::length(position - meshlet.center));
+	}
+
+	// The normal cone: the average face direction, widened until it contains every face normal.
+	glm::vec3 normals[MESHLET_MAX_TRIANGLES];
+	uint32_t normalCount = 0;
+	glm::vec3 axis = glm::vec3(0.0f);
+
+	for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+		const uint8_t* triangle = &data.meshletTriangles[(meshlet.triangleOffset + t) * 3];
+		glm::vec3 p0 = vertices[data.meshletVertices[meshlet.vertexOffset + triangle[0]]].position;
+		glm::vec3 p1 = vertices[data.meshletVertices[meshlet.vertexOffset + triangle[1]]].position;
+		glm::vec3 p2 = vertices[data.meshletVertices[meshlet.vertexOffset + triangle[2]]].position;
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+
+		if (length > 0.0f) {
+			normals[normalCount] = normal / length;
+			axis += normals[normalCount];
+			normalCount++;
+		}
+	}
+
+	meshlet.coneAxis = glm::vec3(0.0f);
+	meshlet.coneCutoff = 1.0f;
+
+	float axisLength = glm::length(axis);
+
+	if (normalCount == 0 || axisLength == 0.0f) {
+		return;
+	}
+
+	axis /= axisLength;
+	float minDot = 1.0f;
+
+	for (uint32_t i = 0; i < normalCount; i++) {
+		minDot = std::min(minDot, glm::dot(normals[i], axis));
+	}
+
+	meshlet.coneAxis = axis;
+
+	if (minDot > 0.0f) {
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+}
+
+MeshletData BuildMeshlets(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount) {
+	MeshletData data;
+
+	const uint8_t unused = 0xFF;
+	std::vector<uint8_t> localIndex(vertexCount, unused);
+	Meshlet meshlet = {};
+
+	auto finishMeshlet = [&]() {
+		if (meshlet.triangleCount == 0) {
+			return;
+		}
+
+		ComputeMeshletBounds(meshlet, data, vertices);
+
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+			localIndex[data.meshletVertices[meshlet.vertexOffset + i]] = unused;
+		}
+
+		data.meshlets.push_back(meshlet);
+		meshlet = {};
+		meshlet.vertexOffset = static_cast<uint32_t>(data.meshletVertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(data.meshletTriangles.size() / 3);
+	};
+
+	for (size_t t = 0; t < indexCount / 3; t++) {
+		uint32_t a = indices[t * 3 + 0];
+		uint32_t b = indices[t * 3 + 1];
+		uint32_t c = indices[t * 3 + 2];
+
+		uint32_t newVertices = (localIndex[a] == unused) + (localIndex[b] == unused && b != a) + (localIndex[c] == unused && c != a && c != b);
+
+		if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount == MESHLET_MAX_TRIANGLES) {
+			finishMeshlet();
+		}
+
+		for (uint32_t vertex : { a, b, c }) {
+			if (localIndex[vertex] == unused) {
+				localIndex[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+				data.meshletVertices.push_back(vertex);
+			}
+
+			data.meshletTriangles.push_back(localIndex[vertex]);
+		}
+
+		meshlet.triangleCount++;
+	}
+
+	finishMeshlet();
+
+	return data;
+}
+
+static double MeasureMs(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void BenchmarkMeshOptimizer(const std::string& fileName, size_t runs) {
+	ObjMesh source = LoadObjParallel(fileName);
+
+	std::vector<double> cacheMs;
+	std::vector<double> overdrawMs;
+	std::vector<double> fetchMs;
+	std::vector<double> meshletMs;
+
+	VertexCacheStats original = AnalyzeVertexCache(source.indices.data(), source.indices.size(), source.vertices.size());
+	VertexCacheStats afterCache = {};
+	VertexCacheStats afterOverdraw = {};
+	VertexCacheStats afterFetch = {};
+	size_t fetchedVertices = 0;
+	MeshletData meshletData;
+
+	// Each stage runs on the whole index buffer, so the timings do not depend on how the model is split into shapes.
+	for (size_t i = 0; i < runs; i++) {
+		ObjMesh mesh = source;
+
+		std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+		OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+		cacheMs.push_back(MeasureMs(startTime));
+		afterCache = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+		startTime = std::chrono::high_resolution_clock::now();
+		OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size());
+		overdrawMs.push_back(MeasureMs(startTime));
+		afterOverdraw = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+		startTime = std::chrono::high_resolution_clock::now();
+		fetchedVertices = OptimizeVertexFetch(mesh.vertices, mesh.indices);
+		fetchMs.push_back(MeasureMs(startTime));
+		afterFetch = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+		startTime = std::chrono::high_resolution_clock::now();
+		meshletData = BuildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size());
+		meshletMs.push_back(MeasureMs(startTime));
+	}
+
+	size_t coneCount = 0;
+
+	for (const Meshlet& meshlet : meshletData.meshlets) {
+		coneCount += meshlet.coneCutoff < 1.0f;
+	}
+
+	size_t meshletCount = std::max<size_t>(meshletData.meshlets.size(), 1);
+	double averageVertices = static_cast<double>(meshletData.meshletVertices.size()) / meshletCount;
+	double averageTriangles = static_cast<double>(meshletData.meshletTriangles.size() / 3) / meshletCount;
+
+	std::cout << "Mesh optimization: " << fileName << ", " << runs << " runs, " << source.vertices.size() << " vertices, " << (source.indices.size() / 3) << " triangles" << std::endl;
+	std::cout << "  original:     ACMR " << original.acmr << ", ATVR " << original.atvr << std::endl;
+	std::cout << "  vertex cache: ACMR " << afterCache.acmr << ", ATVR " << afterCache.atvr << ", mean " << ComputeBenchmarkStats(cacheMs).mean << " ms" << std::endl;
+	std::cout << "  overdraw:     ACMR " << afterOverdraw.acmr << ", ATVR " << afterOverdraw.atvr << ", mean " << ComputeBenchmarkStats(overdrawMs).mean << " ms" << std::endl;
+	std::cout << "  fetch:        ACMR " << afterFetch.acmr << ", ATVR " << afterFetch.atvr << ", " << fetchedVertices << " vertices, mean " << ComputeBenchmarkStats(fetchMs).mean << " ms" << std::endl;
+	std::cout << "  meshlets:     " << meshletData.meshlets.size() << " clusters, " << averageVertices << " vertices and " << averageTriangles << " triangles on average, "
+		<< coneCount << " with a usable normal cone, mean " << ComputeBenchmarkStats(meshletMs).mean << " ms" << std::endl;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ObjLoader.h"
+#include <string>
+
+// Post-transform vertex cache efficiency of an index stream, simulated with a FIFO cache.
+struct VertexCacheStats {
+	// Average cache misses per triangle; 3 is the worst case, about 0.5 the best for regular meshes.
+	float acmr = 0.0f;
+	// Average cache misses per referenced vertex; 1 is optimal.
+	float atvr = 0.0f;
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Reorders triangles for the post-transform cache with Tipsify (Sander et al. 2007). Indices must be below vertexCount.
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Splits a cache-optimized triangle order into clusters and sorts them outward-facing first, so nearer surfaces tend to
+// be drawn before the ones they hide. Clusters are only split where their ACMR stays within threshold of the
+// original order's, so the cache efficiency is mostly kept.
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold = 1.05f, uint32_t cacheSize = 16);
+
+// Reorders vertices into order of first use and drops unreferenced ones. Returns the new vertex count.
+size_t OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+struct MeshOptimizationStats {
+	VertexCacheStats before = {};
+	VertexCacheStats after = {};
+};
+
+// Runs the cache and overdraw optimizations on every shape's index range, so shapes stay contiguous, then the vertex
+// fetch remap on the whole mesh.
+MeshOptimizationStats OptimizeMesh(ObjMesh& mesh);
+
+// A cluster of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles. Its vertices are
+// meshletVertices[vertexOffset..] (indices into the mesh's vertices) and its triangles are triples of local vertex
+// indices in meshletTriangles[triangleOffset * 3..].
+struct Meshlet {
+	uint32_t vertexOffset = 0;
+	uint32_t triangleOffset = 0;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+
+	glm::vec3 center = {};
+	float radius = 0.0f;
+
+	// The cluster faces away from a camera at position p when
+	// dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius. A cutoff of 1 never culls.
+	glm::vec3 coneAxis = {};
+	float coneCutoff = 1.0f;
+};
+
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct MeshletData {
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint8_t> meshletTriangles;
+};
+
+// Partitions the triangles in index order, so it gives the most compact clusters after OptimizeVertexCache.
+MeshletData BuildMeshlets(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount);
+
+// Times every optimization stage on the model, prints ACMR/ATVR before and after and the meshlet statistics.
+void BenchmarkMeshOptimizer(const std::string& fileName, size_t runs);
@@ -0,0 +1,413 @@
+#include "MeshSimplifier.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+
+// Sum of squared distances to a set of planes, weighted by the area of the triangles they came from.
+struct Quadric {
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+	double weight = 0.0;
+
+	void Add(const Quadric& other) {
+		this->a00 += other.a00;
+		this->a01 += other.a01;
+		this->a02 += other.a02;
+		this->a11 += other.a11;
+		this->a12 += other.a12;
+		this->a22 += other.a22;
+		this->b0 += other.b0;
+		this->b1 += other.b1;
+		this->b2 += other.b2;
+		this->c += other.c;
+		this->weight += other.weight;
+	}
+
+	// Mean squared distance of the point to the planes.
+	double Evaluate(const glm::vec3& point) const {
+		if (this->weight <= 0.0) {
+			return 0.0;
+		}
+
+		double x = point.x;
+		double y = point.y;
+		double z = point.z;
+
+		double error = x * (this->a00 * x + this->a01 * y + this->a02 * z)
+			+ y * (this->a01 * x + this->a11 * y + this->a12 * z)
+			+ z * (this->a02 * x + this->a12 * y + this->a22 * z)
+			+ 2.0 * (this->b0 * x + this->b1 * y + this->b2 * z)
+			+ this->c;
+
+		return std::max(error, 0.0) / this->weight;
+	}
+};
+
+static Quadric GetTriangleQuadric(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2) {
+	Quadric quadric;
+
+	glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+	double length = glm::length(normal);
+
+	if (length == 0.0) {
+		return quadric;
+	}
+
+	double nx = normal.x / length;
+	double ny = normal.y / length;
+	double nz = normal.z / length;
+	double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+	double weight = length * 0.5;
+
+	quadric.a00 = weight * nx * nx;
+	quadric.a01 = weight * nx * ny;
+	quadric.a02 = weight * nx * nz;
+	quadric.a11 = weight * ny * ny;
+	quadric.a12 = weight * ny * nz;
+	quadric.a22 = weight * nz * nz;
+	quadric.b0 = weight * nx * d;
+	quadric.b1 = weight * ny * d;
+	quadric.b2 = weight * nz * d;
+	quadric.c = weight * d * d;
+	quadric.weight = weight;
+
+	return quadric;
+}
+
+// Collapses edges in passes: every pass ranks all candidate collapses by error and applies the cheapest ones whose
+// neighbourhoods don't overlap. Keeps its quadrics between calls to Simplify, so successive targets measure their
+// error against the original surface.
+class LodSimplifier {
+private:
+	struct Collapse {
+		uint32_t from = 0;
+		uint32_t to = 0;
+		double cost = 0.0;
+	};
+
+	const Vertex* vertices = nullptr;
+	size_t vertexCount = 0;
+	std::vector<uint32_t> indices = {};
+	std::vector<Quadric> quadrics = {};
+	std::vector<bool> movable = {};
+	double maxCost = 0.0;
+
+	void ClassifyVertices() {
+		this->movable.assign(this->vertexCount, false);
+
+		// Vertices sharing a position with another one lie on a texture seam.
+		std::unordered_map<glm::vec3, uint32_t> positions;
+		std::vector<uint32_t> canonical(this->vertexCount);
+		std::vector<uint32_t> wedgeCounts(this->vertexCount, 0);
+
+		for (uint32_t index : this->indices) {
+			this->movable[index] = true;
+		}
+
+		for (uint32_t v = 0; v < this->vertexCount; v++) {
+			if (!this->movable[v]) {
+				continue;
+			}
+
+			canonical[v] = positions.try_emplace(this->vertices[v].position, v).first->second;
+			wedgeCounts[canonical[v]]++;
+		}
+
+		// An edge without a twin in the opposite direction is a border; one used more than once per direction is not manifold.
+		std::unordered_map<uint64_t, uint32_t> edges;
+		edges.reserve(this->indices.size());
+
+		for (size_t i = 0; i < this->indices.size(); i += 3) {
+			for (uint32_t e = 0; e < 3; e++) {
+				uint32_t a = canonical[this->indices[i + e]];
+				uint32_t b = canonical[this->indices[i + (e + 1) % 3]];
+				edges[(static_cast<uint64_t>(a) << 32) | b]++;
+			}
+		}
+
+		std::vector<bool> fixedPositions(this->vertexCount, false);
+
+		for (const std::pair<const uint64_t, uint32_t>& edge : edges) {
+			uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+			uint32_t b = static_cast<uint32_t>(edge.first);
+
+			if (edge.second > 1 || edges.find((static_cast<uint64_t>(b) << 32) | a) == edges.end()) {
+				fixedPositions[a] = true;
+				fixedPositions[b] = true;
+			}
+		}
+
+		for (uint32_t v = 0; v < this->vertexCount; v++) {
+			if (this->movable[v]) {
+				this->movable[v] = wedgeCounts[canonical[v]] == 1 && !fixedPositions[canonical[v]];
+			}
+		}
+	}
+
+	double GetCost(uint32_t from, uint32_t to) const {
+		Quadric quadric = this->quadrics[from];
+		quadric.Add(this->quadrics[to]);
+
+		return quadric.Evaluate(this->vertices[to].position);
+	}
+
+	// Whether moving from onto to would turn any remaining triangle around from by more than about 75 degrees.
+	bool FlipsTriangles(uint32_t from, uint32_t to, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& adjacency) const {
+		for (uint32_t k = offsets[from]; k < offsets[from + 1]; k++) {
+			const uint32_t* triangle = &this->indices[adjacency[k] * 3];
+
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+				continue;
+			}
+
+			glm::vec3 before[3];
+			glm::vec3 after[3];
+
+			for (uint32_t c = 0; c < 3; c++) {
+				before[c] = this->vertices[triangle[c]].position;
+				after[c] = triangle[c] == from ? this->vertices[to].position : before[c];
+			}
+
+			glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+			if (glm::dot(normalBefore, normalAfter) <= 0.25f * glm::length(normalBefore) * glm::length(normalAfter)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+public:
+	LodSimplifier(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount)
+		: vertices(vertices), vertexCount(vertexCount), indices(indices, indices + indexCount / 3 * 3) {
+		this->quadrics.resize(vertexCount);
+
+		for (size_t i = 0; i < this->indices.size(); i += 3) {
+			Quadric quadric = GetTriangleQuadric(vertices[this->indices[i]].position, vertices[this->indices[i + 1]].position, vertices[this->indices[i + 2]].position);
+
+			for (uint32_t c = 0; c < 3; c++) {
+				this->quadrics[this->indices[i + c]].Add(quadric);
+			}
+		}
+
+		ClassifyVertices();
+	}
+
+	void Simplify(size_t targetIndexCount) {
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> adjacency;
+		std::vector<Collapse> collapses;
+		std::vector<bool> locked;
+		std::vector<uint32_t> remap;
+
+		while (this->indices.size() > targetIndexCount) {
+			size_t triangleCount = this->indices.size() / 3;
+
+			// Triangles around every vertex, flattened: adjacency[offsets[v]..offsets[v + 1]].
+			offsets.assign(this->vertexCount + 1, 0);
+			for (uint32_t index : this->indices) {
+				offsets[index + 1]++;
+			}
+			for (size_t v = 0; v < this->vertexCount; v++) {
+				offsets[v + 1] += offsets[v];
+			}
+
+			adjacency.resize(this->indices.size());
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < this->indices.size(); i++) {
+				adjacency[fill[this->indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			collapses.clear();
+
+			for (size_t t = 0; t < triangleCount; t++) {
+				for (uint32_t e = 0; e < 3; e++) {
+					uint32_t a = this->indices[t * 3 + e];
+					uint32_t b = this->indices[t * 3 + (e + 1) % 3];
+
+					if (this->movable[a]) {
+						collapses.push_back({ a, b, GetCost(a, b) });
+					}
+					if (this->movable[b]) {
+						collapses.push_back({ b, a, GetCost(b, a) });
+					}
+				}
+			}
+
+			if (collapses.empty()) {
+				break;
+			}
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+				return a.cost < b.cost;
+			});
+
+			// An interior collapse removes two triangles.
+			size_t needed = (this->indices.size() - targetIndexCount) / 6 + 1;
+			size_t performed = 0;
+
+			locked.assign(this->vertexCount, false);
+			remap.resize(this->vertexCount);
+			for (uint32_t v = 0; v < this->vertexCount; v++) {
+				remap[v] = v;
+			}
+
+			for (const Collapse& collapse : collapses) {
+				if (performed >= needed) {
+					break;
+				}
+
+				if (locked[collapse.from] || locked[collapse.to] || FlipsTriangles(collapse.from, collapse.to, offsets, adjacency)) {
+					continue;
+				}
+
+				remap[collapse.from] = collapse.to;
+				this->quadrics[collapse.to].Add(this->quadrics[collapse.from]);
+				this->maxCost = std::max(this->maxCost, collapse.cost);
+				performed++;
+
+				// The flip test of later collapses assumes the rest of their neighbourhood stays put.
+				for (uint32_t k = offsets[collapse.from]; k < offsets[collapse.from + 1]; k++) {
+					for (uint32_t c = 0; c < 3; c++) {
+						locked[this->indices[adjacency[k] * 3 + c]] = true;
+					}
+				}
+			}
+
+			if (performed == 0) {
+				break;
+			}
+
+			size_t write = 0;
+
+			for (size_t i = 0; i < this->indices.size(); i += 3) {
+				uint32_t a = remap[this->indices[i]];
+				uint32_t b = remap[this->indices[i + 1]];
+				uint32_t c = remap[this->indices[i + 2]];
+
+				if (a != b && b != c && c != a) {
+					this->indices[write++] = a;
+					this->indices[write++] = b;
+					this->indices[write++] = c;
+				}
+			}
+
+			this->indices.resize(write);
+		}
+	}
+
+	const std::vector<uint32_t>& GetIndices() const {
+		return this->indices;
+	}
+
+	float GetError() const {
+		return static_cast<float>(std::sqrt(this->maxCost));
+	}
+};
+
+std::vector<uint32_t> SimplifyMesh(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, size_t targetIndexCount, float* error) {
+	LodSimplifier simplifier(indices, indexCount, vertices, vertexCount);
+	simplifier.Simplify(targetIndexCount);
+
+	if (error != nullptr) {
+		*error = simplifier.GetError();
+	}
+
+	return simplifier.GetIndices();
+}
+
+void BuildLodChain(ObjMesh& mesh, uint32_t levelCount) {
+	if (mesh.shapes.empty()) {
+		mesh.shapes.push_back({ "", 0, static_cast<uint32_t>(mesh.indices.size()) });
+	}
+
+	mesh.lodErrors = { 0.0f };
+	levelCount = std::min(levelCount, MAX_LOD_LEVELS);
+
+	if (levelCount <= 1) {
+		return;
+	}
+
+	// Every shape is simplified on its own compact copy of the vertices it uses, so the shapes stay separate and
+	// vertices on the boundary between two shapes stay fixed.
+	struct ShapeLods {
+		std::vector<uint32_t> globalIndex;
+		std::vector<Vertex> localVertices;
+		std::unique_ptr<LodSimplifier> simplifier;
+	};
+
+	std::vector<ObjShape> baseShapes = mesh.shapes;
+	std::vector<ShapeLods> shapeLods(baseShapes.size());
+	std::vector<uint32_t> localIndex(mesh.vertices.size(), UINT32_MAX);
+	std::vector<uint32_t> localIndices;
+
+	for (size_t s = 0; s < baseShapes.size(); s++) {
+		const ObjShape& shape = baseShapes[s];
+		ShapeLods& lods = shapeLods[s];
+		localIndices.resize(shape.indexCount);
+
+		for (uint32_t i = 0; i < shape.indexCount; i++) {
+			uint32_t vertex = mesh.indices[shape.firstIndex + i];
+
+			if (localIndex[vertex] == UINT32_MAX) {
+				localIndex[vertex] = static_cast<uint32_t>(lods.globalIndex.size());
+				lods.globalIndex.push_back(vertex);
+				lods.localVertices.push_back(mesh.vertices[vertex]);
+			}
+
+			localIndices[i] = localIndex[vertex];
+		}
+
+		for (uint32_t vertex : lods.globalIndex) {
+			localIndex[vertex] = UINT32_MAX;
+		}
+
+		lods.simplifier = std::make_unique<LodSimplifier>(localIndices.data(), localIndices.size(), lods.localVertices.data(), lods.localVertices.size());
+	}
+
+	size_t previousIndexCount = 0;
+	for (const ObjShape& shape : baseShapes) {
+		previousIndexCount += shape.indexCount;
+	}
+
+	for (uint32_t level = 1; level < levelCount; level++) {
+		std::vector<uint32_t> levelIndices;
+		std::vector<ObjShape> levelShapes;
+		float levelError = mesh.lodErrors.back();
+
+		ParallelFor(baseShapes.size(), std::thread::hardware_concurrency(), [&](size_t s) {
+			shapeLods[s].simplifier->Simplify(static_cast<size_t>(baseShapes[s].indexCount / 3 >> level) * 3);
+		});
+
+		for (size_t s = 0; s < baseShapes.size(); s++) {
+			const ShapeLods& lods = shapeLods[s];
+
+			ObjShape shape = baseShapes[s];
+			shape.firstIndex = static_cast<uint32_t>(mesh.indices.size() + levelIndices.size());
+			shape.indexCount = static_cast<uint32_t>(lods.simplifier->GetIndices().size());
+			levelShapes.push_back(shape);
+
+			for (uint32_t index : lods.simplifier->GetIndices()) {
+				levelIndices.push_back(lods.globalIndex[index]);
+			}
+
+			levelError = std::max(levelError, lods.simplifier->GetError());
+		}
+
+		// Borders and seams limit how far a mesh can go; a level that barely shrinks isn't worth its memory.
+		if (levelIndices.size() * 10 > previousIndexCount * 9) {
+			break;
+		}
+
+		mesh.indices.insert(mesh.indices.end(), levelIndices.begin(), levelIndices.end());
+		mesh.shapes.insert(mesh.shapes.end(), levelShapes.begin(), levelShapes.end());
+		mesh.lodErrors.push_back(levelError);
+		previousIndexCount = levelIndices.size();
+	}
+}
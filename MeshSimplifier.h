@@ -0,0 +1,13 @@
+#pragma once
+
+#include "ObjLoader.h"
+
+// Simplifies the triangles with quadric error metric edge collapses (Garland and Heckbert 1997) until at most
+// targetIndexCount indices are left or nothing more can collapse. Vertices only ever collapse onto existing ones, so
+// the result indexes the same vertices. Vertices on borders and texture seams stay fixed. error receives the largest
+// collapse error as a distance in model units.
+std::vector<uint32_t> SimplifyMesh(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, size_t targetIndexCount, float* error = nullptr);
+
+// Appends up to levelCount - 1 coarser levels of every shape to the mesh's indices and shapes, each with half the
+// triangles of the one before, and fills lodErrors. Stops early once a level no longer removes a tenth of the triangles.
+void BuildLodChain(ObjMesh& mesh, uint32_t levelCount);
@@ -0,0 +1,564 @@
+#include "MipGenerator.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_SSE2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MIP_TARGET_AVX2
+#else
+#define MIP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MIP_NEON 1
+#include <arm_neon.h>
+#endif
+
+static const int MAX_TAPS = 12;
+
+// Texels replicated on either side of a decoded row, so the horizontal pass never has to clamp.
+static const uint32_t ROW_PADDING = 6;
+
+// Levels are split into bands of at least this many rows; each band re-filters the source rows its kernel overlaps.
+static const uint32_t MIN_BAND_ROWS = 32;
+
+// Output texel x of a level is the weighted sum of source texels 2x + first ... 2x + first + taps - 1, in both directions.
+struct MipKernel {
+	int first = 0;
+	int taps = 0;
+	float weights[MAX_TAPS] = {};
+};
+
+struct SRGBTables {
+	// sRGB to linear for the 256 color values, followed by the 256 alpha values scaled to [0, 1].
+	float decode[512];
+	// Linear color quantized to 12 bits back to sRGB, 32-bit wide so it can be gathered.
+	uint32_t encode[4096];
+
+	SRGBTables() {
+		for (int i = 0; i < 256; i++) {
+			float value = i / 255.0f;
+			this->decode[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			this->decode[256 + i] = value;
+		}
+
+		for (int i = 0; i < 4096; i++) {
+			float value = i / 4095.0f;
+			value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+			this->encode[i] = static_cast<uint32_t>(std::lround(value * 255.0f));
+		}
+	}
+};
+
+static const SRGBTables& GetSRGBTables() {
+	static const SRGBTables tables;
+	return tables;
+}
+
+// Every kernel computes each output value as ((0 + w0 * x0) + w1 * x1) + ..., without fused multiply-adds, so all
+// instruction sets produce bit-identical levels.
+struct MipKernels {
+	void (*decodeRow)(const uint8_t* source, float* destination, uint32_t width);
+	void (*filterRow)(const float* source, float* destination, uint32_t width, const MipKernel& kernel);
+	void (*filterColumn)(const float* const* rows, const MipKernel& kernel, float* destination, size_t count);
+	void (*encodeRow)(const float* source, uint8_t* destination, uint32_t width);
+};
+
+static double BesselI0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (int k = 1; k < 32; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+static MipKernel CreateKernel(MipFilter filter) {
+	MipKernel kernel = {};
+
+	if (filter == MipFilter::Box) {
+		kernel.first = 0;
+		kernel.taps = 2;
+		kernel.weights[0] = 0.5f;
+		kernel.weights[1] = 0.5f;
+		return kernel;
+	}
+
+	// Sinc cut off at the destination's Nyquist frequency, windowed to 3 destination texels with alpha 4.
+	const double width = 3.0;
+	const double alpha = 4.0;
+	const double pi = 3.14159265358979323846;
+
+	kernel.first = -5;
+	kernel.taps = 12;
+
+	double weights[MAX_TAPS] = {};
+	double sum = 0.0;
+
+	for (int k = 0; k < kernel.taps; k++) {
+		// Distance from the output texel's center, in destination texels. Never zero for a 2:1 reduction.
+		double distance = (kernel.first + k - 0.5) / 2.0;
+		double t = distance / width;
+
+		weights[k] = std::sin(pi * distance) / (pi * distance) * BesselI0(alpha * std::sqrt(std::max(0.0, 1.0 - t * t))) / BesselI0(alpha);
+		sum += weights[k];
+	}
+
+	for (int k = 0; k < kernel.taps; k++) {
+		kernel.weights[k] = static_cast<float>(weights[k] / sum);
+	}
+
+	return kernel;
+}
+
+static inline void DecodeTexel(const SRGBTables& tables, const uint8_t* source, float* destination) {
+	destination[0] = tables.decode[source[0]];
+	destination[1] = tables.decode[source[1]];
+	destination[2] = tables.decode[source[2]];
+	destination[3] = tables.decode[256 + source[3]];
+}
+
+static inline void EncodeTexel(const SRGBTables& tables, const float* source, uint8_t* destination) {
+	for (int c = 0; c < 4; c++) {
+		float value = std::min(std::max(source[c], 0.0f), 1.0f);
+
+		if (c < 3) {
+			destination[c] = static_cast<uint8_t>(tables.encode[static_cast<int32_t>(value * 4095.0f + 0.5f)]);
+		}
+		else {
+			destination[c] = static_cast<uint8_t>(static_cast<int32_t>(value * 255.0f + 0.5f));
+		}
+	}
+}
+
+static void DecodeRowScalar(const uint8_t* source, float* destination, uint32_t width) {
+	const SRGBTables& tables = GetSRGBTables();
+
+	for (size_t x = 0; x < width; x++) {
+		DecodeTexel(tables, source + x * 4, destination + x * 4);
+	}
+}
+
+static void FilterRowScalar(const float* source, float* destination, uint32_t width, const MipKernel& kernel) {
+	for (size_t x = 0; x < width; x++) {
+		const float* base = source + (2 * static_cast<ptrdiff_t>(x) + kernel.first) * 4;
+		float sum[4] = {};
+
+		for (int k = 0; k < kernel.taps; k++) {
+			for (int c = 0; c < 4; c++) {
+				sum[c] += kernel.weights[k] * base[k * 4 + c];
+			}
+		}
+
+		memcpy(destination + x * 4, sum, sizeof(sum));
+	}
+}
+
+static void FilterColumnScalar(const float* const* rows, const MipKernel& kernel, float* destination, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		float sum = 0.0f;
+
+		for (int k = 0; k < kernel.taps; k++) {
+			sum += kernel.weights[k] * rows[k][i];
+		}
+
+		destination[i] = sum;
+	}
+}
+
+static void EncodeRowScalar(const float* source, uint8_t* destination, uint32_t width) {
+	const SRGBTables& tables = GetSRGBTables();
+
+	for (size_t x = 0; x < width; x++) {
+		EncodeTexel(tables, source + x * 4, destination + x * 4);
+	}
+}
+
+#ifdef MIP_SSE2
+// One RGBA texel per register. The table lookups of decoding have no SSE2 equivalent and stay scalar.
+static void FilterRowSSE2(const float* source, float* destination, uint32_t width, const MipKernel& kernel) {
+	for (size_t x = 0; x < width; x++) {
+		const float* base = source + (2 * static_cast<ptrdiff_t>(x) + kernel.first) * 4;
+		__m128 sum = _mm_setzero_ps();
+
+		for (int k = 0; k < kernel.taps; k++) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(base + k * 4)));
+		}
+
+		_mm_storeu_ps(destination + x * 4, sum);
+	}
+}
+
+static void FilterColumnSSE2(const float* const* rows, const MipKernel& kernel, float* destination, size_t count) {
+	for (size_t i = 0; i < count; i += 4) {
+		__m128 sum = _mm_setzero_ps();
+
+		for (int k = 0; k < kernel.taps; k++) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(rows[k] + i)));
+		}
+
+		_mm_storeu_ps(destination + i, sum);
+	}
+}
+
+static void EncodeRowSSE2(const float* source, uint8_t* destination, uint32_t width) {
+	const SRGBTables& tables = GetSRGBTables();
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 scale = _mm_setr_ps(4095.0f, 4095.0f, 4095.0f, 255.0f);
+
+	alignas(16) int32_t indices[4];
+
+	for (size_t x = 0; x < width; x++) {
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + x * 4), zero), one);
+		_mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), half)));
+
+		uint8_t* texel = destination + x * 4;
+		texel[0] = static_cast<uint8_t>(tables.encode[indices[0]]);
+		texel[1] = static_cast<uint8_t>(tables.encode[indices[1]]);
+		texel[2] = static_cast<uint8_t>(tables.encode[indices[2]]);
+		texel[3] = static_cast<uint8_t>(indices[3]);
+	}
+}
+
+// Two RGBA texels per register, with the sRGB tables read through gathers.
+MIP_TARGET_AVX2 static void DecodeRowAVX2(const uint8_t* source, float* destination, uint32_t width) {
+	const SRGBTables& tables = GetSRGBTables();
+	const __m256i alphaOffset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+
+	size_t x = 0;
+
+	for (; x + 2 <= width; x += 2) {
+		__m256i indices = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + x * 4))), alphaOffset);
+		_mm256_storeu_ps(destination + x * 4, _mm256_i32gather_ps(tables.decode, indices, 4));
+	}
+
+	for (; x < width; x++) {
+		DecodeTexel(tables, source + x * 4, destination + x * 4);
+	}
+}
+
+MIP_TARGET_AVX2 static void FilterRowAVX2(const float* source, float* destination, uint32_t width, const MipKernel& kernel) {
+	size_t x = 0;
+
+	for (; x + 2 <= width; x += 2) {
+		const float* base = source + (2 * static_cast<ptrdiff_t>(x) + kernel.first) * 4;
+		__m256 sum = _mm256_setzero_ps();
+
+		// The second output texel reads the same taps two source texels further on.
+		for (int k = 0; k < kernel.taps; k++) {
+			__m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(base + k * 4)), _mm_loadu_ps(base + (k + 2) * 4), 1);
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel.weights[k]), texels));
+		}
+
+		_mm256_storeu_ps(destination + x * 4, sum);
+	}
+
+	if (x < width) {
+		FilterRowSSE2(source + x * 2 * 4, destination + x * 4, 1, kernel);
+	}
+}
+
+MIP_TARGET_AVX2 static void FilterColumnAVX2(const float* const* rows, const MipKernel& kernel, float* destination, size_t count) {
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 sum = _mm256_setzero_ps();
+
+		for (int k = 0; k < kernel.taps; k++) {
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel.weights[k]), _mm256_loadu_ps(rows[k] + i)));
+		}
+
+		_mm256_storeu_ps(destination + i, sum);
+	}
+
+	if (i < count) {
+		const float* tail[MAX_TAPS];
+
+		for (int k = 0; k < kernel.taps; k++) {
+			tail[k] = rows[k] + i;
+		}
+
+		FilterColumnSSE2(tail, kernel, destination + i, count - i);
+	}
+}
+
+MIP_TARGET_AVX2 static void EncodeRowAVX2(const float* source, uint8_t* destination, uint32_t width) {
+	const SRGBTables& tables = GetSRGBTables();
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 scale = _mm256_setr_ps(4095.0f, 4095.0f, 4095.0f, 255.0f, 4095.0f, 4095.0f, 4095.0f, 255.0f);
+
+	size_t x = 0;
+
+	for (; x + 2 <= width; x += 2) {
+		__m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + x * 4), zero), one);
+		__m256i indices = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, scale), half));
+
+		// Alpha lanes are already 0-255 and keep their index instead of the gathered value.
+		__m256i texels = _mm256_blend_epi32(_mm256_i32gather_epi32(reinterpret_cast<const int*>(tables.encode), indices, 4), indices, 0x88);
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(texels), _mm256_extracti128_si256(texels, 1));
+
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(destination + x * 4), _mm_packus_epi16(packed, packed));
+	}
+
+	for (; x < width; x++) {
+		EncodeTexel(tables, source + x * 4, destination + x * 4);
+	}
+}
+
+static bool CPUSupportsAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+
+	if (info[0] < 7) {
+		return false;
+	}
+
+	// AVX state has to be enabled by the OS (OSXSAVE and XCR0) for the 256-bit registers to be usable.
+	__cpuid(info, 1);
+
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef MIP_NEON
+static void FilterRowNEON(const float* source, float* destination, uint32_t width, const MipKernel& kernel) {
+	for (size_t x = 0; x < width; x++) {
+		const float* base = source + (2 * static_cast<ptrdiff_t>(x) + kernel.first) * 4;
+		float32x4_t sum = vdupq_n_f32(0.0f);
+
+		for (int k = 0; k < kernel.taps; k++) {
+			sum = vaddq_f32(sum, vmulq_n_f32(vld1q_f32(base + k * 4), kernel.weights[k]));
+		}
+
+		vst1q_f32(destination + x * 4, sum);
+	}
+}
+
+static void FilterColumnNEON(const float* const* rows, const MipKernel& kernel, float* destination, size_t count) {
+	for (size_t i = 0; i < count; i += 4) {
+		float32x4_t sum = vdupq_n_f32(0.0f);
+
+		for (int k = 0; k < kernel.taps; k++) {
+			sum = vaddq_f32(sum, vmulq_n_f32(vld1q_f32(rows[k] + i), kernel.weights[k]));
+		}
+
+		vst1q_f32(destination + i, sum);
+	}
+}
+
+static void EncodeRowNEON(const float* source, uint8_t* destination, uint32_t width) {
+	const SRGBTables& tables = GetSRGBTables();
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	const float32x4_t half = vdupq_n_f32(0.5f);
+	const float scaleValues[4] = { 4095.0f, 4095.0f, 4095.0f, 255.0f };
+	const float32x4_t scale = vld1q_f32(scaleValues);
+
+	int32_t indices[4];
+
+	for (size_t x = 0; x < width; x++) {
+		float32x4_t value = vminq_f32(vmaxq_f32(vld1q_f32(source + x * 4), zero), one);
+		vst1q_s32(indices, vcvtq_s32_f32(vaddq_f32(vmulq_f32(value, scale), half)));
+
+		uint8_t* texel = destination + x * 4;
+		texel[0] = static_cast<uint8_t>(tables.encode[indices[0]]);
+		texel[1] = static_cast<uint8_t>(tables.encode[indices[1]]);
+		texel[2] = static_cast<uint8_t>(tables.encode[indices[2]]);
+		texel[3] = static_cast<uint8_t>(indices[3]);
+	}
+}
+#endif
+
+static MipKernels GetMipKernels(MipInstructionSet instructionSet) {
+	MipKernels kernels = { DecodeRowScalar, FilterRowScalar, FilterColumnScalar, EncodeRowScalar };
+
+#ifdef MIP_SSE2
+	if (instructionSet == MipInstructionSet::SSE2) {
+		kernels = { DecodeRowScalar, FilterRowSSE2, FilterColumnSSE2, EncodeRowSSE2 };
+	}
+	else if (instructionSet == MipInstructionSet::AVX2) {
+		kernels = { DecodeRowAVX2, FilterRowAVX2, FilterColumnAVX2, EncodeRowAVX2 };
+	}
+#endif
+
+#ifdef MIP_NEON
+	if (instructionSet == MipInstructionSet::NEON) {
+		kernels = { DecodeRowScalar, FilterRowNEON, FilterColumnNEON, EncodeRowNEON };
+	}
+#endif
+
+	return kernels;
+}
+
+uint32_t GetMipLevelCount(uint32_t width, uint32_t height) {
+	uint32_t levels = 1;
+
+	for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+		levels++;
+	}
+
+	return levels;
+}
+
+bool IsMipInstructionSetSupported(MipInstructionSet instructionSet) {
+	switch (instructionSet) {
+	case MipInstructionSet::Scalar:
+		return true;
+#ifdef MIP_SSE2
+	case MipInstructionSet::SSE2:
+		return true;
+	case MipInstructionSet::AVX2: {
+		static const bool supported = CPUSupportsAVX2();
+		return supported;
+	}
+#endif
+#ifdef MIP_NEON
+	case MipInstructionSet::NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+MipInstructionSet GetBestMipInstructionSet() {
+	const MipInstructionSet candidates[] = { MipInstructionSet::AVX2, MipInstructionSet::NEON, MipInstructionSet::SSE2 };
+
+	for (MipInstructionSet candidate : candidates) {
+		if (IsMipInstructionSetSupported(candidate)) {
+			return candidate;
+		}
+	}
+
+	return MipInstructionSet::Scalar;
+}
+
+const char* GetMipInstructionSetName(MipInstructionSet instructionSet) {
+	switch (instructionSet) {
+	case MipInstructionSet::SSE2:
+		return "SSE2";
+	case MipInstructionSet::AVX2:
+		return "AVX2";
+	case MipInstructionSet::NEON:
+		return "NEON";
+	default:
+		return "scalar";
+	}
+}
+
+const char* GetMipFilterName(MipFilter filter) {
+	return filter == MipFilter::Kaiser ? "Kaiser" : "box";
+}
+
+// Filters destination rows [firstRow, endRow) of one level from the level above it.
+static void DownsampleBand(const MipKernels& kernels, const MipKernel& kernel, const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight,
+	uint8_t* destination, uint32_t width, uint32_t firstRow, uint32_t endRow) {
+	size_t rowFloats = static_cast<size_t>(width) * 4;
+	int64_t firstSourceRow = 2 * static_cast<int64_t>(firstRow) + kernel.first;
+	size_t sourceRowCount = 2 * static_cast<size_t>(endRow - firstRow - 1) + kernel.taps;
+
+	std::vector<float> decoded((static_cast<size_t>(sourceWidth) + 2 * ROW_PADDING) * 4);
+	std::vector<float> filtered(sourceRowCount * rowFloats);
+	std::vector<float> column(rowFloats);
+
+	float* decodedRow = decoded.data() + ROW_PADDING * 4;
+
+	// Horizontal pass over every source row the band's vertical taps touch, repeating the edge rows and columns.
+	for (size_t r = 0; r < sourceRowCount; r++) {
+		int64_t y = std::min<int64_t>(std::max<int64_t>(firstSourceRow + static_cast<int64_t>(r), 0), sourceHeight - 1);
+
+		kernels.decodeRow(source + static_cast<size_t>(y) * sourceWidth * 4, decodedRow, sourceWidth);
+
+		for (uint32_t p = 0; p < ROW_PADDING; p++) {
+			memcpy(decoded.data() + p * 4, decodedRow, 4 * sizeof(float));
+			memcpy(decodedRow + (static_cast<size_t>(sourceWidth) + p) * 4, decodedRow + (static_cast<size_t>(sourceWidth) - 1) * 4, 4 * sizeof(float));
+		}
+
+		kernels.filterRow(decodedRow, filtered.data() + r * rowFloats, width, kernel);
+	}
+
+	const float* rows[MAX_TAPS];
+
+	for (uint32_t y = firstRow; y < endRow; y++) {
+		for (int k = 0; k < kernel.taps; k++) {
+			rows[k] = filtered.data() + (2 * static_cast<size_t>(y - firstRow) + k) * rowFloats;
+		}
+
+		kernels.filterColumn(rows, kernel, column.data(), rowFloats);
+		kernels.encodeRow(column.data(), destination + y * rowFloats, width);
+	}
+}
+
+MipChain GenerateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, unsigned threadCount, MipInstructionSet instructionSet) {
+	if (!IsMipInstructionSetSupported(instructionSet)) {
+		throw std::runtime_error(std::string("Mipmap generation is not supported with ") + GetMipInstructionSetName(instructionSet) + " on this CPU.");
+	}
+
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	MipChain chain;
+	chain.levels.resize(GetMipLevelCount(width, height));
+
+	size_t offset = 0;
+
+	for (MipLevel& level : chain.levels) {
+		level.width = width;
+		level.height = height;
+		level.offset = offset;
+		level.size = static_cast<size_t>(width) * height * 4;
+
+		offset = (offset + level.size + 15) / 16 * 16;
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+
+	chain.data.resize(chain.levels.back().offset + chain.levels.back().size);
+	memcpy(chain.data.data(), pixels, chain.levels[0].size);
+
+	MipKernels kernels = GetMipKernels(instructionSet);
+	MipKernel kernel = CreateKernel(filter);
+
+	for (size_t i = 1; i < chain.levels.size(); i++) {
+		const MipLevel& source = chain.levels[i - 1];
+		const MipLevel& level = chain.levels[i];
+
+		// A few bands per thread so uneven scheduling still balances out.
+		uint32_t bandRows = std::max(MIN_BAND_ROWS, (level.height + threadCount * 4 - 1) / (threadCount * 4));
+		size_t bandCount = (level.height + bandRows - 1) / bandRows;
+
+		ParallelFor(bandCount, threadCount, [&](size_t band) {
+			uint32_t firstRow = static_cast<uint32_t>(band) * bandRows;
+			uint32_t endRow = std::min(level.height, firstRow + bandRows);
+
+			DownsampleBand(kernels, kernel, chain.data.data() + source.offset, source.width, source.height, chain.data.data() + level.offset, level.width, firstRow, endRow);
+		});
+	}
+
+	return chain;
+}
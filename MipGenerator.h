@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class MipFilter {
+	// 2x2 average, the same footprint as a linear blit.
+	Box,
+	// Separable Kaiser-windowed sinc over 12 source texels, sharper and with less aliasing than the box.
+	Kaiser,
+};
+
+enum class MipInstructionSet {
+	Scalar,
+	SSE2,
+	AVX2,
+	NEON,
+};
+
+struct MipLevel {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	size_t offset = 0;
+	size_t size = 0;
+};
+
+// Every level of an RGBA8 image back to back, level 0 first, each starting on a 16-byte boundary so the whole
+// chain can be copied into one staging buffer and uploaded with one region per level.
+struct MipChain {
+	std::vector<MipLevel> levels;
+	std::vector<uint8_t> data;
+};
+
+uint32_t GetMipLevelCount(uint32_t width, uint32_t height);
+
+// The widest instruction set this build and CPU support.
+MipInstructionSet GetBestMipInstructionSet();
+bool IsMipInstructionSetSupported(MipInstructionSet instructionSet);
+const char* GetMipInstructionSetName(MipInstructionSet instructionSet);
+const char* GetMipFilterName(MipFilter filter);
+
+// Builds the full mip chain of an sRGB RGBA8 image on the CPU. Color is filtered in linear space and alpha as is.
+// Each level is split into row bands that run on up to threadCount threads (0 uses all hardware threads); levels
+// smaller than one band are done in a single task. Throws if the instruction set is not supported.
+MipChain GenerateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter = MipFilter::Box, unsigned threadCount = 0,
+	MipInstructionSet instructionSet = GetBestMipInstructionSet());
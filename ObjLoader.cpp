@@ -0,0 +1,480 @@
+#include "ObjLoader.h"
+#include "VertexWeld.h"
+#include "Benchmark.h"
+#include "Parallel.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+// Files smaller than this per chunk are not worth splitting further.
+static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+// Vertices are spread over 2^SHARD_BITS hash tables, each owned by a single thread while deduplicating.
+static const uint32_t SHARD_BITS = 6;
+static const uint32_t SHARD_COUNT = 1u << SHARD_BITS;
+
+struct ObjChunk {
+	const char* begin = nullptr;
+	const char* end = nullptr;
+
+	std::vector<float> positions;
+	std::vector<float> texCoords;
+
+	// Position/texcoord index pairs of every triangle corner, 0-based, -1 for a missing texcoord. Negative file indices
+	// count back from the vertices parsed so far; they are stored relative to the chunk and listed for a fix-up once its base is known.
+	std::vector<int32_t> corners;
+	std::vector<size_t> relativeIndices;
+
+	// Corner offset and name of every `o`/`g` line.
+	std::vector<std::pair<size_t, std::string>> shapeStarts;
+
+	uint32_t positionBase = 0;
+	uint32_t texCoordBase = 0;
+	size_t cornerBase = 0;
+	uint32_t firstUseBase = 0;
+
+	std::vector<std::vector<uint32_t>> shardCorners;
+};
+
+struct VertexShard {
+	VertexWeldTable table;
+	std::vector<uint32_t> globalIndices;
+};
+
+static std::vector<char> ReadObjFile(const std::string& fileName) {
+	std::ifstream file(fileName, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("Could not open file " + fileName);
+	}
+
+	size_t size = static_cast<size_t>(file.tellg());
+	std::vector<char> buffer(size);
+
+	file.seekg(0);
+	file.read(buffer.data(), size);
+
+	return buffer;
+}
+
+static bool IsLineSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* SkipSpaces(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+
+	return p;
+}
+
+static const char* ParseFloat(const char* p, const char* end, float& value) {
+	p = SkipSpaces(p, end);
+
+	if (p < end && *p == '+') {
+		p++;
+	}
+
+	value = 0.0f;
+	return std::from_chars(p, end, value).ptr;
+}
+
+static const char* ParseIndex(const char* p, const char* end, int32_t& value) {
+	if (p < end && *p == '+') {
+		p++;
+	}
+
+	value = 0;
+	return std::from_chars(p, end, value).ptr;
+}
+
+static void AddIndex(ObjChunk& chunk, int32_t index, size_t count) {
+	if (index > 0) {
+		chunk.corners.push_back(index - 1);
+	}
+	else if (index < 0) {
+		chunk.relativeIndices.push_back(chunk.corners.size());
+		chunk.corners.push_back(static_cast<int32_t>(count) + index);
+	}
+	else {
+		chunk.corners.push_back(-1);
+	}
+}
+
+static void ParseObjChunk(ObjChunk& chunk) {
+	std::vector<std::pair<int32_t, int32_t>> polygon;
+	const char* p = chunk.begin;
+
+	while (p < chunk.end) {
+		const char* lineEnd = static_cast<const char*>(memchr(p, '\n', chunk.end - p));
+
+		if (lineEnd == nullptr) {
+			lineEnd = chunk.end;
+		}
+
+		const char* c = SkipSpaces(p, lineEnd);
+		size_t length = lineEnd - c;
+
+		if (length >= 2 && c[0] == 'v' && IsLineSpace(c[1])) {
+			float x, y, z;
+			c = ParseFloat(c + 1, lineEnd, x);
+			c = ParseFloat(c, lineEnd, y);
+			ParseFloat(c, lineEnd, z);
+
+			chunk.positions.insert(chunk.positions.end(), { x, y, z });
+		}
+		else if (length >= 3 && c[0] == 'v' && c[1] == 't' && IsLineSpace(c[2])) {
+			float u, v;
+			c = ParseFloat(c + 2, lineEnd, u);
+			ParseFloat(c, lineEnd, v);
+
+			chunk.texCoords.insert(chunk.texCoords.end(), { u, v });
+		}
+		else if (length >= 2 && c[0] == 'f' && IsLineSpace(c[1])) {
+			// f v, f v/t, f v//n or f v/t/n. Polygons are fanned into triangles like tinyobjloader does.
+			polygon.clear();
+			c++;
+
+			while (true) {
+				c = SkipSpaces(c, lineEnd);
+
+				if (c >= lineEnd || *c == '\r') {
+					break;
+				}
+
+				int32_t position = 0;
+				int32_t texCoord = 0;
+				c = ParseIndex(c, lineEnd, position);
+
+				if (c < lineEnd && *c == '/') {
+					c++;
+
+					if (c < lineEnd && *c != '/') {
+						c = ParseIndex(c, lineEnd, texCoord);
+					}
+				}
+
+				while (c < lineEnd && !IsLineSpace(*c)) {
+					c++;
+				}
+
+				polygon.push_back({ position, texCoord });
+			}
+
+			for (size_t i = 2; i < polygon.size(); i++) {
+				for (size_t corner : { (size_t)0, i - 1, i }) {
+					AddIndex(chunk, polygon[corner].first, chunk.positions.size() / 3);
+					AddIndex(chunk, polygon[corner].second, chunk.texCoords.size() / 2);
+				}
+			}
+		}
+		else if (length >= 2 && (c[0] == 'o' || c[0] == 'g') && IsLineSpace(c[1])) {
+			const char* nameBegin = SkipSpaces(c + 1, lineEnd);
+			const char* nameEnd = lineEnd;
+
+			while (nameEnd > nameBegin && IsLineSpace(nameEnd[-1])) {
+				nameEnd--;
+			}
+
+			chunk.shapeStarts.push_back({ chunk.corners.size() / 2, std::string(nameBegin, nameEnd) });
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+static Vertex MakeVertex(const std::vector<float>& positions, const std::vector<float>& texCoords, int32_t position, int32_t texCoord) {
+	Vertex vertex = {};
+
+	vertex.position = {
+		positions[3 * position + 0],
+		positions[3 * position + 1],
+		positions[3 * position + 2],
+	};
+
+	if (texCoord >= 0) {
+		vertex.texCoord = {
+			texCoords[2 * texCoord + 0],
+			1.0f - texCoords[2 * texCoord + 1],
+		};
+	}
+	else {
+		vertex.texCoord = { 0.0f, 1.0f };
+	}
+
+	vertex.color = { 1.0f, 1.0f, 1.0f };
+
+	return vertex;
+}
+
+static uint32_t ShardOf(const Vertex& vertex) {
+	// The top bits, so the shard does not correlate with the slot a weld table picks from the low bits.
+	return static_cast<uint32_t>(HashVertex(vertex) >> (64 - SHARD_BITS));
+}
+
+ObjMesh LoadObjReference(const std::string& fileName) {
+	tinyobj::attrib_t attrib;
+
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fileName.c_str())) {
+		throw std::runtime_error("Could not load model " + fileName + ": " + warn + err);
+	}
+
+	ObjMesh mesh;
+	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+
+	for (const tinyobj::shape_t& shape : shapes) {
+		mesh.shapes.push_back({ shape.name, static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(shape.mesh.indices.size()) });
+
+		for (const tinyobj::index_t& index : shape.mesh.indices) {
+			Vertex vertex = MakeVertex(attrib.vertices, attrib.texcoords, index.vertex_index, index.texcoord_index);
+
+			if (uniqueVertices.count(vertex) == 0) {
+				uniqueVertices[vertex] = static_cast<uint32_t>(mesh.vertices.size());
+				mesh.vertices.push_back(vertex);
+			}
+
+			mesh.indices.push_back(uniqueVertices[vertex]);
+		}
+	}
+
+	return mesh;
+}
+
+ObjMesh LoadObjParallel(const std::string& fileName, unsigned threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	std::vector<char> data = ReadObjFile(fileName);
+	const char* begin = data.data();
+	const char* end = begin + data.size();
+
+	// A few chunks per thread so that files with uneven sections still balance out.
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount * 4, data.size() / MIN_CHUNK_SIZE));
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* chunkBegin = begin;
+
+	for (size_t i = 0; i < chunkCount; i++) {
+		const char* chunkEnd = end;
+
+		if (i + 1 < chunkCount) {
+			chunkEnd = std::max(chunkBegin, begin + data.size() * (i + 1) / chunkCount);
+			const char* newline = static_cast<const char*>(memchr(chunkEnd, '\n', end - chunkEnd));
+			chunkEnd = newline != nullptr ? newline + 1 : end;
+		}
+
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	ParallelFor(chunkCount, threadCount, [&](size_t i) {
+		ParseObjChunk(chunks[i]);
+	});
+
+	size_t positionCount = 0;
+	size_t texCoordCount = 0;
+	size_t cornerCount = 0;
+
+	for (ObjChunk& chunk : chunks) {
+		chunk.positionBase = static_cast<uint32_t>(positionCount);
+		chunk.texCoordBase = static_cast<uint32_t>(texCoordCount);
+		chunk.cornerBase = cornerCount;
+
+		positionCount += chunk.positions.size() / 3;
+		texCoordCount += chunk.texCoords.size() / 2;
+		cornerCount += chunk.corners.size() / 2;
+	}
+
+	if (cornerCount > UINT32_MAX) {
+		throw std::runtime_error("Model " + fileName + " has too many indices.");
+	}
+
+	std::vector<float> positions(positionCount * 3);
+	std::vector<float> texCoords(texCoordCount * 2);
+
+	ParallelFor(chunkCount, threadCount, [&](size_t i) {
+		ObjChunk& chunk = chunks[i];
+
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase * 3);
+		std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + chunk.texCoordBase * 2);
+
+		for (size_t relative : chunk.relativeIndices) {
+			chunk.corners[relative] += relative % 2 == 0 ? chunk.positionBase : chunk.texCoordBase;
+		}
+
+		for (size_t c = 0; c < chunk.corners.size(); c += 2) {
+			if (chunk.corners[c] < 0 || chunk.corners[c] >= static_cast<int32_t>(positionCount) || chunk.corners[c + 1] >= static_cast<int32_t>(texCoordCount)) {
+				throw std::runtime_error("Invalid vertex index in model " + fileName);
+			}
+
+			if (chunk.corners[c + 1] < 0) {
+				chunk.corners[c + 1] = -1;
+			}
+		}
+	});
+
+	// Every corner is assigned to a shard by the hash of its vertex, then each shard is deduplicated by one thread,
+	// walking its corners in file order so that first uses can be numbered globally afterwards.
+	std::vector<uint8_t> cornerShard(cornerCount);
+	std::vector<uint32_t> cornerSlot(cornerCount);
+	std::vector<uint8_t> firstUse(cornerCount, 0);
+
+	ParallelFor(chunkCount, threadCount, [&](size_t i) {
+		ObjChunk& chunk = chunks[i];
+		chunk.shardCorners.resize(SHARD_COUNT);
+
+		for (size_t c = 0; c < chunk.corners.size() / 2; c++) {
+			uint32_t shard = ShardOf(MakeVertex(positions, texCoords, chunk.corners[2 * c], chunk.corners[2 * c + 1]));
+
+			cornerShard[chunk.cornerBase + c] = static_cast<uint8_t>(shard);
+			chunk.shardCorners[shard].push_back(static_cast<uint32_t>(c));
+		}
+	});
+
+	std::vector<VertexShard> shards(SHARD_COUNT);
+
+	ParallelFor(SHARD_COUNT, threadCount, [&](size_t s) {
+		VertexShard& shard = shards[s];
+		size_t shardCornerCount = 0;
+
+		for (const ObjChunk& chunk : chunks) {
+			shardCornerCount += chunk.shardCorners[s].size();
+		}
+
+		shard.table.Reserve(shardCornerCount);
+
+		for (const ObjChunk& chunk : chunks) {
+			for (uint32_t c : chunk.shardCorners[s]) {
+				Vertex vertex = MakeVertex(positions, texCoords, chunk.corners[2 * c], chunk.corners[2 * c + 1]);
+				std::pair<uint32_t, bool> result = shard.table.Insert(vertex);
+
+				cornerSlot[chunk.cornerBase + c] = result.first;
+
+				if (result.second) {
+					firstUse[chunk.cornerBase + c] = 1;
+				}
+			}
+		}
+
+		shard.globalIndices.resize(shard.table.Size());
+	});
+
+	ParallelFor(chunkCount, threadCount, [&](size_t i) {
+		ObjChunk& chunk = chunks[i];
+		chunk.firstUseBase = 0;
+
+		for (size_t c = 0; c < chunk.corners.size() / 2; c++) {
+			chunk.firstUseBase += firstUse[chunk.cornerBase + c];
+		}
+	});
+
+	uint32_t vertexCount = 0;
+
+	for (ObjChunk& chunk : chunks) {
+		uint32_t count = chunk.firstUseBase;
+		chunk.firstUseBase = vertexCount;
+		vertexCount += count;
+	}
+
+	ObjMesh mesh;
+	mesh.vertices.resize(vertexCount);
+	mesh.indices.resize(cornerCount);
+
+	ParallelFor(chunkCount, threadCount, [&](size_t i) {
+		const ObjChunk& chunk = chunks[i];
+		uint32_t index = chunk.firstUseBase;
+
+		for (size_t c = 0; c < chunk.corners.size() / 2; c++) {
+			size_t corner = chunk.cornerBase + c;
+
+			if (firstUse[corner]) {
+				mesh.vertices[index] = MakeVertex(positions, texCoords, chunk.corners[2 * c], chunk.corners[2 * c + 1]);
+				shards[cornerShard[corner]].globalIndices[cornerSlot[corner]] = index;
+				index++;
+			}
+		}
+	});
+
+	ParallelFor(chunkCount, threadCount, [&](size_t i) {
+		const ObjChunk& chunk = chunks[i];
+
+		for (size_t c = 0; c < chunk.corners.size() / 2; c++) {
+			size_t corner = chunk.cornerBase + c;
+			mesh.indices[corner] = shards[cornerShard[corner]].globalIndices[cornerSlot[corner]];
+		}
+	});
+
+	// Shapes are contiguous in file order; groups that never received a face are dropped.
+	std::vector<std::pair<size_t, std::string>> shapeStarts = { { 0, "" } };
+
+	for (const ObjChunk& chunk : chunks) {
+		for (const std::pair<size_t, std::string>& start : chunk.shapeStarts) {
+			shapeStarts.push_back({ chunk.cornerBase + start.first, start.second });
+		}
+	}
+
+	for (size_t i = 0; i < shapeStarts.size(); i++) {
+		size_t first = shapeStarts[i].first;
+		size_t last = i + 1 < shapeStarts.size() ? shapeStarts[i + 1].first : cornerCount;
+
+		if (last > first) {
+			mesh.shapes.push_back({ shapeStarts[i].second, static_cast<uint32_t>(first), static_cast<uint32_t>(last - first) });
+		}
+	}
+
+	return mesh;
+}
+
+void BenchmarkObjLoaders(const std::string& fileName, size_t runs) {
+	std::vector<double> referenceMs;
+	std::vector<double> parallelMs;
+
+	ObjMesh reference;
+	ObjMesh parallel;
+
+	for (size_t i = 0; i < runs; i++) {
+		std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+		reference = LoadObjReference(fileName);
+		referenceMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
+
+		startTime = std::chrono::high_resolution_clock::now();
+		parallel = LoadObjParallel(fileName);
+		parallelMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
+	}
+
+	BenchmarkStats referenceStats = ComputeBenchmarkStats(referenceMs);
+	BenchmarkStats parallelStats = ComputeBenchmarkStats(parallelMs);
+
+	float maxDifference = 0.0f;
+	bool match = reference.indices == parallel.indices && reference.vertices.size() == parallel.vertices.size();
+
+	for (size_t i = 0; match && i < reference.vertices.size(); i++) {
+		glm::vec3 position = glm::abs(reference.vertices[i].position - parallel.vertices[i].position);
+		glm::vec2 texCoord = glm::abs(reference.vertices[i].texCoord - parallel.vertices[i].texCoord);
+
+		maxDifference = std::max({ maxDifference, position.x, position.y, position.z, texCoord.x, texCoord.y });
+	}
+
+	std::cout << "OBJ loading: " << fileName << ", " << runs << " runs, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+	std::cout << "  tinyobj:  mean " << referenceStats.mean << " ms, p50 " << referenceStats.p50 << " ms, max " << referenceStats.max << " ms" << std::endl;
+	std::cout << "  parallel: mean " << parallelStats.mean << " ms, p50 " << parallelStats.p50 << " ms, max " << parallelStats.max << " ms" << std::endl;
+	std::cout << "  speedup " << (referenceStats.mean / parallelStats.mean) << "x, " << parallel.vertices.size() << " vertices, " << (parallel.indices.size() / 3) << " triangles, "
+		<< (match ? "results match" : "results differ") << " (max attribute difference " << maxDifference << ")" << std::endl;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Vertex.h"
+#include <string>
+
+// A contiguous range of the merged index buffer that came from one `o`/`g` group of the file.
+struct ObjShape {
+	std::string name;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+};
+
+const uint32_t MAX_LOD_LEVELS = 8;
+
+struct ObjMesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<ObjShape> shapes;
+	// Geometric error of every level of detail, in model units; empty or { 0 } for the loaded mesh alone. With more
+	// levels, shapes holds each level's ranges in turn, level 0 first.
+	std::vector<float> lodErrors;
+};
+
+// Single-threaded tinyobjloader path, kept as the baseline for BenchmarkObjLoaders.
+ObjMesh LoadObjReference(const std::string& fileName);
+
+// Parses the file in line-aligned chunks on every core and deduplicates vertices in a sharded hash table.
+// Vertices come out in order of first use, like the reference loader. threadCount 0 uses all hardware threads.
+ObjMesh LoadObjParallel(const std::string& fileName, unsigned threadCount = 0);
+
+// Loads the file repeatedly with both loaders, prints timings and checks that the results match.
+void BenchmarkObjLoaders(const std::string& fileName, size_t runs);
@@ -0,0 +1,149 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+void ParallelFor(size_t count, unsigned threadCount, const std::function<void(size_t)>& body) {
+	std::atomic<size_t> next = 0;
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
+
+	auto worker = [&]() {
+		try {
+			for (size_t i = next++; i < count; i = next++) {
+				body(i);
+			}
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(errorMutex);
+
+			if (!error) {
+				error = std::current_exception();
+			}
+
+			next = count;
+		}
+	};
+
+	std::vector<std::thread> threads;
+
+	for (size_t i = 1; i < std::min<size_t>(threadCount, count); i++) {
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	Stop();
+}
+
+void WorkerPool::Start(unsigned threadCount) {
+	Stop();
+
+	this->stopping = false;
+
+	for (unsigned i = 1; i < threadCount; i++) {
+		this->threads.emplace_back(&WorkerPool::WorkerLoop, this, this->generation);
+	}
+}
+
+void WorkerPool::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->startCondition.notify_all();
+
+	for (std::thread& thread : this->threads) {
+		thread.join();
+	}
+
+	this->threads.clear();
+}
+
+void WorkerPool::Run(size_t count, const std::function<void(size_t)>& body) {
+	if (count == 0) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->body = &body;
+		this->count = count;
+		this->next = 0;
+		this->error = nullptr;
+		this->pending = this->threads.size();
+		this->generation++;
+	}
+
+	this->startCondition.notify_all();
+
+	Work();
+
+	std::exception_ptr error = nullptr;
+
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->doneCondition.wait(lock, [this]() { return this->pending == 0; });
+		this->body = nullptr;
+		std::swap(error, this->error);
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkerPool::WorkerLoop(uint64_t seen) {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->startCondition.wait(lock, [this, seen]() { return this->stopping || this->generation != seen; });
+
+			if (this->stopping) {
+				return;
+			}
+
+			seen = this->generation;
+		}
+
+		Work();
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if (--this->pending == 0) {
+			this->doneCondition.notify_one();
+		}
+	}
+}
+
+void WorkerPool::Work() {
+	try {
+		for (size_t i = this->next++; i < this->count; i = this->next++) {
+			(*this->body)(i);
+		}
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if (!this->error) {
+			this->error = std::current_exception();
+		}
+
+		this->next = this->count;
+	}
+}
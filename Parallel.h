@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs body(i) for every i in [0, count) on up to threadCount threads and rethrows the first exception on the calling thread.
+void ParallelFor(size_t count, unsigned threadCount, const std::function<void(size_t)>& body);
+
+// Like ParallelFor, but the threads are started once and wait between calls, for work issued every frame where
+// starting threads would cost more than the work itself. The calling thread takes part, so Start(n) starts n - 1 threads.
+class WorkerPool {
+private:
+	std::vector<std::thread> threads = {};
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+
+	// Set under the mutex by Run and read by the workers once they see a new generation.
+	const std::function<void(size_t)>* body = nullptr;
+	size_t count = 0;
+	uint64_t generation = 0;
+	size_t pending = 0;
+	bool stopping = false;
+
+	std::atomic<size_t> next = 0;
+	std::exception_ptr error = nullptr;
+
+	void WorkerLoop(uint64_t seen);
+	void Work();
+
+public:
+	~WorkerPool();
+
+	void Start(unsigned threadCount);
+	void Stop();
+	void Run(size_t count, const std::function<void(size_t)>& body);
+
+	unsigned GetThreadCount() const {
+		return static_cast<unsigned>(this->threads.size()) + 1;
+	}
+};
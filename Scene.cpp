@@ -0,0 +1,184 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <glm/gtc/matrix_transform.hpp>
+
+uint32_t Scene::AddObject(const glm::mat4& transform, uint32_t meshId, uint32_t materialId) {
+	this->transforms.push_back(transform);
+	this->meshIds.push_back(meshId);
+	this->materialIds.push_back(materialId);
+
+	return static_cast<uint32_t>(this->transforms.size() - 1);
+}
+
+void Scene::Clear() {
+	this->transforms.clear();
+	this->meshIds.clear();
+	this->materialIds.clear();
+}
+
+std::vector<InstanceBatch> BuildInstanceBatches(const Scene& scene, std::vector<glm::mat4>& instanceTransforms) {
+	std::vector<uint32_t> order(scene.GetObjectCount());
+	std::iota(order.begin(), order.end(), 0);
+
+	// Stable, so objects keep their scene order inside a batch.
+	std::stable_sort(order.begin(), order.end(), [&scene](uint32_t a, uint32_t b) {
+		if (scene.meshIds[a] != scene.meshIds[b]) {
+			return scene.meshIds[a] < scene.meshIds[b];
+		}
+
+		return scene.materialIds[a] < scene.materialIds[b];
+	});
+
+	std::vector<InstanceBatch> batches;
+	instanceTransforms.resize(order.size());
+
+	for (size_t i = 0; i < order.size(); i++) {
+		uint32_t object = order[i];
+		instanceTransforms[i] = scene.transforms[object];
+
+		if (batches.empty() || batches.back().meshId != scene.meshIds[object] || batches.back().materialId != scene.materialIds[object]) {
+			InstanceBatch batch = {};
+			batch.meshId = scene.meshIds[object];
+			batch.materialId = scene.materialIds[object];
+			batch.firstInstance = static_cast<uint32_t>(i);
+			batches.push_back(batch);
+		}
+
+		batches.back().instanceCount++;
+	}
+
+	return batches;
+}
+
+void CreateGridScene(Scene& scene, size_t count, float spacing, uint32_t meshId, uint32_t materialId) {
+	size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+	float offset = (side - 1) * spacing * 0.5f;
+
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 position = { (i % side) * spacing - offset, (i / side) * spacing - offset, 0.0f };
+		scene.AddObject(glm::translate(glm::mat4(1.0f), position), meshId, materialId);
+	}
+}
+
+Frustum GetFrustum(const glm::mat4& viewProjection) {
+	glm::vec4 rows[4];
+
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum = {};
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return frustum;
+}
+
+bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius) {
+	for (const glm::vec4& plane : frustum.planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void GetVertexBounds(const Vertex* vertices, size_t count, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+	boundsMin = glm::vec3(0.0f);
+	boundsMax = glm::vec3(0.0f);
+
+	for (size_t i = 0; i < count; i++) {
+		boundsMin = i == 0 ? vertices[i].position : glm::min(boundsMin, vertices[i].position);
+		boundsMax = i == 0 ? vertices[i].position : glm::max(boundsMax, vertices[i].position);
+	}
+}
+
+glm::vec4 GetBoundingSphere(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	return glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+}
+
+static float GetMaxScale(const glm::mat4& transform) {
+	return std::sqrt(std::max(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])), std::max(glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])), glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])))));
+}
+
+uint32_t SelectLod(const std::vector<float>& lodErrors, float scale, float distance, float lodScale) {
+	uint32_t level = 0;
+
+	while (level + 1 < lodErrors.size() && lodErrors[level + 1] * scale * lodScale <= distance) {
+		level++;
+	}
+
+	return level;
+}
+
+void CullInstanceBatches(const std::vector<InstanceBatch>& batches, const std::vector<glm::mat4>& instanceTransforms, const std::vector<glm::vec4>& meshBoundingSpheres, const std::vector<std::vector<float>>& meshLodErrors, const glm::mat4& model, const glm::mat4& view, const Frustum& frustum, float lodScale, uint32_t levelCount, glm::mat4* culledTransforms, std::vector<uint32_t>& visibleCounts) {
+	levelCount = std::max(1u, levelCount);
+	visibleCounts.assign(levelCount * batches.size(), 0);
+
+	static const std::vector<float> noLods;
+
+	for (size_t b = 0; b < batches.size(); b++) {
+		const InstanceBatch& batch = batches[b];
+
+		if (batch.meshId >= meshBoundingSpheres.size()) {
+			continue;
+		}
+
+		glm::vec4 sphere = meshBoundingSpheres[batch.meshId];
+		const std::vector<float>& lodErrors = batch.meshId < meshLodErrors.size() ? meshLodErrors[batch.meshId] : noLods;
+
+		for (uint32_t i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++) {
+			glm::mat4 world = model * instanceTransforms[i];
+			glm::vec3 center = glm::vec3(world * glm::vec4(glm::vec3(sphere), 1.0f));
+			float scale = GetMaxScale(world);
+
+			if (!IsSphereVisible(frustum, center, sphere.w * scale)) {
+				continue;
+			}
+
+			float distance = glm::length(glm::vec3(view * glm::vec4(center, 1.0f))) - sphere.w * scale;
+			uint32_t level = std::min(SelectLod(lodErrors, scale, distance, lodScale), levelCount - 1);
+
+			uint32_t& visible = visibleCounts[level * batches.size() + b];
+			culledTransforms[level * instanceTransforms.size() + batch.firstInstance + visible] = instanceTransforms[i];
+			visible++;
+		}
+	}
+}
+
+void SelectBatchLods(const std::vector<InstanceBatch>& batches, const std::vector<glm::mat4>& instanceTransforms, const std::vector<glm::vec4>& meshBoundingSpheres, const std::vector<std::vector<float>>& meshLodErrors, const glm::mat4& modelView, float lodScale, std::vector<uint32_t>& batchLods) {
+	batchLods.assign(batches.size(), 0);
+
+	for (size_t b = 0; b < batches.size(); b++) {
+		const InstanceBatch& batch = batches[b];
+
+		if (batch.meshId >= meshBoundingSpheres.size() || batch.meshId >= meshLodErrors.size() || batch.instanceCount == 0) {
+			continue;
+		}
+
+		glm::vec4 sphere = meshBoundingSpheres[batch.meshId];
+		uint32_t level = UINT32_MAX;
+
+		for (uint32_t i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++) {
+			glm::mat4 transform = modelView * instanceTransforms[i];
+			float scale = GetMaxScale(transform);
+			float distance = glm::length(glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f))) - sphere.w * scale;
+
+			level = std::min(level, SelectLod(meshLodErrors[batch.meshId], scale, distance, lodScale));
+		}
+
+		batchLods[b] = level;
+	}
+}
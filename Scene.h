@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Vertex.h"
+#include <vector>
+
+// Every object of the scene, stored as flat arrays indexed by object: object i has transforms[i], meshIds[i] and materialIds[i].
+struct Scene {
+	std::vector<glm::mat4> transforms;
+	std::vector<uint32_t> meshIds;
+	std::vector<uint32_t> materialIds;
+
+	size_t GetObjectCount() const {
+		return this->transforms.size();
+	}
+
+	uint32_t AddObject(const glm::mat4& transform, uint32_t meshId, uint32_t materialId);
+	void Clear();
+};
+
+// Objects sharing a mesh and a material, drawn together with one instanced draw per mesh draw. Their transforms are
+// stored contiguously from firstInstance.
+struct InstanceBatch {
+	uint32_t meshId = 0;
+	uint32_t materialId = 0;
+	uint32_t firstInstance = 0;
+	uint32_t instanceCount = 0;
+};
+
+// Groups the objects by mesh, then material, and writes their transforms in batch order into instanceTransforms.
+std::vector<InstanceBatch> BuildInstanceBatches(const Scene& scene, std::vector<glm::mat4>& instanceTransforms);
+
+// Planes of a view frustum as (normal, distance) with the normals pointing inwards, for a 0..1 depth range.
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+Frustum GetFrustum(const glm::mat4& viewProjection);
+bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius);
+
+void GetVertexBounds(const Vertex* vertices, size_t count, glm::vec3& boundsMin, glm::vec3& boundsMax);
+// Sphere around a bounding box, as (center, radius).
+glm::vec4 GetBoundingSphere(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+// The coarsest level of detail whose error, scaled by the instance's scale and by lodScale, is within distance.
+// Level errors never decrease, and distances at or behind the near side of the bounding sphere pick level 0.
+uint32_t SelectLod(const std::vector<float>& lodErrors, float scale, float distance, float lodScale);
+
+// Tests every instance of every batch against the frustum, using the bounding sphere of the batch's mesh transformed
+// by model * instance transform, and picks its level of detail from the sphere's distance to the camera. The visible
+// transforms of level l are written to culledTransforms from l * instanceTransforms.size() + the batch's
+// firstInstance, and their number to visibleCounts[l * batches.size() + batch]. Levels past levelCount are clamped.
+// Batches whose mesh has no bounding sphere get no instances.
+void CullInstanceBatches(const std::vector<InstanceBatch>& batches, const std::vector<glm::mat4>& instanceTransforms, const std::vector<glm::vec4>& meshBoundingSpheres, const std::vector<std::vector<float>>& meshLodErrors, const glm::mat4& model, const glm::mat4& view, const Frustum& frustum, float lodScale, uint32_t levelCount, glm::mat4* culledTransforms, std::vector<uint32_t>& visibleCounts);
+
+// Picks one level of detail per batch, for its nearest instance, for draws that can't vary it per instance.
+void SelectBatchLods(const std::vector<InstanceBatch>& batches, const std::vector<glm::mat4>& instanceTransforms, const std::vector<glm::vec4>& meshBoundingSpheres, const std::vector<std::vector<float>>& meshLodErrors, const glm::mat4& modelView, float lodScale, std::vector<uint32_t>& batchLods);
+
+// Fills the scene with count copies of one mesh on a square grid in the XY plane, centered on the origin.
+void CreateGridScene(Scene& scene, size_t count, float spacing, uint32_t meshId, uint32_t materialId);
@@ -0,0 +1,212 @@
+#include "StagingRing.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+void StagingRing::Init(VkDevice logicalDevice, VkBuffer buffer, void* mapped, VkDeviceSize capacity, VkDeviceSize alignment) {
+	this->logicalDevice = logicalDevice;
+	this->buffer = buffer;
+	this->mapped = static_cast<uint8_t*>(mapped);
+	this->capacity = capacity;
+	this->alignment = alignment;
+	this->stats.capacity = capacity;
+}
+
+bool StagingRing::TryAllocate(VkDeviceSize size, VkDeviceSize& offset) {
+	if (this->entries.empty()) {
+		offset = 0;
+		return size <= this->capacity;
+	}
+
+	VkDeviceSize head = AlignUp(this->entries.back().end, this->alignment);
+	VkDeviceSize tail = this->entries.front().offset;
+
+	// Wrapped: the free space is the gap between the newest and the oldest entry.
+	if (this->entries.back().offset < tail) {
+		offset = head;
+		return head + size <= tail;
+	}
+
+	// Otherwise it is the end of the buffer, then its start up to the oldest entry.
+	if (head + size <= this->capacity) {
+		offset = head;
+		return true;
+	}
+
+	offset = 0;
+	return size <= tail;
+}
+
+void StagingRing::PopReleased() {
+	while (!this->entries.empty() && this->entries.front().released && this->entries.front().waiters == 0) {
+		this->entries.pop_front();
+		this->firstEntry++;
+	}
+}
+
+bool StagingRing::WaitOldestSubmitted(std::unique_lock<std::mutex>& lock) {
+	if (this->entries.empty()) {
+		return false;
+	}
+
+	// Entries are reclaimed in order, so only the oldest one can make room.
+	uint64_t id = this->firstEntry;
+
+	if (this->entries.front().released) {
+		// Another allocation already waited for it, and it is popped as soon as the last such waiter returns.
+		this->waitDone.wait(lock, [&]() {
+			return this->firstEntry != id;
+		});
+
+		return true;
+	}
+
+	VkFence fence = this->entries.front().fence;
+	VkSemaphore semaphore = this->entries.front().semaphore;
+	uint64_t value = this->entries.front().value;
+
+	if (fence == VK_NULL_HANDLE && semaphore == VK_NULL_HANDLE) {
+		// Still being recorded; nothing to wait for.
+		return false;
+	}
+
+	// Other threads keep allocating, submitting and releasing while this one waits on the GPU.
+	this->entries.front().waiters++;
+	lock.unlock();
+
+	if (fence != VK_NULL_HANDLE) {
+		vkWaitForFences(this->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+	}
+	else {
+		VkSemaphoreWaitInfo waitInfo = {};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &semaphore;
+		waitInfo.pValues = &value;
+
+		vkWaitSemaphores(this->logicalDevice, &waitInfo, UINT64_MAX);
+	}
+
+	lock.lock();
+
+	// Entries with waiters are never popped, so it is still the oldest one.
+	Entry& entry = this->entries[id - this->firstEntry];
+	entry.waiters--;
+
+	// The GPU is done reading it, so the owner's later Release has nothing left to do.
+	entry.released = true;
+	PopReleased();
+	this->waitDone.notify_all();
+
+	return true;
+}
+
+VkDeviceSize StagingRing::GetBytesInUse() const {
+	if (this->entries.empty()) {
+		return 0;
+	}
+
+	VkDeviceSize tail = this->entries.front().offset;
+	VkDeviceSize head = this->entries.back().end;
+
+	return head > tail ? head - tail : this->capacity - tail + head;
+}
+
+bool StagingRing::Allocate(VkDeviceSize size, StagingRegion& region) {
+	if (!IsEnabled()) {
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	size = size > 0 ? size : 1;
+
+	VkDeviceSize offset = 0;
+	bool fits = size <= this->capacity;
+	bool stalled = false;
+	std::chrono::time_point stallStart = std::chrono::high_resolution_clock::now();
+
+	while (fits && !TryAllocate(size, offset)) {
+		fits = WaitOldestSubmitted(lock);
+		stalled = stalled || fits;
+	}
+
+	if (stalled) {
+		this->stats.stallCount++;
+		this->stats.stallMs += std::chrono::duration<double, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - stallStart).count();
+	}
+
+	if (!fits) {
+		this->stats.overflowCount++;
+		this->stats.overflowBytes += size;
+		return false;
+	}
+
+	Entry entry = {};
+	entry.offset = offset;
+	entry.end = offset + size;
+	this->entries.push_back(entry);
+
+	region.buffer = this->buffer;
+	region.offset = offset;
+	region.size = size;
+	region.mapped = this->mapped + offset;
+	region.entry = this->firstEntry + this->entries.size() - 1;
+
+	this->stats.allocationCount++;
+	this->stats.bytesStreamed += size;
+	this->stats.peakBytesInUse = std::max(this->stats.peakBytesInUse, GetBytesInUse());
+
+	return true;
+}
+
+void StagingRing::Submitted(const StagingRegion& region, VkFence fence) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	if (region.entry >= this->firstEntry && region.entry < this->firstEntry + this->entries.size()) {
+		this->entries[region.entry - this->firstEntry].fence = fence;
+	}
+}
+
+void StagingRing::Submitted(const StagingRegion& region, VkSemaphore semaphore, uint64_t value) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	if (region.entry >= this->firstEntry && region.entry < this->firstEntry + this->entries.size()) {
+		Entry& entry = this->entries[region.entry - this->firstEntry];
+		entry.semaphore = semaphore;
+		entry.value = value;
+	}
+}
+
+void StagingRing::Release(const StagingRegion& region) {
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	// The owner destroys or resets the fence or semaphore next, so let allocations still waiting on it return first.
+	this->waitDone.wait(lock, [&]() {
+		return region.entry < this->firstEntry || region.entry >= this->firstEntry + this->entries.size() || this->entries[region.entry - this->firstEntry].waiters == 0;
+	});
+
+	// Already reclaimed if an allocation waited for it.
+	if (region.entry >= this->firstEntry && region.entry < this->firstEntry + this->entries.size()) {
+		this->entries[region.entry - this->firstEntry].released = true;
+		PopReleased();
+	}
+}
+
+StagingRingStats StagingRing::GetStats() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	return this->stats;
+}
+
+void StagingRing::PrintStats() {
+	StagingRingStats stats = GetStats();
+
+	std::cout << "Staging ring: " << (stats.bytesStreamed / 1024) << " KiB streamed in " << stats.allocationCount << " allocations, peak " << (stats.peakBytesInUse / 1024) << " of " << (stats.capacity / 1024)
+		<< " KiB, " << stats.stallCount << " stalls (" << stats.stallMs << " ms), " << stats.overflowCount << " overflows to dedicated buffers (" << (stats.overflowBytes / 1024) << " KiB)" << std::endl;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "Allocator.h"
+
+// A range of staging memory. Ring regions live in the shared ring buffer; when the ring cannot fit a request, the
+// region is a dedicated buffer of its own and memory is set.
+struct StagingRegion {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;
+
+	// Ring entry id, or UINT64_MAX for a dedicated buffer.
+	uint64_t entry = UINT64_MAX;
+	Allocation memory = {};
+};
+
+struct StagingRingStats {
+	VkDeviceSize capacity = 0;
+	VkDeviceSize bytesStreamed = 0;
+	VkDeviceSize peakBytesInUse = 0;
+	uint64_t allocationCount = 0;
+	// Allocations that had to wait for the GPU to release older regions.
+	uint64_t stallCount = 0;
+	double stallMs = 0.0;
+	// Allocations that did not fit even in an empty ring, or found it full of unsubmitted regions.
+	uint64_t overflowCount = 0;
+	VkDeviceSize overflowBytes = 0;
+};
+
+// A persistently mapped staging buffer handed out front to back and reclaimed in allocation order. Every region is
+// released by its owner once the GPU is done with it; regions tied to a fence or timeline semaphore can also be
+// waited on when the ring runs full. Owners must release a region before resetting or destroying the fence or
+// semaphore it was submitted with. Safe to use from several threads.
+class StagingRing {
+private:
+	struct Entry {
+		VkDeviceSize offset = 0;
+		VkDeviceSize end = 0;
+		bool released = false;
+
+		VkFence fence = VK_NULL_HANDLE;
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		uint64_t value = 0;
+
+		// Allocations blocked on the fence or semaphore with the mutex unlocked. The entry is kept, and its owner's
+		// Release held back, until they return.
+		uint32_t waiters = 0;
+	};
+
+	VkDevice logicalDevice = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	uint8_t* mapped = nullptr;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize alignment = 16;
+
+	// Live entries in allocation order; entries.front() has id firstEntry.
+	std::deque<Entry> entries = {};
+	uint64_t firstEntry = 0;
+
+	StagingRingStats stats = {};
+	std::mutex mutex;
+	std::condition_variable waitDone;
+
+	bool TryAllocate(VkDeviceSize size, VkDeviceSize& offset);
+	void PopReleased();
+	bool WaitOldestSubmitted(std::unique_lock<std::mutex>& lock);
+	VkDeviceSize GetBytesInUse() const;
+
+public:
+	void Init(VkDevice logicalDevice, VkBuffer buffer, void* mapped, VkDeviceSize capacity, VkDeviceSize alignment);
+
+	bool IsEnabled() const {
+		return this->buffer != VK_NULL_HANDLE;
+	}
+
+	// Returns false if the region cannot be placed in the ring; the caller then creates a dedicated buffer.
+	bool Allocate(VkDeviceSize size, StagingRegion& region);
+	// Ties the region to the submission that reads from it.
+	void Submitted(const StagingRegion& region, VkFence fence);
+	void Submitted(const StagingRegion& region, VkSemaphore semaphore, uint64_t value);
+	void Release(const StagingRegion& region);
+
+	StagingRingStats GetStats();
+	void PrintStats();
+};
@@ -0,0 +1,323 @@
+#include "TextureCache.h"
+#include "MipGenerator.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+static const uint32_t TEXTURE_CACHE_MAGIC = 0x58455456; // "VTEX"
+static const uint32_t TEXTURE_CACHE_VERSION = 2;
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool IsCacheableFormat(uint32_t format) {
+	return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+}
+
+static uint64_t GetLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+	if (format == VK_FORMAT_BC1_RGB_SRGB_BLOCK) {
+		return static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * 8;
+	}
+
+	return static_cast<uint64_t>(width) * height * 4;
+}
+
+bool TextureCache::Open(const std::string& cachePath, const std::string& sourcePath) {
+	Close();
+
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+
+	if (!GetFileStamp(sourcePath, sourceSize, sourceTime) || !this->file.Open(cachePath)) {
+		return false;
+	}
+
+	const TextureCacheHeader* candidate = reinterpret_cast<const TextureCacheHeader*>(this->file.GetData());
+	uint64_t fileSize = this->file.GetSize();
+
+	bool valid = fileSize >= sizeof(TextureCacheHeader)
+		&& candidate->magic == TEXTURE_CACHE_MAGIC
+		&& candidate->version == TEXTURE_CACHE_VERSION
+		&& IsCacheableFormat(candidate->format)
+		&& candidate->sourceSize == sourceSize
+		&& candidate->sourceTime == sourceTime
+		&& candidate->sourcePathHash == HashFilePath(sourcePath)
+		&& candidate->fileSize == fileSize
+		&& candidate->mipLevels > 0 && candidate->mipLevels <= 32
+		&& sizeof(TextureCacheHeader) + static_cast<uint64_t>(candidate->mipLevels) * sizeof(TextureCacheLevel) <= candidate->dataOffset
+		&& candidate->dataOffset % 16 == 0
+		&& candidate->dataOffset + candidate->dataSize <= fileSize;
+
+	if (valid) {
+		const TextureCacheLevel* levels = reinterpret_cast<const TextureCacheLevel*>(this->file.GetData() + sizeof(TextureCacheHeader));
+
+		for (uint32_t i = 0; valid && i < candidate->mipLevels; i++) {
+			valid = levels[i].offset % 16 == 0
+				&& levels[i].size == GetLevelSize(static_cast<VkFormat>(candidate->format), levels[i].width, levels[i].height)
+				&& levels[i].offset + levels[i].size <= candidate->dataSize;
+		}
+	}
+
+	if (!valid) {
+		std::cout << "Discarding stale texture cache " << cachePath << std::endl;
+		Close();
+		return false;
+	}
+
+	this->header = candidate;
+	return true;
+}
+
+void TextureCache::Close() {
+	this->file.Close();
+	this->header = nullptr;
+}
+
+VkFormat TextureCache::GetFormat() const {
+	return static_cast<VkFormat>(this->header->format);
+}
+
+uint32_t TextureCache::GetWidth() const {
+	return this->header->width;
+}
+
+uint32_t TextureCache::GetHeight() const {
+	return this->header->height;
+}
+
+uint32_t TextureCache::GetMipLevels() const {
+	return this->header->mipLevels;
+}
+
+const TextureCacheLevel* TextureCache::GetLevels() const {
+	return reinterpret_cast<const TextureCacheLevel*>(this->file.GetData() + sizeof(TextureCacheHeader));
+}
+
+const void* TextureCache::GetData() const {
+	return this->file.GetData() + this->header->dataOffset;
+}
+
+VkDeviceSize TextureCache::GetDataSize() const {
+	return this->header->dataSize;
+}
+
+std::string GetTextureCachePath(const std::string& cacheDirectory, const std::string& sourcePath, VkFormat format) {
+	return GetCacheFilePath(cacheDirectory, sourcePath, format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? "bc1.tex" : "rgba8.tex");
+}
+
+static uint16_t PackRGB565(const float color[3]) {
+	uint32_t r = static_cast<uint32_t>(std::lround(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+	uint32_t g = static_cast<uint32_t>(std::lround(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+	uint32_t b = static_cast<uint32_t>(std::lround(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(uint16_t packed, int color[3]) {
+	color[0] = ((packed >> 11) & 31) * 255 / 31;
+	color[1] = ((packed >> 5) & 63) * 255 / 63;
+	color[2] = (packed & 31) * 255 / 31;
+}
+
+// Encodes one 4x4 block in four-color BC1 mode. The endpoints span the block's bounding box, along the diagonal that
+// follows the sign of the red/green and blue/green covariance, inset by 1/16 so the extremes land on the palette.
+static void EncodeBC1Block(const uint8_t texels[16][4], uint8_t* out) {
+	float minColor[3] = { 255.0f, 255.0f, 255.0f };
+	float maxColor[3] = { 0.0f, 0.0f, 0.0f };
+	float mean[3] = {};
+
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			minColor[c] = std::min(minColor[c], static_cast<float>(texels[i][c]));
+			maxColor[c] = std::max(maxColor[c], static_cast<float>(texels[i][c]));
+			mean[c] += texels[i][c] / 16.0f;
+		}
+	}
+
+	float covarianceRG = 0.0f;
+	float covarianceBG = 0.0f;
+
+	for (int i = 0; i < 16; i++) {
+		covarianceRG += (texels[i][0] - mean[0]) * (texels[i][1] - mean[1]);
+		covarianceBG += (texels[i][2] - mean[2]) * (texels[i][1] - mean[1]);
+	}
+
+	if (covarianceRG < 0.0f) {
+		std::swap(minColor[0], maxColor[0]);
+	}
+
+	if (covarianceBG < 0.0f) {
+		std::swap(minColor[2], maxColor[2]);
+	}
+
+	for (int c = 0; c < 3; c++) {
+		float inset = (maxColor[c] - minColor[c]) / 16.0f;
+		maxColor[c] -= inset;
+		minColor[c] += inset;
+	}
+
+	uint16_t color0 = PackRGB565(maxColor);
+	uint16_t color1 = PackRGB565(minColor);
+
+	// color0 > color1 selects the four-color mode.
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	uint32_t indices = 0;
+
+	if (color0 != color1) {
+		int palette[4][3];
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int bestDistance = INT32_MAX;
+
+			for (int p = 0; p < 4; p++) {
+				int dr = texels[i][0] - palette[p][0];
+				int dg = texels[i][1] - palette[p][1];
+				int db = texels[i][2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+
+				if (distance < bestDistance) {
+					best = p;
+					bestDistance = distance;
+				}
+			}
+
+			indices |= static_cast<uint32_t>(best) << (2 * i);
+		}
+	}
+
+	out[0] = static_cast<uint8_t>(color0 & 0xFF);
+	out[1] = static_cast<uint8_t>(color0 >> 8);
+	out[2] = static_cast<uint8_t>(color1 & 0xFF);
+	out[3] = static_cast<uint8_t>(color1 >> 8);
+	out[4] = static_cast<uint8_t>(indices & 0xFF);
+	out[5] = static_cast<uint8_t>((indices >> 8) & 0xFF);
+	out[6] = static_cast<uint8_t>((indices >> 16) & 0xFF);
+	out[7] = static_cast<uint8_t>(indices >> 24);
+}
+
+static std::vector<uint8_t> EncodeBC1(const uint8_t* pixels, uint32_t width, uint32_t height) {
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+
+	std::vector<uint8_t> blocks(static_cast<size_t>(blocksX) * blocksY * 8);
+	uint8_t texels[16][4];
+
+	for (uint32_t by = 0; by < blocksY; by++) {
+		for (uint32_t bx = 0; bx < blocksX; bx++) {
+			// Edge blocks of levels that aren't a multiple of 4 repeat their last row and column.
+			for (uint32_t i = 0; i < 16; i++) {
+				uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+				uint32_t y = std::min(by * 4 + i / 4, height - 1);
+
+				memcpy(texels[i], &pixels[(static_cast<size_t>(y) * width + x) * 4], 4);
+			}
+
+			EncodeBC1Block(texels, &blocks[(static_cast<size_t>(by) * blocksX + bx) * 8]);
+		}
+	}
+
+	return blocks;
+}
+
+bool BuildTextureCache(const std::string& cachePath, const std::string& sourcePath, VkFormat format) {
+	TextureCacheHeader header = {};
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourcePathHash = HashFilePath(sourcePath);
+
+	if (!GetFileStamp(sourcePath, header.sourceSize, header.sourceTime)) {
+		throw std::runtime_error("Could not load image " + sourcePath);
+	}
+
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+	if (!pixels) {
+		throw std::runtime_error("Could not load image " + sourcePath);
+	}
+
+	bool opaque = true;
+
+	for (size_t i = 3; opaque && i < static_cast<size_t>(width) * height * 4; i += 4) {
+		opaque = pixels[i] == 255;
+	}
+
+	if (format != VK_FORMAT_BC1_RGB_SRGB_BLOCK || !opaque) {
+		format = VK_FORMAT_R8G8B8A8_SRGB;
+	}
+
+	// Built once per source image, so the sharper Kaiser filter is worth its cost here.
+	MipChain chain = GenerateMipChain(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), MipFilter::Kaiser);
+	stbi_image_free(pixels);
+
+	header.format = format;
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+	header.mipLevels = static_cast<uint32_t>(chain.levels.size());
+
+	std::vector<TextureCacheLevel> levels(header.mipLevels);
+	std::vector<std::vector<uint8_t>> encodedLevels(header.mipLevels);
+	uint64_t offset = 0;
+
+	for (uint32_t i = 0; i < header.mipLevels; i++) {
+		const MipLevel& level = chain.levels[i];
+
+		if (format == VK_FORMAT_BC1_RGB_SRGB_BLOCK) {
+			encodedLevels[i] = EncodeBC1(chain.data.data() + level.offset, level.width, level.height);
+		}
+
+		levels[i].width = level.width;
+		levels[i].height = level.height;
+		levels[i].offset = offset;
+		levels[i].size = format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? encodedLevels[i].size() : level.size;
+
+		offset = AlignUp(offset + levels[i].size, 16);
+	}
+
+	header.dataOffset = AlignUp(sizeof(TextureCacheHeader) + levels.size() * sizeof(TextureCacheLevel), 16);
+	header.dataSize = levels.back().offset + levels.back().size;
+	header.fileSize = header.dataOffset + header.dataSize;
+
+	std::ofstream file = OpenCacheFile(cachePath);
+
+	if (!file.is_open()) {
+		return false;
+	}
+
+	static const char zeros[16] = {};
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(TextureCacheHeader));
+	file.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(TextureCacheLevel));
+	file.write(zeros, static_cast<std::streamsize>(header.dataOffset - sizeof(TextureCacheHeader) - levels.size() * sizeof(TextureCacheLevel)));
+
+	for (uint32_t i = 0; i < header.mipLevels; i++) {
+		const uint8_t* levelData = format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? encodedLevels[i].data() : chain.data.data() + chain.levels[i].offset;
+		file.write(reinterpret_cast<const char*>(levelData), static_cast<std::streamsize>(levels[i].size));
+
+		uint64_t end = levels[i].offset + levels[i].size;
+
+		if (i + 1 < header.mipLevels) {
+			file.write(zeros, static_cast<std::streamsize>(levels[i + 1].offset - end));
+		}
+	}
+
+	return CommitCacheFile(file, cachePath);
+}
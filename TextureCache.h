@@ -0,0 +1,64 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <vulkan/vulkan.h>
+#include <string>
+
+// On-disk layout of a texture cache file: this header, one TextureCacheLevel per mip level and the level data,
+// each level starting on a 16-byte boundary so it can be used directly as a vkCmdCopyBufferToImage buffer offset.
+struct TextureCacheHeader {
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t mipLevels = 0;
+
+	// The cache is only used while the source image still has this size, modification time and path.
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	uint64_t sourcePathHash = 0;
+
+	uint64_t dataOffset = 0;
+	uint64_t dataSize = 0;
+	uint64_t fileSize = 0;
+};
+
+struct TextureCacheLevel {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Relative to the start of the level data.
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+// A texture cache file mapped read-only into memory, holding every mip level ready to be copied into a staging buffer.
+class TextureCache {
+private:
+	MappedFile file;
+	const TextureCacheHeader* header = nullptr;
+
+public:
+	// Maps the cache file for sourcePath. Returns false, leaving the cache closed, if it is missing, stale or malformed.
+	bool Open(const std::string& cachePath, const std::string& sourcePath);
+	void Close();
+
+	bool IsOpen() const {
+		return this->header != nullptr;
+	}
+
+	VkFormat GetFormat() const;
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+	uint32_t GetMipLevels() const;
+	const TextureCacheLevel* GetLevels() const;
+	const void* GetData() const;
+	VkDeviceSize GetDataSize() const;
+};
+
+std::string GetTextureCachePath(const std::string& cacheDirectory, const std::string& sourcePath, VkFormat format);
+
+// Decodes the source image, builds the full mip chain on the CPU and writes it in the requested format, either
+// VK_FORMAT_R8G8B8A8_SRGB or VK_FORMAT_BC1_RGB_SRGB_BLOCK. Images with transparency are always stored as RGBA8
+// since BC1 would drop their alpha. Throws if the source can't be decoded, returns false if the cache can't be written.
+bool BuildTextureCache(const std::string& cachePath, const std::string& sourcePath, VkFormat format);
@@ -0,0 +1,59 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtx/hash.hpp>
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+struct Vertex {
+	glm::vec3 position;
+	glm::vec3 color;
+	glm::vec2 texCoord;
+
+	bool operator==(const Vertex& other) const {
+		return this->position == other.position && this->texCoord == other.texCoord && this->color == other.color;
+	}
+};
+
+// Mixes every 64-bit word of the vertex and finishes with the MurmurHash3 avalanche, so neighbouring grid positions
+// land far apart. Negative zeros are folded into positive ones to stay consistent with operator==.
+inline uint64_t HashVertex(const Vertex& vertex) {
+	static_assert(sizeof(Vertex) % sizeof(uint64_t) == 0 && sizeof(Vertex) % sizeof(float) == 0, "Vertex must be tightly packed floats.");
+
+	float values[sizeof(Vertex) / sizeof(float)];
+	memcpy(values, &vertex, sizeof(Vertex));
+
+	for (float& value : values) {
+		value += 0.0f;
+	}
+
+	uint64_t words[sizeof(Vertex) / sizeof(uint64_t)];
+	memcpy(words, values, sizeof(Vertex));
+
+	uint64_t hash = sizeof(Vertex);
+
+	for (uint64_t word : words) {
+		hash ^= word * 0x9E3779B97F4A7C15ull;
+		hash = ((hash << 27) | (hash >> 37)) * 0xC2B2AE3D27D4EB4Full;
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+template<> struct std::hash<Vertex> {
+	size_t operator()(Vertex const& vertex) const {
+		return static_cast<size_t>(HashVertex(vertex));
+	}
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "Vertex.h"
+#include <array>
+#include <cmath>
+
+// GPU-side vertex layouts. Models are loaded, welded, optimized and cached as full-precision Vertex and packed into
+// one of these on upload; the vertex shader undoes the quantization with the VertexQuantization in the uniforms.
+
+enum class PositionFormat {
+	Float32,
+	// Normalized to the mesh's bounding box.
+	Unorm16
+};
+
+enum class TexCoordFormat {
+	Float32,
+	Float16,
+	// Normalized to the mesh's texture coordinate bounds.
+	Unorm16
+};
+
+// Maps packed attributes back to model space: position = offset + packed * scale, likewise for texture coordinates.
+struct VertexQuantization {
+	alignas(16) glm::vec4 positionOffset = glm::vec4(0.0f);
+	alignas(16) glm::vec4 positionScale = glm::vec4(1.0f);
+	// xy offset, zw scale.
+	alignas(16) glm::vec4 texCoordTransform = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+inline uint16_t QuantizeUnorm16(float value) {
+	return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+}
+
+template<PositionFormat Format> struct PositionAttribute;
+
+template<> struct PositionAttribute<PositionFormat::Float32> {
+	using Type = glm::vec3;
+	static constexpr VkFormat FORMAT = VK_FORMAT_R32G32B32_SFLOAT;
+
+	static Type Pack(const glm::vec3& position, const VertexQuantization&) {
+		return position;
+	}
+};
+
+template<> struct PositionAttribute<PositionFormat::Unorm16> {
+	// Padded to four components; three-component 16-bit vertex formats are rarely supported.
+	using Type = std::array<uint16_t, 4>;
+	static constexpr VkFormat FORMAT = VK_FORMAT_R16G16B16A16_UNORM;
+
+	static Type Pack(const glm::vec3& position, const VertexQuantization& quantization) {
+		glm::vec3 normalized = (position - glm::vec3(quantization.positionOffset)) / glm::vec3(quantization.positionScale);
+		return { QuantizeUnorm16(normalized.x), QuantizeUnorm16(normalized.y), QuantizeUnorm16(normalized.z), 0 };
+	}
+};
+
+template<TexCoordFormat Format> struct TexCoordAttribute;
+
+template<> struct TexCoordAttribute<TexCoordFormat::Float32> {
+	using Type = glm::vec2;
+	static constexpr VkFormat FORMAT = VK_FORMAT_R32G32_SFLOAT;
+
+	static Type Pack(const glm::vec2& texCoord, const VertexQuantization&) {
+		return texCoord;
+	}
+};
+
+template<> struct TexCoordAttribute<TexCoordFormat::Float16> {
+	using Type = std::array<uint16_t, 2>;
+	static constexpr VkFormat FORMAT = VK_FORMAT_R16G16_SFLOAT;
+
+	static Type Pack(const glm::vec2& texCoord, const VertexQuantization&) {
+		uint32_t packed = glm::packHalf2x16(texCoord);
+		return { static_cast<uint16_t>(packed & 0xFFFF), static_cast<uint16_t>(packed >> 16) };
+	}
+};
+
+template<> struct TexCoordAttribute<TexCoordFormat::Unorm16> {
+	using Type = std::array<uint16_t, 2>;
+	static constexpr VkFormat FORMAT = VK_FORMAT_R16G16_UNORM;
+
+	static Type Pack(const glm::vec2& texCoord, const VertexQuantization& quantization) {
+		glm::vec2 offset = glm::vec2(quantization.texCoordTransform.x, quantization.texCoordTransform.y);
+		glm::vec2 scale = glm::vec2(quantization.texCoordTransform.z, quantization.texCoordTransform.w);
+		glm::vec2 normalized = (texCoord - offset) / scale;
+		return { QuantizeUnorm16(normalized.x), QuantizeUnorm16(normalized.y) };
+	}
+};
+
+// The members in the same order as Vertex; the color is dropped from layouts without it.
+template<PositionFormat Position, TexCoordFormat TexCoord, bool HasColor> struct VertexStorage {
+	typename PositionAttribute<Position>::Type position;
+	glm::vec3 color;
+	typename TexCoordAttribute<TexCoord>::Type texCoord;
+};
+
+template<PositionFormat Position, TexCoordFormat TexCoord> struct VertexStorage<Position, TexCoord, false> {
+	typename PositionAttribute<Position>::Type position;
+	typename TexCoordAttribute<TexCoord>::Type texCoord;
+};
+
+template<PositionFormat Position, TexCoordFormat TexCoord, bool HasColor>
+struct VertexLayout : VertexStorage<Position, TexCoord, HasColor> {
+	static constexpr bool HAS_COLOR = HasColor;
+
+	// Layouts without a color attribute need the shader variant built with -DNO_VERTEX_COLOR.
+	static const char* GetShaderPath() {
+		return HasColor ? "shaders/vert.spv" : "shaders/vert_compact.spv";
+	}
+
+	static VertexQuantization GetQuantization(const Vertex* vertices, size_t count) {
+		VertexQuantization quantization = {};
+
+		if (count == 0) {
+			return quantization;
+		}
+
+		if constexpr (Position == PositionFormat::Unorm16) {
+			glm::vec3 boundsMin = vertices[0].position;
+			glm::vec3 boundsMax = vertices[0].position;
+
+			for (size_t i = 1; i < count; i++) {
+				boundsMin = glm::min(boundsMin, vertices[i].position);
+				boundsMax = glm::max(boundsMax, vertices[i].position);
+			}
+
+			// Flat axes keep a non-zero scale so packing doesn't divide by zero.
+			quantization.positionOffset = glm::vec4(boundsMin, 0.0f);
+			quantization.positionScale = glm::vec4(glm::max(boundsMax - boundsMin, glm::vec3(1e-20f)), 0.0f);
+		}
+
+		if constexpr (TexCoord == TexCoordFormat::Unorm16) {
+			glm::vec2 boundsMin = vertices[0].texCoord;
+			glm::vec2 boundsMax = vertices[0].texCoord;
+
+			for (size_t i = 1; i < count; i++) {
+				boundsMin = glm::min(boundsMin, vertices[i].texCoord);
+				boundsMax = glm::max(boundsMax, vertices[i].texCoord);
+			}
+
+			quantization.texCoordTransform = glm::vec4(boundsMin, glm::max(boundsMax - boundsMin, glm::vec2(1e-20f)));
+		}
+
+		return quantization;
+	}
+
+	// Writes count packed vertices to packed, which must have room for them.
+	static void Pack(const Vertex* vertices, size_t count, const VertexQuantization& quantization, VertexLayout* packed) {
+		for (size_t i = 0; i < count; i++) {
+			packed[i].position = PositionAttribute<Position>::Pack(vertices[i].position, quantization);
+			packed[i].texCoord = TexCoordAttribute<TexCoord>::Pack(vertices[i].texCoord, quantization);
+
+			if constexpr (HasColor) {
+				packed[i].color = vertices[i].color;
+			}
+		}
+	}
+
+	// Binding 0 holds the vertices, binding 1 one model matrix per instance.
+	static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions() {
+		std::vector<VkVertexInputBindingDescription> inputBindingDescriptions(2);
+
+		inputBindingDescriptions[0].binding = 0;
+		inputBindingDescriptions[0].stride = sizeof(VertexLayout);
+		inputBindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		inputBindingDescriptions[1].binding = 1;
+		inputBindingDescriptions[1].stride = sizeof(glm::mat4);
+		inputBindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		return inputBindingDescriptions;
+	}
+
+	// Locations stay fixed across layouts: 0 position, 1 color, 2 texture coordinates, 3-6 the instance matrix.
+	static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions() {
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+
+		VkVertexInputAttributeDescription position = {};
+		position.binding = 0;
+		position.location = 0;
+		position.format = PositionAttribute<Position>::FORMAT;
+		position.offset = offsetof(VertexLayout, position);
+		attributeDescriptions.push_back(position);
+
+		if constexpr (HasColor) {
+			VkVertexInputAttributeDescription color = {};
+			color.binding = 0;
+			color.location = 1;
+			color.format = VK_FORMAT_R32G32B32_SFLOAT;
+			color.offset = offsetof(VertexLayout, color);
+			attributeDescriptions.push_back(color);
+		}
+
+		VkVertexInputAttributeDescription texCoord = {};
+		texCoord.binding = 0;
+		texCoord.location = 2;
+		texCoord.format = TexCoordAttribute<TexCoord>::FORMAT;
+		texCoord.offset = offsetof(VertexLayout, texCoord);
+		attributeDescriptions.push_back(texCoord);
+
+		// The instance's mat4 takes one location per column.
+		for (uint32_t column = 0; column < 4; column++) {
+			VkVertexInputAttributeDescription instance = {};
+			instance.binding = 1;
+			instance.location = 3 + column;
+			instance.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			instance.offset = column * sizeof(glm::vec4);
+			attributeDescriptions.push_back(instance);
+		}
+
+		return attributeDescriptions;
+	}
+};
+
+// The loaded Vertex as is, 32 bytes.
+using FullVertex = VertexLayout<PositionFormat::Float32, TexCoordFormat::Float32, true>;
+// Every loaded model is white, so the color is dropped: 12 bytes.
+using CompactVertex = VertexLayout<PositionFormat::Unorm16, TexCoordFormat::Unorm16, false>;
+
+static_assert(sizeof(FullVertex) == 32 && sizeof(CompactVertex) == 12, "Vertex layouts must be tightly packed.");
+
+// The layout vertex buffers are uploaded in, unless its shader is missing and the engine falls back to FullVertex.
+// Define FULL_PRECISION_VERTICES to build with 32-byte float vertices.
+#ifdef FULL_PRECISION_VERTICES
+using GpuVertex = FullVertex;
+#else
+using GpuVertex = CompactVertex;
+#endif
@@ -0,0 +1,159 @@
+#include "VertexWeld.h"
+#include "ObjLoader.h"
+#include "Benchmark.h"
+
+#include <chrono>
+#include <iostream>
+#include <unordered_map>
+
+void VertexWeldTable::Reserve(size_t expectedCount) {
+	size_t slotCount = 64;
+
+	while (slotCount * 3 < expectedCount * 4) {
+		slotCount *= 2;
+	}
+
+	if (slotCount > this->slots.size()) {
+		Rehash(slotCount);
+	}
+}
+
+void VertexWeldTable::Rehash(size_t slotCount) {
+	this->slots.assign(slotCount, Slot());
+	size_t mask = slotCount - 1;
+
+	for (uint32_t index = 0; index < this->vertices.size(); index++) {
+		uint64_t hash = HashVertex(this->vertices[index]);
+		size_t i = hash & mask;
+
+		while (this->slots[i].index != UINT32_MAX) {
+			i = (i + 1) & mask;
+		}
+
+		this->slots[i].tag = static_cast<uint32_t>(hash >> 32);
+		this->slots[i].index = index;
+	}
+}
+
+// The glm-based combination the engine used to hash vertices with, kept as the baseline.
+struct LegacyVertexHash {
+	size_t operator()(const Vertex& vertex) const {
+		return ((std::hash<glm::vec3>()(vertex.position) ^ (std::hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (std::hash<glm::vec2>()(vertex.texCoord) << 1);
+	}
+};
+
+static std::vector<uint32_t> WeldLegacy(const std::vector<Vertex>& corners) {
+	std::unordered_map<Vertex, uint32_t, LegacyVertexHash> uniqueVertices = {};
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	for (const Vertex& vertex : corners) {
+		if (uniqueVertices.count(vertex) == 0) {
+			uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(vertex);
+		}
+
+		indices.push_back(uniqueVertices[vertex]);
+	}
+
+	return indices;
+}
+
+static std::vector<uint32_t> WeldUnorderedMap(const std::vector<Vertex>& corners) {
+	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	uniqueVertices.reserve(corners.size());
+	indices.reserve(corners.size());
+
+	for (const Vertex& vertex : corners) {
+		std::pair<std::unordered_map<Vertex, uint32_t>::iterator, bool> result = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(vertices.size()));
+
+		if (result.second) {
+			vertices.push_back(vertex);
+		}
+
+		indices.push_back(result.first->second);
+	}
+
+	return indices;
+}
+
+static std::vector<uint32_t> WeldFlatTable(const std::vector<Vertex>& corners) {
+	VertexWeldTable table;
+	std::vector<uint32_t> indices;
+
+	table.Reserve(corners.size());
+	indices.reserve(corners.size());
+
+	for (const Vertex& vertex : corners) {
+		indices.push_back(table.Insert(vertex).first);
+	}
+
+	return indices;
+}
+
+static void BenchmarkWelders(const std::string& label, const std::vector<Vertex>& corners, size_t runs) {
+	const std::vector<std::pair<const char*, std::vector<uint32_t>(*)(const std::vector<Vertex>&)>> welders = {
+		{ "unordered_map, glm hash, count + operator[]", WeldLegacy },
+		{ "unordered_map, HashVertex, try_emplace", WeldUnorderedMap },
+		{ "VertexWeldTable", WeldFlatTable },
+	};
+
+	std::cout << "Vertex welding: " << label << ", " << corners.size() << " indices, " << runs << " runs" << std::endl;
+
+	std::vector<uint32_t> expected;
+
+	for (const auto& welder : welders) {
+		std::vector<double> samples;
+		std::vector<uint32_t> indices;
+
+		for (size_t i = 0; i < runs; i++) {
+			std::chrono::time_point startTime = std::chrono::high_resolution_clock::now();
+			indices = welder.second(corners);
+			samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
+		}
+
+		if (expected.empty()) {
+			expected = indices;
+		}
+
+		BenchmarkStats stats = ComputeBenchmarkStats(samples);
+
+		std::cout << "  " << welder.first << ": p50 " << stats.p50 << " ms, " << (corners.size() / stats.p50 / 1000.0) << " M indices/s"
+			<< (indices == expected ? "" : " (output differs)") << std::endl;
+	}
+}
+
+void BenchmarkVertexWelding(const std::string& modelPath, size_t runs) {
+	ObjMesh mesh = LoadObjParallel(modelPath);
+	std::vector<Vertex> corners;
+
+	corners.reserve(mesh.indices.size());
+
+	for (uint32_t index : mesh.indices) {
+		corners.push_back(mesh.vertices[index]);
+	}
+
+	BenchmarkWelders(modelPath, corners, runs);
+
+	// A regular grid with integer coordinates is the worst case for the glm hash combination.
+	const uint32_t GRID_SIZE = 1024;
+	corners.clear();
+
+	for (uint32_t y = 0; y < GRID_SIZE; y++) {
+		for (uint32_t x = 0; x < GRID_SIZE; x++) {
+			for (glm::vec2 corner : { glm::vec2(0, 0), glm::vec2(1, 0), glm::vec2(1, 1), glm::vec2(0, 0), glm::vec2(1, 1), glm::vec2(0, 1) }) {
+				Vertex vertex = {};
+				vertex.position = { x + corner.x, y + corner.y, 0.0f };
+				vertex.color = { 1.0f, 1.0f, 1.0f };
+				vertex.texCoord = { (x + corner.x) / GRID_SIZE, (y + corner.y) / GRID_SIZE };
+
+				corners.push_back(vertex);
+			}
+		}
+	}
+
+	BenchmarkWelders(std::to_string(GRID_SIZE) + "x" + std::to_string(GRID_SIZE) + " grid", corners, runs);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Vertex.h"
+#include <string>
+#include <utility>
+#include <algorithm>
+
+// Flat open-addressing table for welding identical vertices. Slots hold a hash tag and an index into the densely
+// stored unique vertices and are probed linearly, so a lookup touches one cache line in the common case and
+// inserting never allocates once the table has been reserved.
+class VertexWeldTable {
+private:
+	struct Slot {
+		uint32_t tag = 0;
+		uint32_t index = UINT32_MAX;
+	};
+
+	std::vector<Slot> slots = {};
+	std::vector<Vertex> vertices = {};
+
+	void Rehash(size_t slotCount);
+
+public:
+	// Sizes the table so that expectedCount unique vertices fit without rehashing. The index count is a safe upper bound.
+	void Reserve(size_t expectedCount);
+
+	// Returns the index of the vertex and whether it was newly inserted.
+	std::pair<uint32_t, bool> Insert(const Vertex& vertex) {
+		if ((this->vertices.size() + 1) * 4 > this->slots.size() * 3) {
+			Rehash(std::max<size_t>(64, this->slots.size() * 2));
+		}
+
+		uint64_t hash = HashVertex(vertex);
+		uint32_t tag = static_cast<uint32_t>(hash >> 32);
+		size_t mask = this->slots.size() - 1;
+
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			Slot& slot = this->slots[i];
+
+			if (slot.index == UINT32_MAX) {
+				slot.tag = tag;
+				slot.index = static_cast<uint32_t>(this->vertices.size());
+				this->vertices.push_back(vertex);
+
+				return { slot.index, true };
+			}
+
+			if (slot.tag == tag && this->vertices[slot.index] == vertex) {
+				return { slot.index, false };
+			}
+		}
+	}
+
+	size_t Size() const {
+		return this->vertices.size();
+	}
+
+	std::vector<Vertex>& GetVertices() {
+		return this->vertices;
+	}
+};
+
+// Welds the corners of the model and of a synthetic grid with std::unordered_map and with VertexWeldTable and prints indices per second.
+void BenchmarkVertexWelding(const std::string& modelPath, size_t runs);
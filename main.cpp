@@ -1,18 +1,238 @@
 #include "Engine.h"
 
-int main() {
+// Thrown for arguments that can't be used at all; the message is printed as is.
+struct ArgumentError : std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
+
+static void PrintUsage() {
+	std::cout << "Usage: V-Renderer [options]\n"
+		<< "  --headless, --frames N, --capture FILE\n"
+		<< "  --benchmark, --benchmark-frames N, --benchmark-seconds S, --benchmark-resizes N, --benchmark-output FILE, --benchmark-culling\n"
+		<< "  --benchmark-obj N, --benchmark-weld N, --benchmark-mips N, --benchmark-meshopt N\n"
+		<< "  --no-mesh-optimization, --32bit-indices, --lod-levels N, --lod-error PIXELS\n"
+		<< "  --cpu-mipmaps, --sync-loading, --staging-ring MB\n"
+		<< "  --prerecorded, --record-threads N, --split-draws TRIANGLES\n"
+		<< "  --instances N, --instance-spacing D, --culling off|cpu|gpu\n"
+		<< "  --frames-in-flight N, --present-mode fifo|mailbox|immediate|fifo-relaxed, --fps-limit FPS" << std::endl;
+}
+
+// The value after a flag, which a flag at the end of the command line doesn't have.
+static std::string GetValue(int argc, char** argv, int& i, const std::string& arg) {
+	if (i + 1 >= argc) {
+		throw ArgumentError("Missing value for " + arg + ".");
+	}
+
+	return argv[++i];
+}
+
+// std::stoul accepts "-5" and wraps it around to a huge count, so anything with a minus sign is rejected first.
+static unsigned long long ParseCount(const std::string& value) {
+	if (value.find('-') != std::string::npos) {
+		throw std::out_of_range(value);
+	}
+
+	return std::stoull(value);
+}
+
+int main(int argc, char** argv) {
 	Engine engine;
+	std::ofstream capture;
+	size_t objBenchmarkRuns = 0;
+	size_t weldBenchmarkRuns = 0;
+	size_t mipBenchmarkRuns = 0;
+	size_t meshOptimizerBenchmarkRuns = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		try {
+			if (arg == "--headless") {
+				engine.HEADLESS = true;
+			}
+			else if (arg == "--frames") {
+				engine.HEADLESS_FRAMES = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark") {
+				engine.BENCHMARK = true;
+			}
+			else if (arg == "--benchmark-frames") {
+				engine.BENCHMARK_FRAMES = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark-seconds") {
+				engine.BENCHMARK_SECONDS = std::stod(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark-resizes") {
+				engine.BENCHMARK_RESIZES = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark-output") {
+				engine.BENCHMARK_OUTPUT = GetValue(argc, argv, i, arg);
+			}
+			else if (arg == "--benchmark-obj") {
+				objBenchmarkRuns = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark-weld") {
+				weldBenchmarkRuns = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark-mips") {
+				mipBenchmarkRuns = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark-meshopt") {
+				meshOptimizerBenchmarkRuns = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--no-mesh-optimization") {
+				engine.OPTIMIZE_MESHES = false;
+			}
+			else if (arg == "--32bit-indices") {
+				engine.SIXTEEN_BIT_INDICES = false;
+			}
+			else if (arg == "--lod-levels") {
+				engine.LOD_LEVELS = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--lod-error") {
+				engine.LOD_ERROR_PIXELS = std::stof(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--cpu-mipmaps") {
+				engine.CPU_MIPMAPS = true;
+			}
+			else if (arg == "--sync-loading") {
+				engine.ASYNC_STREAMING = false;
+			}
+			else if (arg == "--staging-ring") {
+				engine.STAGING_RING_SIZE = ParseCount(GetValue(argc, argv, i, arg)) * 1024 * 1024;
+			}
+			else if (arg == "--prerecorded") {
+				engine.RECORD_EVERY_FRAME = false;
+			}
+			else if (arg == "--record-threads") {
+				engine.RECORD_THREADS = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--split-draws") {
+				engine.DRAW_SPLIT_TRIANGLES = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--instances") {
+				engine.SCENE_INSTANCES = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--instance-spacing") {
+				engine.SCENE_SPACING = std::stof(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--culling") {
+				std::string mode = GetValue(argc, argv, i, arg);
+
+				if (mode == "off") {
+					engine.CULL_MODE = CullMode::Off;
+				}
+				else if (mode == "cpu") {
+					engine.CULL_MODE = CullMode::CPU;
+				}
+				else if (mode == "gpu") {
+					engine.CULL_MODE = CullMode::GPU;
+				}
+				else {
+					throw std::invalid_argument(mode);
+				}
+			}
+			else if (arg == "--frames-in-flight") {
+				engine.MAX_CONCURRENT_FRAMES = ParseCount(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--present-mode") {
+				std::string mode = GetValue(argc, argv, i, arg);
+
+				if (mode == "fifo") {
+					engine.PRESENT_MODE = VK_PRESENT_MODE_FIFO_KHR;
+				}
+				else if (mode == "mailbox") {
+					engine.PRESENT_MODE = VK_PRESENT_MODE_MAILBOX_KHR;
+				}
+				else if (mode == "immediate") {
+					engine.PRESENT_MODE = VK_PRESENT_MODE_IMMEDIATE_KHR;
+				}
+				else if (mode == "fifo-relaxed") {
+					engine.PRESENT_MODE = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+				}
+				else {
+					throw std::invalid_argument(mode);
+				}
+			}
+			else if (arg == "--fps-limit") {
+				engine.FPS_LIMIT = std::stod(GetValue(argc, argv, i, arg));
+			}
+			else if (arg == "--benchmark-culling") {
+				engine.BENCHMARK = true;
+				engine.BENCHMARK_CULLING = true;
+			}
+			else if (arg == "--capture") {
+				capture.open(GetValue(argc, argv, i, arg), std::ios::binary);
+			}
+			else {
+				std::cout << "Unknown argument " << arg << "." << std::endl;
+				PrintUsage();
+				return 2;
+			}
+		}
+		catch (const ArgumentError& e) {
+			std::cout << e.what() << std::endl;
+			PrintUsage();
+			return 2;
+		}
+		catch (const std::logic_error&) {
+			// Thrown by std::stoul and friends for values that aren't numbers or don't fit, and for unknown modes.
+			std::cout << "Invalid value \"" << argv[i] << "\" for " << arg << "." << std::endl;
+			return 2;
+		}
+	}
+
+	// Exits with 0 on success, 1 when loading, rendering or a benchmark fails and 2 on bad arguments.
+	try {
+		if (objBenchmarkRuns > 0) {
+			BenchmarkObjLoaders(engine.MODEL_PATH, objBenchmarkRuns);
+			return 0;
+		}
+
+		if (weldBenchmarkRuns > 0) {
+			BenchmarkVertexWelding(engine.MODEL_PATH, weldBenchmarkRuns);
+			return 0;
+		}
+
+		if (meshOptimizerBenchmarkRuns > 0) {
+			BenchmarkMeshOptimizer(engine.MODEL_PATH, meshOptimizerBenchmarkRuns);
+			return 0;
+		}
+	}
+	catch (std::exception& e) {
+		std::cout << "Benchmark failed. Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	if (capture.is_open()) {
+		// Raw 4-byte-per-pixel frames, back to back, written straight from mapped memory.
+		engine.readbackCallback = [&capture](const ReadbackFrame& frame) {
+			capture.write(static_cast<const char*>(frame.pixels), static_cast<std::streamsize>(frame.width) * frame.height * 4);
+		};
+	}
 
 	try {
 		engine.Load();
 	}
 	catch (std::exception & e) {
 		std::cout << "Could not load renderer. Error: " << e.what() << std::endl;
-		return 0;
+		return 1;
+	}
+
+	try {
+		if (mipBenchmarkRuns > 0) {
+			engine.BenchmarkMipmaps(engine.TEXTURE_PATH, mipBenchmarkRuns);
+		}
+		else {
+			engine.Start();
+		}
+	}
+	catch (std::exception& e) {
+		std::cout << "Rendering failed. Error: " << e.what() << std::endl;
+		return 1;
 	}
 
-	engine.Start();
 	engine.Close();
 
-	return 1;
-}
\ No newline at end of file
+	return 0;
+}
@@ -0,0 +1,17 @@
+#!/bin/sh
+# Rebuilds the SPIR-V the engine loads from the GLSL sources next to this script and validates the result.
+# Needs glslc and spirv-val from the Vulkan SDK on PATH.
+set -e
+cd "$(dirname "$0")"
+
+compile() {
+	output="$1"
+	shift
+	glslc --target-env=vulkan1.2 "$@" -o "$output"
+	spirv-val --target-env vulkan1.2 "$output"
+}
+
+compile vert.spv shader.vert
+compile frag.spv shader.frag
+compile cull.spv cull.comp
+compile vert_compact.spv -DNO_VERTEX_COLOR shader.vert
@@ -4,18 +4,30 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 projection;
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 texCoordTransform;
 } UBO;
 
+// Compiled twice: vert.spv for layouts with a color attribute, and vert_compact.spv with -DNO_VERTEX_COLOR.
 layout (location = 0) in vec3 inPosition;
+#ifndef NO_VERTEX_COLOR
 layout (location = 1) in vec3 inColor;
+#endif
 layout (location = 2) in vec2 inTexCoord;
+layout (location = 3) in mat4 inModel;
 
 
 layout (location = 0) out vec3 fragColor;
 layout (location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = UBO.projection * UBO.view * UBO.model * vec4(inPosition, 1.0);
+    vec3 position = UBO.positionOffset.xyz + inPosition * UBO.positionScale.xyz;
+    gl_Position = UBO.projection * UBO.view * UBO.model * inModel * vec4(position, 1.0);
+#ifdef NO_VERTEX_COLOR
+    fragColor = vec3(1.0);
+#else
     fragColor = inColor;
-    fragTexCoord = inTexCoord;
-}
\ No newline at end of file
+#endif
+    fragTexCoord = UBO.texCoordTransform.xy + inTexCoord * UBO.texCoordTransform.zw;
+}